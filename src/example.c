@@ -5,15 +5,14 @@
 
 /* ----------------------------------------------------------------------------------- */
 
-static void on_audio(const int16_t* samples, uint32_t nbytes, uint32_t nframes);
+static void on_audio(const int16_t* samples, uint32_t nbytes, uint32_t nframes, const video_generator_timestamp* ts);
 static void on_sigh(int s);
 
 /* ----------------------------------------------------------------------------------- */
 
-uint64_t now = 0;
-uint64_t total_audio_frames = 0;
 video_generator_settings cfg;
 video_generator gen;
+FILE* audio_fp = NULL;
 uint8_t must_run = 1;
 uint64_t goal_frame = 0;
 uint64_t goal_copy = 0;
@@ -34,27 +33,18 @@ int main() {
   cfg.bip_frequency = 500;
   cfg.bop_frequency = 1500;
 
-  if (0 != video_generator_init(&cfg, &gen)) {
-    printf("Error: cannot initialize the video generator.\n");
-    exit(EXIT_FAILURE);
-  }
-
-  /* Write raw audio block to a file. This chunk will be repeadetly used while running. */
-  FILE* fp = fopen("out_s16_44100_stereo.pcm", "wb");
-  if (!fp) {
+  /* Write the raw audio to a file, from the audio callback. */
+  audio_fp = fopen("out_s16_44100_stereo.pcm", "wb");
+  if (!audio_fp) {
     printf("Error: cannot open pcm output file.\n");
     exit(EXIT_FAILURE);
   }
 
-  if (1 != fwrite(gen.audio_buffer, gen.audio_nbytes, 1, fp)) {
-    printf("Error: failed to write the audio block.\n");
+  if (0 != video_generator_init(&cfg, &gen)) {
+    printf("Error: cannot initialize the video generator.\n");
     exit(EXIT_FAILURE);
   }
 
-  if (0 != fclose(fp)) {
-    printf("Error: failed to close the audio example file.\n");
-  }
-
   /* Write video to a raw yuv file. */
   video_fp = fopen("out_yuv420p_320x240.yuv", "wb");
   if (!video_fp) {
@@ -81,6 +71,10 @@ int main() {
     
   video_generator_clear(&gen);
 
+  if (0 != fclose(audio_fp)) {
+    printf("Error: failed to close the audio file correctly.\n");
+  }
+
   if (0 != fclose(video_fp)) {
     printf("Error: failed to close the video file correctly.\n");
   }
@@ -97,8 +91,11 @@ static void on_sigh(int s) {
   must_run = 0;
 }
 
-static void on_audio(const int16_t* samples, uint32_t nbytes, uint32_t nframes) {
-  total_audio_frames += nframes; /* this can be used for our timebase */
-  now = ((1.0 / 44100.0) * 1e9) * total_audio_frames; /* not used in this example but this could be used as your timebase. */
-  goal_frame = now / ((uint64_t)gen.fps * 1e3); /* set the goal frame up to which we have to generate frames. */
+static void on_audio(const int16_t* samples, uint32_t nbytes, uint32_t nframes, const video_generator_timestamp* ts) {
+  if (1 != fwrite(samples, nbytes, 1, audio_fp)) {
+    printf("Error: failed to write the audio period.\n");
+  }
+
+  /* the audio is our timebase: generate the frames up to the end of this period. */
+  goal_frame = ((ts->sample + nframes) * cfg.fps) / ts->timebase_den;
 }
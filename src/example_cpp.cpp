@@ -0,0 +1,91 @@
+/*
+
+  C++ example
+  ------------
+
+  Renders frames with the C++ API in all supported pixel formats and bit
+  depths and writes them into raw files:
+
+     ./example_cpp [width] [height] [nframes]
+
+  Play the output with e.g.:
+
+     ffplay -f rawvideo -pix_fmt p010le -video_size 1280x720 out_nv12_10.yuv
+
+ */
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <video_generator.hpp>
+
+/* ----------------------------------------------------------------------------------- */
+
+static int render(int width, int height, int nframes, vg::PixelFormat format, int depth, const char* filepath);
+
+/* ----------------------------------------------------------------------------------- */
+
+int main(int argc, char** argv) {
+
+  int width = (argc > 1) ? atoi(argv[1]) : 1280;
+  int height = (argc > 2) ? atoi(argv[2]) : 720;
+  int nframes = (argc > 3) ? atoi(argv[3]) : 250;
+
+  try {
+    render(width, height, nframes, vg::PixelFormat::I420, 8, "out_i420_8.yuv");
+    render(width, height, nframes, vg::PixelFormat::I420, 10, "out_i420_10.yuv");
+    render(width, height, nframes, vg::PixelFormat::NV12, 8, "out_nv12_8.yuv");
+    render(width, height, nframes, vg::PixelFormat::NV12, 10, "out_nv12_10.yuv");
+  }
+  catch (const std::exception& e) {
+    printf("Error: %s\n", e.what());
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static int render(int width, int height, int nframes, vg::PixelFormat format, int depth, const char* filepath) {
+
+  static const char* simd_names[] = { "scalar", "sse2", "avx2" };
+  video_generator_settings cfg;
+
+  memset(&cfg, 0x00, sizeof(cfg));
+  cfg.width = width;
+  cfg.height = height;
+  cfg.fps = 25;
+
+  vg::Generator gen(cfg);
+  vg::Frame frame = gen.make_frame(format, depth);
+
+  FILE* fp = fopen(filepath, "wb");
+  if (!fp) {
+    printf("Error: cannot open %s.\n", filepath);
+    return -1;
+  }
+
+  double elapsed = 0.0;
+
+  for (int i = 0; i < nframes; ++i) {
+
+    auto start = std::chrono::steady_clock::now();
+    gen.render(frame);
+    elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    vg::span<uint8_t> bytes = frame.bytes();
+    if (1 != fwrite(bytes.data(), bytes.size(), 1, fp)) {
+      printf("Error: failed to write frame %llu.\n", (unsigned long long)frame.frame);
+      break;
+    }
+  }
+
+  fclose(fp);
+
+  printf("%s: %d frames, %.3f ms per frame (%s).\n",
+         filepath, nframes,
+         (nframes > 0) ? (elapsed * 1000.0) / nframes : 0.0,
+         simd_names[(int)gen.simd()]);
+
+  return 0;
+}
@@ -0,0 +1,210 @@
+/*
+
+  Shared memory example
+  ----------------------
+
+  Start a producer which renders frames into a shared memory ring, then
+  start one or more consumers in other terminals:
+
+     ./example_shm produce /video_generator 3840 2160 60
+     ./example_shm consume /video_generator [delay in ms per frame]
+
+  Pass a delay to the consumer to simulate a slow encoder and see the overruns.
+  When a producer crashed its segment is left behind and a new producer 
+  refuses to use the name; remove it with:
+
+     ./example_shm remove /video_generator
+
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <video_generator.h>
+#include <video_generator_shm.h>
+
+/* ----------------------------------------------------------------------------------- */
+
+static int produce(const char* name, int width, int height, int fps);
+static int consume(const char* name, int delay_ms);
+static uint64_t now_ns();
+static void sleep_ns(uint64_t ns);
+static void on_sigh(int s);
+
+/* ----------------------------------------------------------------------------------- */
+
+volatile sig_atomic_t must_run = 1;
+
+/* ----------------------------------------------------------------------------------- */
+
+int main(int argc, char** argv) {
+
+  if (argc < 3) {
+    printf("Usage: %s produce <name> [width] [height] [fps]\n", argv[0]);
+    printf("       %s consume <name> [delay in ms per frame]\n", argv[0]);
+    printf("       %s remove <name>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  signal(SIGINT, on_sigh);
+
+  if (0 == strcmp(argv[1], "produce")) {
+    return produce(argv[2],
+                   (argc > 3) ? atoi(argv[3]) : 1280,
+                   (argc > 4) ? atoi(argv[4]) : 720,
+                   (argc > 5) ? atoi(argv[5]) : 25);
+  }
+  else if (0 == strcmp(argv[1], "consume")) {
+    return consume(argv[2], (argc > 3) ? atoi(argv[3]) : 0);
+  }
+  else if (0 == strcmp(argv[1], "remove")) {
+    return (0 == video_generator_shm_remove(argv[2])) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  printf("Error: unknown mode %s\n", argv[1]);
+  return EXIT_FAILURE;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static int produce(const char* name, int width, int height, int fps) {
+
+  video_generator_settings cfg;
+  video_generator gen;
+  video_generator_shm shm;
+  uint64_t start, frame_ns, due, now;
+
+  memset(&cfg, 0x00, sizeof(cfg));
+  cfg.width = width;
+  cfg.height = height;
+  cfg.fps = fps;
+
+  if (0 != video_generator_init(&cfg, &gen)) {
+    printf("Error: cannot initialize the video generator.\n");
+    return EXIT_FAILURE;
+  }
+
+  if (0 != video_generator_shm_create(&shm, name, &gen, 8)) {
+    printf("Error: cannot create the shared memory ring.\n");
+    video_generator_clear(&gen);
+    return EXIT_FAILURE;
+  }
+
+  printf("Producing %dx%d@%d into %s, %zu bytes.\n", width, height, fps, name, shm.nbytes);
+
+  frame_ns = 1000000000ull / fps;
+  start = now_ns();
+
+  while (must_run) {
+
+    if (0 != video_generator_shm_update(&shm, &gen)) {
+      printf("Error: failed to generate a frame.\n");
+      break;
+    }
+
+    due = start + gen.frame * frame_ns;
+    now = now_ns();
+    if (due > now) {
+      sleep_ns(due - now);
+    }
+
+    if (0 == (gen.frame % fps)) {
+      printf("Frame: %llu\n", (unsigned long long)gen.frame);
+    }
+  }
+
+  video_generator_shm_destroy(&shm);
+  video_generator_clear(&gen);
+
+  return EXIT_SUCCESS;
+}
+
+static int consume(const char* name, int delay_ms) {
+
+  video_generator_shm shm;
+  video_generator_shm_frame frame;
+  uint64_t nframes = 0;
+  uint64_t ntorn = 0;
+  uint64_t start, last;
+  uint32_t checksum = 0;
+  uint32_t i;
+  int r;
+
+  if (0 != video_generator_shm_open(&shm, name)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("Consuming %ux%u from %s.\n", shm.header->width, shm.header->height, name);
+
+  start = now_ns();
+  last = start;
+
+  while (must_run) {
+
+    r = video_generator_shm_acquire(&shm, &frame, 1000);
+    if (VIDEO_GENERATOR_SHM_CLOSED == r) {
+      printf("Producer stopped.\n");
+      break;
+    }
+    if (0 != r) {
+      continue;
+    }
+
+    /* read one byte per cache line so the frame is really touched. */
+    for (i = 0; i < frame.width * frame.height; i += 64) {
+      checksum += frame.planes[0][i];
+    }
+
+    if (delay_ms > 0) {
+      sleep_ns((uint64_t)delay_ms * 1000000ull);
+    }
+
+    if (VIDEO_GENERATOR_SHM_OVERRUN == video_generator_shm_release(&shm, &frame)) {
+      ntorn++;
+    }
+
+    nframes++;
+
+    if (now_ns() - last > 1000000000ull) {
+      last = now_ns();
+      printf("Frames: %llu, fps: %.2f, overruns: %llu, torn: %llu, seq: %llu, pts: %lld, dirty rects: %u\n",
+             (unsigned long long)nframes,
+             nframes / ((last - start) * 1e-9),
+             (unsigned long long)shm.overruns,
+             (unsigned long long)ntorn,
+             (unsigned long long)frame.seq,
+             (long long)frame.timestamp.pts,
+             frame.num_dirty_rects);
+    }
+  }
+
+  printf("Received %llu frames, %llu overruns (checksum: %u).\n",
+         (unsigned long long)nframes,
+         (unsigned long long)shm.overruns,
+         checksum);
+
+  video_generator_shm_close(&shm);
+
+  return EXIT_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns) {
+  struct timespec ts;
+  ts.tv_sec = ns / 1000000000ull;
+  ts.tv_nsec = ns % 1000000000ull;
+  nanosleep(&ts, NULL);
+}
+
+static void on_sigh(int s) {
+  (void)s;
+  must_run = 0;
+}
@@ -2,7 +2,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include <video_generator.h>
+#include <video_generator_trace.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  define HAVE_SSE2
+#  include <emmintrin.h>
+#endif
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
 
 /* ----------------------------------------------------------------------------------- */
 /*                          T H R E A D I N G                                          */
@@ -70,6 +84,37 @@
     return 0;
   }
 
+  /* 
+     The mutex is a kernel object so we can't use CONDITION_VARIABLE. An auto
+     reset event together with SignalObjectAndWait() gives the same behavior
+     because unlocking and starting to wait is atomic.
+  */
+  int cond_init(cond* c) {
+    if (NULL == c) { return -1; } 
+    c->handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (NULL == c->handle) { return -2; } 
+    return 0;
+  }
+
+  int cond_destroy(cond* c) {
+    if (NULL == c) { return -1; } 
+    if (0 == CloseHandle(c->handle)) { return -2; } 
+    return 0;
+  }
+
+  int cond_wait(cond* c, mutex* m) {
+    if (NULL == c) { return -1; } 
+    if (NULL == m) { return -2; } 
+    if (WAIT_FAILED == SignalObjectAndWait(m->handle, c->handle, INFINITE, FALSE)) { return -3; } 
+    return mutex_lock(m);
+  }
+
+  int cond_signal(cond* c) {
+    if (NULL == c) { return -1; } 
+    if (!SetEvent(c->handle)) { return -2; } 
+    return 0;
+  }
+
 #elif defined(__linux) || defined(__APPLE__)
 
   void* thread_function_wrapper(void* t) {
@@ -120,6 +165,31 @@
     return 0;
   }
 
+  int cond_init(cond* c) {
+    if (NULL == c) { return -1; }
+    if (0 != pthread_cond_init(&c->handle, NULL)) { return -2; }
+    return 0;
+  }
+
+  int cond_destroy(cond* c) {
+    if (NULL == c) { return -1; }
+    if (0 != pthread_cond_destroy(&c->handle)) { return -2; }
+    return 0;
+  }
+
+  int cond_wait(cond* c, mutex* m) {
+    if (NULL == c) { return -1; }
+    if (NULL == m) { return -2; }
+    if (0 != pthread_cond_wait(&c->handle, &m->handle)) { return -3; }
+    return 0;
+  }
+
+  int cond_signal(cond* c) {
+    if (NULL == c) { return -1; }
+    if (0 != pthread_cond_signal(&c->handle)) { return -2; }
+    return 0;
+  }
+
   int thread_join(thread* t) {
     if (NULL == t) { return -1; }
     if (0 != pthread_join(t->handle, NULL)) { return -2; } 
@@ -189,11 +259,32 @@ static uint64_t ns() {
 #endif
 }
 
+/* Sleeps for (at least) the given number of nanoseconds. */
+static void sleep_ns(uint64_t nanos) {
+#if defined(_WIN32)
+  Sleep((DWORD)(nanos / 1000000));
+#else
+  struct timespec req;
+  req.tv_sec = nanos / 1000000000ull;
+  req.tv_nsec = nanos % 1000000000ull;
+  nanosleep(&req, NULL);
+#endif
+}
+
 /* ----------------------------------------------------------------------------------- */
 /*                          V I D E O   G E N E R A T O  R                             */
 /* ----------------------------------------------------------------------------------- */
 
 #define CLIP(X) ( (X) > 255 ? 255 : (X) < 0 ? 0 : X)
+
+typedef struct scaler_axis scaler_axis;
+
+struct scaler_axis {
+  uint32_t dst;                                           /* number of output pixels. */
+  uint32_t ntaps;                                         /* number of weights per output pixel, a multiple of `align`. */
+  uint32_t* start;                                        /* first input pixel of each output pixel. */
+  uint16_t* weights;                                      /* `ntaps` weights per output pixel, they sum to 1 << 14. */
+};
 #define RGB2Y(R, G, B) CLIP(( (  66 * (R) + 129 * (G) +  25 * (B) + 128) >> 8) +  16)
 #define RGB2U(R, G, B) CLIP(( ( -38 * (R) -  74 * (G) + 112 * (B) + 128) >> 8) + 128)
 #define RGB2V(R, G, B) CLIP(( ( 112 * (R) -  94 * (G) -  18 * (B) + 128) >> 8) + 128)
@@ -201,8 +292,47 @@ static uint64_t ns() {
 static uint64_t numbersfont_pixel_data[] = {0x0,0x0,0xffffffff0000,0x0,0xffffff0000000000,0xffffffffffff,0x0,0x0,0xffffffffffffff00,0xff,0xffffffffffff0000,0xffffffffffffffff,0xffffffffffffffff,0xffffffff,0xffff000000000000,0xffffffffff,0x0,0xff00000000000000,0xffffffffffff,0x0,0xffff000000000000,0xffffffffffffffff,0xffffffffffffffff,0x0,0xffffffffff000000,0xffffff,0x0,0xffffff0000000000,0xffffffff,0x0,0x0,0xff00ffffff000000,0xffffffff,0x0,0x0,0xffffffffff00,0x0,0xffffffffff000000,0xffffffffffffffff,0x0,0xff00000000000000,0xffffffffffffffff,0xffffff,0xffffffffffff0000,0xffffffffffffffff,0xffffffffffffffff,0xffffffff,0xffffffffff000000,0xffffffffffffffff,0x0,0xffffff0000000000,0xffffffffffffffff,0xff,0xffff000000000000,0xffffffffffffffff,0xffffffffffffffff,0x0,0xffffffffffffff00,0xffffffffffff,0x0,0xffffffffff000000,0xffffffffffffff,0x0,0x0,0xff00ffffffff0000,0xffffffff,0x0,0x0,0xffffffffffff,0x0,0xffffffffffffff00,0xffffffffffffffff,0xffff,0xffffff0000000000,0xffffffffffffffff,0xffffffff,0xffffffffffff0000,0xffffffffffffffff,0xffffffffffffffff,0xffffffff,0xffffffffffff0000,0xffffffffffffffff,0xff,0xffffffffff000000,0xffffffffffffffff,0xffff,0xffffff0000000000,0xffffffffffffffff,0xffffffffffffffff,0xff00000000000000,0xffffffffffffffff,0xffffffffffffff,0x0,0xffffffffffff0000,0xffffffffffffffff,0x0,0x0,0xff00ffffffffff00,0xffffffff,0x0,0xff00000000000000,0xffffffffffff,0x0,0xffffffffffffffff,0xffffffffffffffff,0xffffff,0xffffffff00000000,0xffffffffffffffff,0xffffffffff,0xffffffffffff0000,0xffffffffffffffff,0xffffffffffffffff,0xffffffff,0xffffffffffffff00,0xffffffffffffffff,0xffff,0xffffffffffff0000,0xffffffffffffffff,0xffffffff,0xffffff0000000000,0xffffffffffffffff,0xffffffffffffffff,0xffff000000000000,0xffffffffffffffff,0xffffffffffffffff,0x0,0xffffffffffffffff,0xffffffffffffffff,0xffff,0x0,0xff00ffffffffffff,0xffffffff,0x0,0xff00000000000000,0xffffffffffff,0xff00000000000000,0xffffffffffffffff,0xffffffffffffffff,0xffffffff,0xffffffffff000000,0xffffffffffffffff,0xffffffffffff,0xffffffffffff0000,0xffffffffffffffff,0xffffffffffffffff,0xffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffff,0xffffffffffffff00,0xffffffffffffffff,0xffffffff,0xffffff0000000000,0xffffffffffffffff,0xffffffffffffffff,0xffff000000000000,0xffffffffffffffff,0xffffffffffffffff,0xff,0xffffffffffffffff,0xffffffffffffffff,0xffff,0xff00000000000000,0xff00ffffffffffff,0xffffffff,0x0,0xffff000000000000,0xffffffffffff,0xff00000000000000,0xffffffffffff,0xffffff0000000000,0xffffffffff,0xffffffffffff0000,0xff0000000000ffff,0xffffffffffffff,0x0,0x0,0xff00000000000000,0xffffff,0xffffffffffffff,0xffffffff00000000,0xffffff,0xffffffffffffff00,0xffff000000000000,0xffffffffff,0xffffff0000000000,0xffff,0x0,0xffffff0000000000,0xffffffff,0xffffffffff000000,0xff0000000000ffff,0xffffffffffffff,0xffffff0000000000,0xffffff,0xffff000000000000,0xffffffffffff,0x0,0x0,0xffffff0000000000,0xffffffffffff,0xffff000000000000,0xffffffffff,0xff00000000000000,0xffffffffff,0xffffffffffff0000,0x0,0xffffffffffff00,0x0,0x0,0xffff000000000000,0xff0000000000ffff,0xffffffffff,0xffff000000000000,0xffffffff,0xffffffffffff,0xff00000000000000,0xffffffffff,0xffffff0000000000,0xffff,0x0,0xffffff0000000000,0xffffff,0xffffffff00000000,0xffff00000000ffff,0xffffffffff,0xff00000000000000,0xffffffff,0xffffff0000000000,0xffffffffffff,0x0,0x0,0xffffff0000000000,0xffffffffffff,0xffff000000000000,0xffffff,0x0,0xffffffffffff,0xffffffffffff00,0x0,0xffffffffff0000,0x0,0x0,0xffffff0000000000,0xff000000000000ff,0xffffffff,0xff00000000000000,0xffffffff,0xffffffffff,0x0,0xffffffffffff,0xffffffff00000000,0xffff,0x0,0xffffffff00000000,0xffff,0xffffff0000000000,0xffff000000ffffff,0xffffffff,0xff00000000000000,0xffffffff,0xffffffffff000000,0xffffffffffff,0x0,0x0,0xffffffff00000000,0xffffffffffff,0xffffff0000000000,0xffffff,0x0,0xffffffffffff,0xffffffffff00,0x0,0xffffffffffff0000,0x0,0x0,0xffffffff00000000,0xffff000000000000,0xffffffff,0xff00000000000000,0xff0000ffffffffff,0xffffffffff,0x0,0xffffffffff00,0xffffffff00000000,0xff,0x0,0xffffffff00000000,0xff,0xffff000000000000,0xffff000000ffffff,0xffffff,0x0,0xffffffffff,0xffffffffffff0000,0xffffffffffff,0x0,0x0,0xffffffffff000000,0xffffffffffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0xffffffffffff,0x0,0xffffffffff000000,0x0,0x0,0xffffffffff000000,0xffff000000000000,0xffffff,0x0,0xff0000ffffffffff,0xffffffff,0x0,0xffffffffff00,0xffffffff00000000,0xff,0x0,0xffffffff00000000,0xff,0xffff000000000000,0xffffff0000ffffff,0xffffff,0x0,0xffffffff00,0xffffffffffffffff,0xffffffffff00,0x0,0x0,0xffffffffffff0000,0xffffffffff00,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0xffffffffff,0x0,0x0,0x0,0x0,0xffffffffff0000,0xffff000000000000,0xffffff,0x0,0xffffffffff,0xffffff00,0x0,0xffffffffff00,0xffffffff00000000,0xff,0x0,0xffffffff00000000,0xff,0xffff000000000000,0xffffff0000ffffff,0xffff,0x0,0xff0000ffffffff00,0xffffffffffffff,0xffffffffff00,0x0,0x0,0xffffffffffff0000,0xffffffffff00,0xff00000000000000,0xffff,0x0,0xffffffffff00,0xffffffffff,0x0,0x0,0x0,0x0,0xffffffff0000,0xffff000000000000,0xffffff,0x0,0xffffffffff,0x0,0x0,0xffffffffff00,0xffffffff00000000,0xff,0x0,0xffffffff00000000,0xff,0xffff000000000000,0xffffff0000ffffff,0xffff,0x0,0xff0000ffffffff00,0xffffffffff,0xffffffffff00,0x0,0x0,0xffffffffffff00,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffffffffff,0x0,0x0,0x0,0x0,0xffffffffff00,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffff,0xffffffffff000000,0xff,0x0,0xffffffff00000000,0xffff,0xffffff0000000000,0xffffff0000ffffff,0xffff,0x0,0xff00ffffffffff00,0xffffff,0xffffffffff00,0x0,0x0,0xffffffffffff,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffffffff,0x0,0x0,0x0,0x0,0xffffffffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0xff00000000000000,0xffffffffff,0xffffffffff000000,0xffffffff000000ff,0xffff,0xffffff0000000000,0xffffff,0xffffff0000000000,0xffffff000000ffff,0xffff,0x0,0xff00ffffffffff00,0xff,0xffffffffff00,0x0,0x0,0xffffffffff,0xffffffffff00,0x0,0x0,0x0,0xff0000ffffffffff,0xffffffff,0xffffffffffff0000,0xff,0x0,0x0,0xffffffffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0xffffff0000000000,0xffffffff,0xffffffffff000000,0xffffffffffff0000,0xffffffff,0xffff000000000000,0xffffffff,0xffffffffff000000,0xffffff00000000ff,0xffff,0x0,0xffffffffff00,0x0,0xffffffffff00,0x0,0xff00000000000000,0xffffffffff,0xffffffffff00,0x0,0x0,0x0,0xff0000ffffffffff,0xffffffff,0xffffffffffffffff,0xffffff,0x0,0xff00000000000000,0xffffffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0xffffffffffffff00,0xffffff,0xffffffffff000000,0xffffffffffffff00,0xffffffffffff,0xff00000000000000,0xffffffffffffffff,0xffffffffffffffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0xffffffffff00,0x0,0xffff000000000000,0xffffffff,0xffffffffff00,0x0,0x0,0xff00000000000000,0xff0000ffffffffff,0xffff0000ffffffff,0xffffffffffffffff,0xffffffffff,0x0,0xff00000000000000,0xffffffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0xffffffffffffff00,0xff,0xffffffffff000000,0xffffffffffffffff,0xffffffffffffff,0x0,0xffffffffffffffff,0xffffffffffffff,0xffffff0000000000,0xffffff,0x0,0xffffffffffff,0x0,0xffffffffff00,0x0,0xffffff0000000000,0xffffff,0xffffffffff00,0x0,0x0,0xffff000000000000,0xff000000ffffffff,0xffffff00ffffffff,0xffffffffffffffff,0xffffffffffff,0x0,0xffff000000000000,0xffffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0xffffffffffffff00,0xffffff,0xffffffffffff0000,0xffffffffffffffff,0xffffffffffffffff,0x0,0xffffffffffffff00,0xffffffffffff,0xffff000000000000,0xffffff,0xff00000000000000,0xffffffffffff,0x0,0xffffffffff00,0x0,0xffffff0000000000,0xffffff,0xffffffffff00,0x0,0x0,0xffffff0000000000,0xff00000000ffffff,0xffffff00ffffffff,0xffffffffffffffff,0xffffffffffffff,0x0,0xffff000000000000,0xffffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0xffffffffffffff00,0xffffffff,0xffffffffffff0000,0xffff,0xffffffffffffff00,0xff00000000000000,0xffffffffffffffff,0xffffffffffffffff,0xffff000000000000,0xffffffff,0xffff000000000000,0xffffffffffff,0x0,0xffffffffff00,0x0,0xffffffff00000000,0xffff,0xffffffffff00,0x0,0x0,0xffffffff00000000,0xff0000000000ffff,0xffffffffffffffff,0xff,0xffffffffffffff,0x0,0xffffff0000000000,0xffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0xffffffff00ffff00,0xffffffffff,0xffffffffffff0000,0x0,0xffffffffff000000,0xffff0000000000ff,0xffffffffffffffff,0xffffffffffffffff,0xff000000000000ff,0xffffffffffff,0xffffff0000000000,0xffffffffffff,0x0,0xffffffffff00,0x0,0xffffffffff000000,0xff,0xffffffffff00,0x0,0x0,0xffffffffff000000,0xff0000000000ffff,0xffffffffffffff,0x0,0xffffffffffffff00,0x0,0xffffff0000000000,0xffff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffffff,0xffffff00000000,0x0,0xffffffff00000000,0xffffff00000000ff,0xffffffff,0xffffffffff000000,0xff0000000000ffff,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffff,0x0,0xffffffffff00,0x0,0xffffffffff000000,0x0,0xffffffffff00,0x0,0x0,0xffffffffffff0000,0xff000000000000ff,0xffffffffffff,0x0,0xffffffffffff0000,0x0,0xffffffff00000000,0xff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffffff00,0x0,0x0,0xffffffff00000000,0xffffffff0000ffff,0xffff,0xffffff0000000000,0xffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffffffff00,0x0,0xffffffffff00,0x0,0xffffffffffff0000,0x0,0xffffffffff00,0x0,0x0,0xffffffffffffff00,0xff00000000000000,0xffffffffff,0x0,0xffffffffff000000,0xff,0xffffffff00000000,0xff,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffff0000,0x0,0x0,0xffffff0000000000,0xffffffff0000ffff,0xff,0xffff000000000000,0xffffff,0xffffffffffffff00,0xffffffffffffff,0xffffffffff00,0x0,0xffffffffff00,0x0,0xffffffffffff00,0x0,0xffffffffff00,0x0,0xff00000000000000,0xffffffffffff,0xff00000000000000,0xffffffff,0x0,0xffffffff00000000,0xff,0xffffffffff000000,0x0,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffffff0000,0x0,0x0,0xffffff0000000000,0xffffffff0000ffff,0xff,0xffff000000000000,0xffffff,0xffffffffff000000,0xffffffffff,0xffffffffff00,0x0,0xffffffffff00,0x0,0xffffffffffff,0x0,0xffffffffff00,0x0,0xffff000000000000,0xffffffffff,0xff00000000000000,0xffffffff,0x0,0xffffffff00000000,0xff,0xffffffffff000000,0x0,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffff000000,0x0,0x0,0xffffff0000000000,0xffffffffff00ffff,0x0,0xff00000000000000,0xffffffff,0xffffff0000000000,0xffffff,0xffffffffff00,0x0,0xff00ffffffffff00,0xffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffff,0xffffff0000000000,0xffffffff,0xff00000000000000,0xffffffff,0x0,0xffffffff00000000,0xff,0xffffffffff000000,0x0,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffff000000,0x0,0x0,0xffffff0000000000,0xffffffffff00ffff,0x0,0xff00000000000000,0xffffffff,0x0,0x0,0xffffffffff00,0x0,0xff00ffffffffff00,0xffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffff,0xffffffff00000000,0xffffff,0xff00000000000000,0xffffffff,0x0,0xffffffff00000000,0xff,0xffffffffff0000,0x0,0xffffff0000000000,0xffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffff000000,0x0,0x0,0xffffff0000000000,0xffffffffff00ffff,0x0,0xff00000000000000,0xffffffff,0x0,0x0,0xffffffffff,0x0,0xff00ffffffffff00,0xffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffff,0xffffffffffff0000,0xffff,0x0,0xffffffff,0x0,0xffffffff00000000,0xff,0xffffffffff0000,0x0,0xffff000000000000,0xffffff,0x0,0xffffffffff,0xffffff00,0x0,0xffffffffff000000,0x0,0x0,0xffffff0000000000,0xffffffffff00ffff,0x0,0xff00000000000000,0xffffffff,0x0,0x0,0xffffffffff,0x0,0xff00ffffffffff00,0xffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffff,0xffffffffffffff00,0xff,0x0,0xffffffff,0x0,0xffffffff00000000,0xff,0xffffffffff0000,0x0,0xffff000000000000,0xffffff,0x0,0xff0000ffffffffff,0xffffffff,0x0,0xffffffffff000000,0xffffffffff00,0x0,0xffffff0000000000,0xffffffffff00ffff,0x0,0xff00000000000000,0xffffffff,0x0,0x0,0xffffffffff,0x0,0xff00ffffffffff00,0xffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffffffff,0xffffff,0xffffffffffffff,0x0,0x0,0xffffffffff,0x0,0xffffffffff000000,0xff,0xffffffffff0000,0x0,0xffff000000000000,0xffffff,0x0,0xff0000ffffffffff,0xffffffffff,0x0,0xffffffffffff0000,0xffffffffff00,0x0,0xffffffff00000000,0xffffffffff0000ff,0x0,0xff00000000000000,0xffff0000ffffffff,0xffffff,0xff00000000000000,0xffffffffff,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xff00000000000000,0xffffffffffff,0x0,0x0,0xffffffffff,0x0,0xffffffffff000000,0x0,0xffffffffff00,0x0,0xffff000000000000,0xffffffff,0xff00000000000000,0xff0000ffffffffff,0xffffffffff,0x0,0xffffffffff0000,0xffffffffffff00,0x0,0xffffffff00000000,0xffffffffff0000ff,0xff,0xffff000000000000,0xffff0000ffffffff,0xffffff,0xff00000000000000,0xffffffff,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xff00000000000000,0xffffffffff,0x0,0x0,0xffffffffff00,0x0,0xffffffffffff0000,0x0,0xffffffffff00,0x0,0xff00000000000000,0xffffffff,0xff00000000000000,0xffffffff,0xffffffffffff,0x0,0xffffffffffff00,0xffffffffff0000,0x0,0xffffffffff000000,0xffffffff000000ff,0xff,0xffff000000000000,0xffff000000ffffff,0xffffffff,0xff00000000000000,0xffffffff,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffff000000000000,0xffffffff,0x0,0x0,0xffffffffffff00,0x0,0xffffffffffffff00,0x0,0xffffffffff00,0x0,0xff00000000000000,0xffffffffff,0xffff000000000000,0xffffffff,0xffffffffffffff,0x0,0xffffffffffffff,0xffffffffffff0000,0x0,0xffffffffffff0000,0xffffffff00000000,0xffff,0xffffff0000000000,0xff00000000ffffff,0xffffffffff,0xffffff0000000000,0xffffff,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffffff0000000000,0xffffff,0x0,0x0,0xffffffffffff0000,0xff,0xffffffffffffff,0x0,0xffffffffff00,0x0,0x0,0xffffffffffffff,0xffffffff00000000,0xffffff,0xffffffffffffff00,0xff00000000000000,0xffffffffffff,0xffffffffff000000,0xffff,0xffffffffffffffff,0xffffff0000000000,0xffffffffff,0xffffffffff000000,0xff0000000000ffff,0xffffffffffff,0xffffffff00000000,0xffffff,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffffff0000000000,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffff,0xffffffffff000000,0xffffffffffffffff,0xffffffffffff,0x0,0xffffffffff,0x0,0x0,0xffffffffffffffff,0xffffffffffffffff,0xffffff,0xffffffffffffff00,0xffffffffffffffff,0xffffffffff,0xffffffffff000000,0xffffffffffffffff,0xffffffffffffff,0xffffff0000000000,0xffffffffffffffff,0xffffffffffffffff,0xffff,0xffffffffffffffff,0xffffffffffffffff,0xffff,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffffff0000000000,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffff,0xffffffff00000000,0xffffffffffffffff,0xffffffffff,0x0,0xffffffffff,0x0,0x0,0xffffffffffffff00,0xffffffffffffffff,0xffff,0xffffffffffff0000,0xffffffffffffffff,0xffffffff,0xffffffff00000000,0xffffffffffffffff,0xffffffffffff,0xffff000000000000,0xffffffffffffffff,0xffffffffffffffff,0xff,0xffffffffffffff00,0xffffffffffffffff,0xff,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffffffff00000000,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffff,0xffffff0000000000,0xffffffffffffffff,0xffffffff,0x0,0xffffffffff,0x0,0x0,0xffffffffffff0000,0xffffffffffffffff,0xff,0xffffffffff000000,0xffffffffffffffff,0xffffff,0xffffff0000000000,0xffffffffffffffff,0xffffffffff,0xff00000000000000,0xffffffffffffffff,0xffffffffffffffff,0x0,0xffffffffffffff00,0xffffffffffffffff,0x0,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffffffff00000000,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffff,0xffff000000000000,0xffffffffffffffff,0xffffff,0x0,0xffffffffff,0x0,0x0,0xffffffffff000000,0xffffffffffffffff,0x0,0xffffff0000000000,0xffffffffffffffff,0xffff,0xff00000000000000,0xffffffffffffffff,0xffffff,0x0,0xffffffffffffff00,0xffffffffffff,0x0,0xffffffffff000000,0xffffffffffffff,0x0,0x0,0xffffffffff00,0x0,0x0,0x0,0xffffffffff00,0xffffffff00000000,0xffffffffffffffff,0xffffffffffffffff,0xffffffffffff,0x0,0xffffffffffffff00,0x0,0x0,0xffffffffff,0x0,0x0,0xffff000000000000,0xffffffffff,0x0,0xff00000000000000,0xffffffffffffff,0x0,0x0,0xffffffffffffff00,0xff,0x0,0xffffffff00000000,0xffffff,0x0,0xffffff0000000000,0xffffffff,0x0,0x0,0xffffffffff00,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0,0x0};
 static int numbersfont_char_data[] = {48,109,0,25,39,3,12,31,49,239,0,15,39,6,12,31,50,28,0,26,39,2,12,31,51,135,0,25,39,3,12,31,52,0,0,27,39,1,12,31,53,161,0,25,39,3,12,31,54,55,0,26,39,2,12,31,55,82,0,26,39,2,12,31,56,187,0,25,39,3,12,31,57,213,0,25,39,3,12,31,58,255,0,5,29,5,22,15};
 static int fill(video_generator* gen, int x, int y, int w, int h, int r, int g, int b);
+static void plane_set(video_generator* g, uint8_t* dest, int value, size_t n);
+static void plane_copy(video_generator* g, uint8_t* dest, const uint8_t* src, size_t n);
+static void plane_fence(video_generator* g);
 static int add_number_string(video_generator* gen, const char* str, int x, int y);
 static int add_char(video_generator* gen, video_generator_char* kar, int x, int y);
+static int font_init(video_generator* g);
+static void font_box(video_generator* g, int box_w, int box_h);
+static void font_scale_glyph(const uint8_t* src, int src_stride, int sw, int sh, uint8_t* dest, int dest_stride, int dw, int dh);
+static int pattern_init(video_generator* g);
+static void pattern_clear(video_generator* g);
+static void pattern_draw(video_generator* g, uint32_t y0, uint32_t y1);
+static void bars_init(video_generator* g);
+static void bars_draw(video_generator* g, int32_t start_y, int32_t nlines, int yc, int uc, int vc);
+static uint8_t* stream_row_begin(video_generator* g, uint8_t* dest, int* streaming);
+static void stream_row_end(video_generator* g, uint8_t* dest, uint8_t* row, size_t n);
+static int timeline_init(video_generator* g, video_generator_settings* cfg);
+static void timeline_clear(video_generator* g);
+static void timeline_draw(video_generator* g);
+static int timeline_alpha(video_generator_scene* sc, uint64_t t);
+static uint32_t pattern_hash(uint32_t x);
+static int faults_init(video_generator* g, video_generator_settings* cfg);
+static double fault_chance(uint32_t seed, uint32_t salt, uint64_t index);
+static uint64_t fault_jitter(video_generator_faults* f, uint64_t index);
+static void fault_store(video_generator* g);
+static void slice_emit(video_generator* g, uint32_t index, uint64_t frame_start);
+static void slice_emit_frame(video_generator* g, uint64_t frame_start);
+static int renditions_init(video_generator* g, video_generator_settings* cfg);
+static void renditions_clear(video_generator* g);
+static void renditions_update(video_generator* g, uint64_t frame);
+static void dirty_frame(video_generator* g, int bar_y, int bar_h, int box_x, int box_y, uint32_t box_color);
+static void dirty_add(video_generator* g, int x, int y, int w, int h);
+static void dirty_full(video_generator* g);
+static void dirty_scale(video_generator* r, video_generator* g);
+static int cache_init(video_generator* g, video_generator_settings* cfg);
+static void cache_clear(video_generator* g);
+static int cache_replay(video_generator* g);
+static void cache_store(video_generator* g);
+static int audio_sequence_init(video_generator* g, video_generator_settings* cfg);
+static void audio_sequence_clear(video_generator* g);
+static void audio_render(video_generator* g, int16_t* out, uint32_t nframes);
+static void audio_oscillator(int16_t* out, uint32_t nframes, uint32_t nchannels, uint32_t channels, float amplitude, double* phase, double* freq, double dfreq);
 static void* audio_thread(void* gen); /* When we need to generate audio, we do this in another thread. So be aware that the callback will be called from this thread! */
 
 int video_generator_init(video_generator_settings* cfg, video_generator* g) {
@@ -211,7 +341,6 @@ int video_generator_init(video_generator_settings* cfg, video_generator* g) {
   int dx = 0;
   int max_els = RXS_MAX_CHARS * 8; /* members per char */
   video_generator_char* c = NULL;
-  int num_frames; /* used for bip/bop calculations. */
 
   if (!g) { return -1; } 
   if (!cfg) { return -2; } 
@@ -221,6 +350,8 @@ int video_generator_init(video_generator_settings* cfg, video_generator* g) {
   
   /* initalize members */
   g->frame = 0;
+  g->num_dirty_rects = 0;
+  g->dirty_valid = 0;
   g->ybytes = cfg->width * cfg->height;
   g->ubytes = (cfg->width * 0.5) * (cfg->height * 0.5);
   g->vbytes = g->ubytes;
@@ -229,13 +360,36 @@ int video_generator_init(video_generator_settings* cfg, video_generator* g) {
   g->height = cfg->height;
   g->fps = (1.0 / cfg->fps) * 1000 * 1000;
 
-  g->y = (uint8_t*)malloc(g->nbytes);
-  g->u = g->y + g->ybytes;
-  g->v = g->y + (g->ybytes + g->ubytes);
+  /* everything that video_generator_clear() frees, so we can call it when we fail halfway. */
+  g->buffer = NULL;
+  g->pattern_phase = NULL;
+  g->pattern_ramp = NULL;
+  g->bars_row = NULL;
+  g->stream_row = NULL;
+  g->fault_prev = NULL;
+  g->font_atlas = NULL;
+  g->scenes = NULL;
+  g->num_scenes = 0;
+  g->timeline_rects = NULL;
+  g->renditions = NULL;
+  g->num_renditions = 0;
+  g->scaler = NULL;
+  g->cache = NULL;
+  g->audio_thread = NULL;
+  g->audio_buffer = NULL;
+  g->audio_events = NULL;
+  g->audio_event_ends = NULL;
+  g->audio_num_events = 0;
+
+  g->buffer = (uint8_t*)malloc(g->nbytes);
+  if (NULL == g->buffer) {
+    printf("Error: cannot allocate the frame buffer.\n");
+    video_generator_clear(g);
+    return -12;
+  }
 
-  g->planes[0] = g->y;
-  g->planes[1] = g->u;
-  g->planes[2] = g->v;
+  g->y = NULL;
+  video_generator_set_buffer(g, NULL);
 
   g->strides[0] = cfg->width;
   g->strides[1] = cfg->width * 0.5;
@@ -261,9 +415,70 @@ int video_generator_init(video_generator_settings* cfg, video_generator* g) {
   }
 
   /* bitmap font specifics */
+  g->font_pixels = (const uint8_t*)numbersfont_pixel_data;
   g->font_w = 264;
   g->font_h = 50;
   g->font_line_height = 63;
+  g->font_atlas = NULL;
+
+  /* stress patterns */
+  g->pattern = cfg->pattern;
+  g->noise_amplitude = cfg->noise_amplitude;
+  g->seed = cfg->seed;
+  g->streaming_stores = (0 != cfg->streaming_stores) ? 1 : 0;
+
+  if (0 != pattern_init(g)) {
+    printf("Error: cannot initialize the pattern: %u\n", cfg->pattern);
+    video_generator_clear(g);
+    return -10;
+  }
+
+  if (0 != faults_init(g, cfg)) {
+    printf("Error: invalid fault settings.\n");
+    video_generator_clear(g);
+    return -13;
+  }
+
+  /* slices */
+  if (0 != cfg->slice_rows && (0 != (cfg->slice_rows % VIDEO_GENERATOR_SLICE_ALIGN) || NULL == cfg->slice_callback)) {
+    printf("Error: slice_rows must be a multiple of %d and needs a slice_callback.\n", VIDEO_GENERATOR_SLICE_ALIGN);
+    video_generator_clear(g);
+    return -14;
+  }
+
+  g->slice_rows = cfg->slice_rows;
+  g->slice_callback = (0 != cfg->slice_rows) ? cfg->slice_callback : NULL;
+  g->slice_user = cfg->slice_user;
+  g->clip_y0 = 0;
+  g->clip_y1 = cfg->height;
+  g->slice_first_ns = 0;
+  g->slice_first_max_ns = 0;
+  g->slice_first_total_ns = 0;
+  g->slice_nframes = 0;
+
+  if (0 != timeline_init(g, cfg)) {
+    printf("Error: cannot initialize the timeline.\n");
+    video_generator_clear(g);
+    return -11;
+  }
+
+  if (0 != renditions_init(g, cfg)) {
+    printf("Error: cannot initialize the renditions.\n");
+    video_generator_clear(g);
+    return -15;
+  }
+
+  if (0 != font_init(g)) {
+    printf("Error: cannot create the scaled font.\n");
+    video_generator_clear(g);
+    return -16;
+  }
+
+  if (0 != cache_init(g, cfg)) {
+    printf("Error: cannot initialize the frame cache.\n");
+    video_generator_clear(g);
+    return -17;
+  }
 
   /* default audio settings. */
   g->audio_bip_frequency = 0;
@@ -272,76 +487,63 @@ int video_generator_init(video_generator_settings* cfg, video_generator* g) {
   g->audio_samplerate = 0;
   g->audio_nbytes = 0;
   g->audio_buffer = NULL;
+  g->audio_events = NULL;
+  g->audio_event_ends = NULL;
+  g->audio_num_events = 0;
   g->audio_callback = NULL;
   g->audio_thread = NULL;
 
   /* initialize audio */
   if (NULL != cfg->audio_callback) {
 
-    if (0 == cfg->bip_frequency) {
+    if (0 == cfg->num_audio_events && 0 == cfg->bip_frequency) {
       printf("Error: audio_callback set but no bip_frequency set. Use e.g. 500.");
+      video_generator_clear(g);
       return -6;
     }
 
-    if (0 == cfg->bop_frequency) {
+    if (0 == cfg->num_audio_events && 0 == cfg->bop_frequency) {
       printf("Error: audio_callback set but no bop_frequency set. Use e.g. 1500.");
+      video_generator_clear(g);
       return -7;
     }
 
-    /* we allocate a buffer up to 4 seconds. */
+    /* we synthesize one period at a time. */
     g->audio_bip_frequency = cfg->bip_frequency;
     g->audio_bop_frequency = cfg->bop_frequency;
-    g->audio_bip_millis = 100;
-    g->audio_bop_millis = 100;
     g->audio_nchannels = 2;
     g->audio_samplerate = 44100;
     g->audio_nsamples = 1024;
-    g->audio_nseconds = 4;
-    g->audio_nbytes = sizeof(int16_t) * g->audio_samplerate * g->audio_nchannels * g->audio_nseconds;
+    g->audio_nbytes = sizeof(int16_t) * g->audio_nsamples * g->audio_nchannels;
     g->audio_callback = cfg->audio_callback;
 
+    if (0 != audio_sequence_init(g, cfg)) {
+      printf("Error: invalid audio events.\n");
+      video_generator_clear(g);
+      return -18;
+    }
+
     /* alloc the buffer. */
     g->audio_buffer = (int16_t*)malloc(g->audio_nbytes); 
     if (!g->audio_buffer) {
       printf("Error while allocating the audio buffer.");
-      g->audio_buffer = NULL;
+      video_generator_clear(g);
       return -7;
     }
 
-    /* fill with silence */
-    memset((uint8_t*)g->audio_buffer, 0x00, g->audio_nbytes);
-
-    /* bip */
-    dx= 0;
-    num_frames = (g->audio_bip_millis/1000.0) * g->audio_samplerate;
-    for (i = g->audio_samplerate;  i < (g->audio_samplerate + num_frames); ++i) {
-      dx = i * 2;
-      g->audio_buffer[dx + 0] = 10000 * sin( (6.28318530718/g->audio_samplerate) * g->audio_bip_frequency * i);
-      g->audio_buffer[dx + 1] = g->audio_buffer[dx + 0];
-    }
-
-    /* bop */
-    num_frames = (g->audio_bip_millis/1000.0) * g->audio_samplerate;
-    for (i = (g->audio_samplerate * 3); i < (g->audio_samplerate * 3 + num_frames); ++i) {
-      dx = i * 2;
-      g->audio_buffer[dx + 0] = 10000 * sin( (6.28318530718/g->audio_samplerate) * g->audio_bop_frequency * i);
-      g->audio_buffer[dx + 1] = g->audio_buffer[dx + 0];
-    }
-
     /* init mutex. */
     if (0 != mutex_init(&g->audio_mutex)) {
       printf("Error: cannot initialize the audio mutex!");
-      free(g->audio_buffer);
-      g->audio_buffer = NULL;
+      video_generator_clear(g);
       return -8;
     }
 
     /* start audio thread. */
+    g->audio_thread_must_stop = 0;
     g->audio_thread = thread_alloc(audio_thread, (void*)g);
     if (NULL == g->audio_thread) {
       printf("Error: cannot create audio thread.\n");
-      free(g->audio_buffer);
-      g->audio_buffer = NULL;
+      video_generator_clear(g);
       return -9;
     }
   }
@@ -358,25 +560,43 @@ int video_generator_clear(video_generator* g) {
     mutex_unlock(&g->audio_mutex);
     thread_join(g->audio_thread);
     g->audio_thread = NULL;
+  }
 
-    /* free the audio buffer. */
-    if (NULL != g->audio_buffer) {
-      free(g->audio_buffer);
-      g->audio_buffer = NULL;
-    }
+  /* free the audio buffer. */
+  if (NULL != g->audio_buffer) {
+    free(g->audio_buffer);
+    g->audio_buffer = NULL;
   }
 
+  audio_sequence_clear(g);
+
   if (!g) { return -1; } 
   if (!g->width) { return -2; } 
   if (!g->height) { return -3; } 
   
-  if (g->y) {
-    free(g->y);
+  if (g->buffer) {
+    free(g->buffer);
+  }
+
+  pattern_clear(g);
+  timeline_clear(g);
+  renditions_clear(g);
+  cache_clear(g);
+
+  if (NULL != g->font_atlas) {
+    free(g->font_atlas);
+    g->font_atlas = NULL;
+  }
+
+  if (NULL != g->fault_prev) {
+    free(g->fault_prev);
+    g->fault_prev = NULL;
   }
 
+  g->buffer = NULL;
   g->y = NULL;
   g->u = NULL;
-  g->u = NULL;
+  g->v = NULL;
   g->width = 0;
   g->height = 0;
   g->frame = 0;
@@ -395,48 +615,104 @@ int video_generator_clear(video_generator* g) {
   g->planes[2] = NULL;
 
   g->audio_nchannels = 0;
-  g->audio_nseconds = 0;
   g->audio_samplerate = 0;
   g->audio_bip_frequency = 0;
   g->audio_bop_frequency = 0;
-  g->audio_bip_millis = 0;
-  g->audio_bop_millis = 0;
   g->audio_nbytes = 0;
   g->audio_callback = NULL;
 
   return 0;
 }
 
+int video_generator_set_buffer(video_generator* g, uint8_t* buffer) {
+
+  if (!g) { return -1; } 
+
+  if (NULL == buffer) {
+    buffer = g->buffer;
+  }
+
+  if (NULL == buffer) { return -2; } 
+
+  /* the timeline can only redraw the objects when the previous frame is in the buffer. */
+  if (buffer != g->y) {
+    g->timeline_valid = 0;
+  }
+
+  g->y = buffer;
+  g->u = g->y + g->ybytes;
+  g->v = g->y + (g->ybytes + g->ubytes);
+  g->planes[0] = g->y;
+  g->planes[1] = g->u;
+  g->planes[2] = g->v;
+
+  return 0;
+}
+
+uint64_t video_generator_now_ns() {
+  return ns();
+}
+
 /* generates a new frame and stores it in the y, u and v members */
 int video_generator_update(video_generator* g) {
 
   double perc;
-  int is_bip, is_bop;
-  int text_w, text_x, text_y, i;
+  uint32_t markers;
+  int text_w, text_x, text_y;
   int32_t bar_h, time, speed, start_y, nlines, h;
-  uint64_t days, hours, minutes, seconds;
-  uint32_t stride, end_y;
+  uint64_t days, hours, minutes, seconds, frame_start;
+  uint32_t slice_y, slice_index;
   char timebuf[512] = { 0 } ;
   int text_r, text_g, text_b;
-  int rc, gc, bc, yc, uc, vc, dx;
-  int colors[] = { 
-    255, 255, 255,  // white
-    255, 255, 0,    // yellow
-    0,   255, 255,  // cyan
-    0,   255, 0,    // green
-    255, 0,   255,  // magenta
-    255, 0,   0,    // red
-    0,   0,   255   // blue
-  };
+  int rc, gc, bc, yc, uc, vc;
 
   if (!g) { return -1; } 
   if (!g->width) { return -2; } 
   if (!g->height) { return -3; } 
 
+  VIDEO_GENERATOR_TRACE_BEGIN(trace_update);
+
+  frame_start = ns();
   text_r = 0;
   text_g = 0;
   text_b = 0;
 
+  /* simulate capture faults: a dropped frame skips a frame number, a repeated frame keeps the picture. */
+  g->fault_flags = 0;
+  g->num_dirty_rects = 0;
+  if (0.0 != g->faults.video_drop_probability
+      && fault_chance(g->faults.seed, 0x64726f70, g->frame) < g->faults.video_drop_probability)
+    {
+      g->fault_flags |= VIDEO_GENERATOR_FAULT_DROPPED;
+      g->frames_dropped++;
+      g->frame++;
+    }
+
+  /* the frame number is final now. */
+  g->timestamp.pts = (int64_t)g->frame;
+  g->timestamp.timebase_num = g->fps_num;
+  g->timestamp.timebase_den = g->fps_den;
+  g->timestamp.sample = (g->frame * g->audio_source->audio_samplerate * g->fps_num) / g->fps_den;
+  g->timestamp.capture_ns = frame_start;
+
+  if (0.0 != g->faults.video_repeat_probability
+      && 0 != g->fault_prev_valid
+      && fault_chance(g->faults.seed, 0x72657074, g->frame) < g->faults.video_repeat_probability)
+    {
+      plane_copy(g, g->y, g->fault_prev, g->nbytes);
+      plane_fence(g);
+      g->fault_flags |= VIDEO_GENERATOR_FAULT_REPEATED;
+      g->frames_repeated++;
+      slice_emit_frame(g, frame_start);
+      renditions_update(g, g->frame);
+      g->frame++;
+      VIDEO_GENERATOR_TRACE_END(trace_update, "update");
+      return 0;
+    }
+
+  /* the bar moves from top to bottom in 5 seconds. */
+  g->perc = (g->frame % (5 * g->fps_den)) * g->step;
+
   h = g->height - 1;
   bar_h = g->height / 5;
   start_y = -bar_h + (g->perc * (h + bar_h));
@@ -453,94 +729,289 @@ int video_generator_update(video_generator* g) {
     nlines = bar_h;
   }
 
-  /* increment step */
-  g->perc += g->step;
-  if (g->perc >= (1.0)) {
-    g->perc = 0.0;
-  }
+  /* the color of the bar is based on the next position. */
+  g->perc = ((g->frame + 1) % (5 * g->fps_den)) * g->step;
 
   if (nlines + start_y > g->height || nlines < 0 || start_y < 0 || start_y >= g->height) {
-    printf("Error: this shouldn't happen.. writing outside the buffer: %d, %d, %d\n", nlines, (nlines + start_y), start_y);
+    printf("Error: the moving bar is outside the frame, start: %d, end: %d, lines: %d.\n", start_y, (nlines + start_y), nlines);
+    VIDEO_GENERATOR_TRACE_END(trace_update, "update");
     return -1;
   }
 
-  /* reset */
-  memset(g->y, 0x00, g->ybytes);
-  memset(g->u, 0x00, g->ubytes);
-  memset(g->v, 0x00, g->vbytes);
+  /* draw blip/blop visuals; renditions use the audio of the main generator. */
+  markers = video_generator_markers(g);
+  if (0 != (markers & (1u << VIDEO_GENERATOR_AUDIO_MARKER_BIP))) {
+    text_r = 0;
+    text_g = 0;
+    text_b = 255;
+  }
+  if (0 != (markers & (1u << VIDEO_GENERATOR_AUDIO_MARKER_BOP))) {
+    text_r = 255;
+    text_g = 0;
+    text_b = 0;
+  }
+
+  seconds = (g->frame/ g->fps_den);
+  minutes = (seconds / 60);
+  hours = minutes / 60;
+  days = hours / 24;
+  minutes %= 60;
+  seconds %= 60;
+  hours %= 24;
+  text_w = g->text_w;
+  text_x = (g->width / 2) - (text_w / 2);
+  text_y = (g->height / 2) - (g->text_h / 2);
+  sprintf(timebuf, "%03llu:%02llu:%02llu:%02llu", days, hours, minutes, seconds);
+
+  dirty_frame(g, start_y, nlines, text_x, text_y, (text_r << 16) | (text_g << 8) | text_b);
 
-  for (i = 0; i < 7; ++i) {
-    dx = i * 3;
-    rc = colors[dx + 0];
-    gc = colors[dx + 1];
-    bc = colors[dx + 2];
-    fill(g, i * (g->width / 7), 0, (g->width / 7), g->height, rc, gc, bc);
+  /* a cached frame only needs a new time box. */
+  if (0 == cache_replay(g)) {
+    if (0 != g->num_scenes) {
+      dirty_full(g);
+    }
+    VIDEO_GENERATOR_TRACE_BEGIN(trace_cached_box);
+    fill(g, text_x, text_y, text_w, g->text_h, text_r, text_g, text_b);
+    add_number_string(g, timebuf, text_x + g->text_margin, text_y + g->text_margin);
+    VIDEO_GENERATOR_TRACE_END(trace_cached_box, "time box");
+    slice_emit_frame(g, frame_start);
+    plane_fence(g);
+    renditions_update(g, g->frame);
+    fault_store(g);
+    g->frame++;
+    VIDEO_GENERATOR_TRACE_END(trace_update, "update");
+    return 0;
+  }
+
+  /* the timeline redraws parts of the previous frame, so it's drawn completely before the first slice. */
+  if (0 != g->num_scenes) {
+    VIDEO_GENERATOR_TRACE_BEGIN(trace_timeline);
+    timeline_draw(g);
+    VIDEO_GENERATOR_TRACE_END(trace_timeline, "timeline");
   }
 
+  /* 
+     Everything below only draws the rows between clip_y0 and clip_y1. Without
+     slices this is the whole frame, otherwise we render and hand over one 
+     slice (group of rows) at a time, from top to bottom.
+  */
   rc = 255 - (g->perc * 255);
   gc = 30 + (g->perc * 235);
   bc = 150 + (g->perc * 205);
   yc = RGB2Y(rc, gc, bc);
   uc = RGB2U(rc, gc, bc);
   vc = RGB2V(rc, gc, bc);
+  slice_index = 0;
+
+  for (slice_y = 0; slice_y < g->height; slice_y = g->clip_y1) {
+
+    g->clip_y0 = slice_y;
+    g->clip_y1 = (0 == g->slice_rows) ? g->height : slice_y + g->slice_rows;
+    g->clip_y1 = (g->clip_y1 > g->height) ? g->height : g->clip_y1;
+    
+    if (0 != g->num_scenes) {
+      /* already drawn. */
+    }
+    else if (VIDEO_GENERATOR_PATTERN_BARS != g->pattern) {
+      VIDEO_GENERATOR_TRACE_BEGIN(trace_pattern);
+      pattern_draw(g, g->clip_y0, g->clip_y1);
+      VIDEO_GENERATOR_TRACE_END(trace_pattern, "pattern");
+    }
+    else {
+      VIDEO_GENERATOR_TRACE_BEGIN(trace_bars);
+      bars_draw(g, start_y, nlines, yc, uc, vc);
+      VIDEO_GENERATOR_TRACE_END(trace_bars, "bars");
+    }
+
+    VIDEO_GENERATOR_TRACE_BEGIN(trace_box);
+    fill(g, text_x, text_y, text_w, g->text_h, text_r, text_g, text_b);
+    VIDEO_GENERATOR_TRACE_END(trace_box, "time box");
+
+    VIDEO_GENERATOR_TRACE_BEGIN(trace_text);
+    add_number_string(g, timebuf, text_x + g->text_margin, text_y + g->text_margin);
+    VIDEO_GENERATOR_TRACE_END(trace_text, "text");
 
-  /* fill y channel */
-  for (i = start_y; i < (start_y + nlines); ++i) {
-    memset(g->y + (i * g->width), yc, g->width);
+    if (NULL != g->slice_callback) {
+      slice_emit(g, slice_index, frame_start);
+    }
+
+    slice_index++;
   }
-  
-  /* fill u and v channel */
-  start_y = start_y / 2;
-  stride = g->width * 0.5;
-  end_y = start_y + nlines/ 2;
 
-  for (i = start_y; i < end_y; ++i) {
-    memset(g->u + i * stride, uc, stride);
-    memset(g->v + i * stride, vc, stride);
+  g->clip_y0 = 0;
+  g->clip_y1 = g->height;
+
+  /* make the streamed stores visible before the frame is handed over. */
+  plane_fence(g);
+
+  if (NULL != g->cache) {
+    VIDEO_GENERATOR_TRACE_BEGIN(trace_cache);
+    cache_store(g);
+    VIDEO_GENERATOR_TRACE_END(trace_cache, "cache store");
   }
 
-  /* draw blip/blop visuals. */
-  if (NULL != g->audio_buffer) {
-    mutex_lock(&g->audio_mutex);
-    {
-      is_bop = g->audio_is_bop;
-      is_bip = g->audio_is_bip;
+  if (0 != g->num_renditions) {
+    VIDEO_GENERATOR_TRACE_BEGIN(trace_renditions);
+    renditions_update(g, g->frame);
+    VIDEO_GENERATOR_TRACE_END(trace_renditions, "renditions");
+  }
 
-    }
-    mutex_unlock(&g->audio_mutex);
+  fault_store(g);
+  g->frame++;
+  VIDEO_GENERATOR_TRACE_END(trace_update, "update");
+  return 0;
+}
+
+/* Hands over a frame that is already complete (repeated or cached) in slices. */
+static void slice_emit_frame(video_generator* g, uint64_t frame_start) {
+  uint32_t slice_y, slice_index;
+
+  if (NULL == g->slice_callback) {
+    return;
+  }
+
+  for (slice_y = 0, slice_index = 0; slice_y < g->height; slice_y += g->slice_rows, ++slice_index) {
+    g->clip_y0 = slice_y;
+    g->clip_y1 = (slice_y + g->slice_rows > g->height) ? g->height : slice_y + g->slice_rows;
+    slice_emit(g, slice_index, frame_start);
+  }
+
+  g->clip_y0 = 0;
+  g->clip_y1 = g->height;
+}
+
+/* Calls the slice callback for the rows between clip_y0 and clip_y1. */
+static void slice_emit(video_generator* g, uint32_t index, uint64_t frame_start) {
+  video_generator_slice slice;
+  uint32_t cy = g->clip_y0 / 2;
+
+  plane_fence(g);
+
+  slice.frame = g->frame;
+  slice.index = index;
+  slice.nslices = (g->height + g->slice_rows - 1) / g->slice_rows;
+  slice.y = g->clip_y0;
+  slice.nrows = g->clip_y1 - g->clip_y0;
+  slice.planes[0] = g->y + g->clip_y0 * g->strides[0];
+  slice.planes[1] = g->u + cy * g->strides[1];
+  slice.planes[2] = g->v + cy * g->strides[2];
+  slice.strides[0] = g->strides[0];
+  slice.strides[1] = g->strides[1];
+  slice.strides[2] = g->strides[2];
+  slice.elapsed_ns = ns() - frame_start;
+  slice.timestamp = g->timestamp;
+
+  /* time to the first slice: how long an encoder has to wait before it can start. */
+  if (0 == index) {
+    g->slice_first_ns = slice.elapsed_ns;
+    g->slice_first_total_ns += slice.elapsed_ns;
+    g->slice_first_max_ns = (slice.elapsed_ns > g->slice_first_max_ns) ? slice.elapsed_ns : g->slice_first_max_ns;
+    g->slice_nframes++;
+  }
+
+  g->slice_callback(&slice, g->slice_user);
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          S T R E A M I N G   S T O R E S                            */
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  With `streaming_stores` the large writes into the planes use non-temporal 
+  stores: they go to memory through the write combining buffers and don't 
+  evict the cache of the consumer. Short spans are written normally because
+  partial cache lines are expensive to stream. Non-temporal stores are weakly 
+  ordered, so plane_fence() must be called before the frame (or a slice) is 
+  handed over to another thread.
+*/
+
+#define STREAM_MIN_BYTES 256
+
+#if defined(HAVE_SSE2)
+static inline void store16(uint8_t* dest, __m128i v, int streaming) {
+  if (0 != streaming && 0 == ((uintptr_t)dest & 15)) {
+    _mm_stream_si128((__m128i*)dest, v);
+  }
+  else {
+    _mm_storeu_si128((__m128i*)dest, v);
+  }
+}
+#endif
+
+static void plane_set(video_generator* g, uint8_t* dest, int value, size_t n) {
+
+#if defined(HAVE_SSE2)
+  __m128i v;
+  size_t head, i;
 
-    if (is_bip == 1) {
-      text_r = 0;
-      text_g = 0;
-      text_b = 255;
+  if (0 != g->streaming_stores && n >= STREAM_MIN_BYTES) {
+    head = (16 - ((uintptr_t)dest & 15)) & 15;
+    memset(dest, value, head);
+    v = _mm_set1_epi8((char)value);
+    for (i = head; i + 16 <= n; i += 16) {
+      _mm_stream_si128((__m128i*)(dest + i), v);
     }
-    if (is_bop == 1) {
-      text_r = 255;
-      text_g = 0;
-      text_b = 0;
+    memset(dest + i, value, n - i);
+    return;
+  }
+#endif
+
+  memset(dest, value, n);
+}
+
+static void plane_copy(video_generator* g, uint8_t* dest, const uint8_t* src, size_t n) {
+
+#if defined(HAVE_SSE2)
+  size_t head, i;
+
+  if (0 != g->streaming_stores && n >= STREAM_MIN_BYTES) {
+    head = (16 - ((uintptr_t)dest & 15)) & 15;
+    memcpy(dest, src, head);
+    for (i = head; i + 16 <= n; i += 16) {
+      _mm_stream_si128((__m128i*)(dest + i), _mm_loadu_si128((const __m128i*)(src + i)));
     }
+    memcpy(dest + i, src + i, n - i);
+    return;
   }
+#endif
 
-  seconds = (g->frame/ g->fps_den);
-  minutes = (seconds / 60);
-  hours = minutes / 60;
-  days = hours / 24;
-  minutes %= 60;
-  seconds %= 60;
-  hours %= 24;
-  text_w = 360; /* manually measured */
-  text_x = (g->width / 2) - (text_w / 2);
-  text_y = (g->height / 2) - 50;
+  memcpy(dest, src, n);
+}
 
-  fill(g, text_x, text_y, text_w, 100, text_r, text_g, text_b);
+static void plane_fence(video_generator* g) {
+#if defined(HAVE_SSE2)
+  if (0 != g->streaming_stores) {
+    _mm_sfence();
+  }
+#endif
+}
 
-  sprintf(timebuf, "%03llu:%02llu:%02llu:%02llu", days, hours, minutes, seconds);
-  add_number_string(g, timebuf, text_x + 20, text_y + 20);
+/* 
+   The SIMD row functions can only stream into rows that start on 16 bytes,
+   which is every other row when the width is e.g. 1366. Those rows are drawn
+   into `stream_row` with regular stores (it stays in the cache) and then 
+   streamed into the plane by stream_row_end().
+*/
+static uint8_t* stream_row_begin(video_generator* g, uint8_t* dest, int* streaming) {
 
-  g->frame++;
-  return 0;
+  *streaming = g->streaming_stores;
+
+  if (0 == g->streaming_stores || 0 == ((uintptr_t)dest & 15)) {
+    return dest;
+  }
+
+  *streaming = 0;
+  return g->stream_row;
+}
+
+static void stream_row_end(video_generator* g, uint8_t* dest, uint8_t* row, size_t n) {
+  if (row != dest) {
+    plane_copy(g, dest, row, n);
+  }
 }
 
+/* ----------------------------------------------------------------------------------- */
+
 static int fill(video_generator* gen, int x, int y, int w, int h, int r, int g, int b) {
 
   // Y 
@@ -557,13 +1028,19 @@ static int fill(video_generator* gen, int x, int y, int w, int h, int r, int g,
   int hh = h / 2;
   int ww = w / 2;
 
+  // only the rows of the current slice.
+  int y0 = ((int)gen->clip_y0 > y) ? (int)gen->clip_y0 : y;
+  int y1 = ((int)gen->clip_y1 < (y + h)) ? (int)gen->clip_y1 : (y + h);
+  int yy0 = ((int)gen->clip_y0 / 2 > yy) ? (int)gen->clip_y0 / 2 : yy;
+  int yy1 = ((int)gen->clip_y1 / 2 < (yy + hh)) ? (int)gen->clip_y1 / 2 : (yy + hh);
+
   // y 
-  for (j = y; j < (y + h); ++j) {
+  for (j = y0; j < y1; ++j) {
     memset(gen->y + j * gen->width + x, yc, w);
   }
 
   // u and v 
-  for (j = yy; j < (yy + hh); ++j) {
+  for (j = yy0; j < yy1; ++j) {
     memset(gen->u + j * half_w + xx, uc, (ww));
     memset(gen->v + j * half_w + xx, vc, (ww));
   }
@@ -601,145 +1078,2216 @@ static int add_number_string(video_generator* gen, const char* str, int x, int y
  return 0;
 }
 
+/* Copies the glyph rows into the luma plane, clipped to the frame and the current slice. */
 static int add_char(video_generator* gen, video_generator_char* kar, int x, int y) {
-  int i = 0;
   int j = 0;
-  int dest_x = 0;
-  int dest_y = 0;
-  int src_dx = 0;
-  int dest_dx = 0;
-
-  uint8_t* pixels = (uint8_t*)numbersfont_pixel_data; 
+  int x0 = 0;
+  int x1 = 0;
+  int y0 = 0;
+  int y1 = 0;
 
   if (!kar) { return -1; } 
   if (!gen) { return -2; } 
+
+  y += kar->yoffset;
+  x0 = (x < 0) ? -x : 0;
+  x1 = (x + kar->width > (int)gen->width) ? ((int)gen->width - x) : kar->width;
+  y0 = (y < (int)gen->clip_y0) ? ((int)gen->clip_y0 - y) : 0;
+  y1 = (y + kar->height > (int)gen->clip_y1) ? ((int)gen->clip_y1 - y) : kar->height;
+
+  if (x1 <= x0) {
+    return 0;
+  }
   
-  for (i = kar->x, dest_x = x; i < (kar->x + kar->width); ++i, ++dest_x) {
-    for (j = kar->y, dest_y = y; j < (kar->y + kar->height); ++j, ++dest_y) {
-      src_dx = j * gen->font_w + i;
-      dest_dx = (kar->yoffset + dest_y) * gen->width + dest_x;
-      gen->y[dest_dx] = pixels[src_dx];
-    }
+  for (j = y0; j < y1; ++j) {
+    memcpy(gen->y + (y + j) * gen->strides[0] + x + x0,
+           gen->font_pixels + (kar->y + j) * gen->font_w + kar->x + x0,
+           x1 - x0);
   }
 
   return 0;
 }
 
-/* ----------------------------------------------------------------------------------- */
-/*                          A U D I O  G E N E R A T O R                               */
-/* ----------------------------------------------------------------------------------- */
-
-static void* audio_thread(void* gen) {
-  video_generator* g;
-  uint8_t must_stop;
-  uint64_t now, delay, timeout, dx, bip_start_dx, bip_end_dx, bop_start_dx, bop_end_dx;
-  uint32_t nbytes = 0; 
-  uint8_t* tmp_buffer = NULL;
-  uint8_t* audio_buffer = NULL;
-  int bytes_to_end = 0;
-  int bytes_from_start = 0;
-  int bytes_needed = 0;
-  int bytes_total = 0;
-  int is_bip = 0;
-  int is_bop = 0;
-  int prev_is_bip = 0;
-  int prev_is_bop = 0;
-  int num_bip_frames = 0;
-  int num_bip_bytes = 0;
-  int num_bop_frames = 0;
-  int num_bop_bytes = 0;
+/*
+  The bitmap font was made for the 360x100 time box of a 1280x720 frame. For
+  other resolutions we scale the glyphs (and their metrics) once into a new 
+  atlas so drawing the text stays a copy of rows. Every destination pixel is 
+  the average of the source pixels it covers (area sampling), which works 
+  for both smaller and larger glyphs.
+*/
+static int font_init(video_generator* g) {
 
+  video_generator_char* c;
+  uint32_t scale;
+  int k, x, atlas_w, atlas_h, box_w, box_h;
 
-  /* get the handle. */
-  must_stop = 0;
-  g = (video_generator*)gen;
-  if (NULL == g) {
-    printf("Not supposed to happen but the audio thread cannot get a handle to the generator.\n");
-    exit(1);
+  /* 16.16 fixed point, the largest scale at which the box fits in both directions. */
+  scale = (uint32_t)(((uint64_t)g->width << 16) / 1280);
+  if ((uint32_t)(((uint64_t)g->height << 16) / 720) < scale) {
+    scale = (uint32_t)(((uint64_t)g->height << 16) / 720);
   }
-  
-  /* init */
-  now = 0;
-  timeout = 0;
-  dx = 0;
-  delay = (g->audio_nsamples * ((double)1.0/g->audio_samplerate) * 1e9);
-  nbytes = g->audio_nsamples * sizeof(int16_t) * g->audio_nchannels;
-  tmp_buffer = (uint8_t*)malloc(nbytes);
-  audio_buffer = (uint8_t*)g->audio_buffer;
-  bytes_needed = nbytes;
-  bytes_total = g->audio_nbytes;
-
-  /* calc the bip/bop start and end positions. */
-  num_bip_frames = (g->audio_bip_millis/1000.0) * g->audio_samplerate;
-  num_bip_bytes = sizeof(int16_t) * g->audio_nchannels * num_bip_frames;
-  num_bop_frames = (g->audio_bop_millis/1000.0) * g->audio_samplerate;
-  num_bop_bytes = sizeof(int16_t) * g->audio_nchannels * num_bop_frames;
-  bip_start_dx = (bytes_total / g->audio_nseconds);
-  bip_end_dx = bip_start_dx + num_bip_bytes;
-  bop_start_dx = ((bytes_total / g->audio_nseconds) * 3);
-  bop_end_dx = bop_start_dx + num_bop_bytes;
 
-  while (1) {
+#define FONT_SCALE(v) ((int)(((int64_t)(v) * scale + 32768) >> 16))
 
-    mutex_lock(&g->audio_mutex);
-      must_stop = g->audio_thread_must_stop;
-    mutex_unlock(&g->audio_mutex);
+  box_w = FONT_SCALE(360);
+  box_h = FONT_SCALE(100);
+  g->text_margin = FONT_SCALE(20);
 
-    if (1 == must_stop) {
-      break;
-    }
+  if ((1 << 16) == scale) {
+    font_box(g, box_w, box_h);
+    return 0;
+  }
 
-    now = ns();
-    if (now > timeout) {
+  /* the scaled glyphs are stored next to each other. */
+  atlas_w = 0;
+  atlas_h = 0;
+  for (k = 0; k < RXS_MAX_CHARS; ++k) {
+    c = &g->chars[k];
+    atlas_w += (FONT_SCALE(c->width) > 0) ? FONT_SCALE(c->width) : 1;
+    atlas_h = (FONT_SCALE(c->height) > atlas_h) ? FONT_SCALE(c->height) : atlas_h;
+  }
+  atlas_h = (atlas_h > 0) ? atlas_h : 1;
 
-      /* Playing bip? */
-      is_bip = (dx >= bip_start_dx && dx <= bip_end_dx) ? 1 : 0;
-      is_bop = (dx >= bop_start_dx && dx <= bop_end_dx) ? 1 : 0;
-      
-      bytes_to_end = bytes_total - dx;
-      if (0 == bytes_to_end) {
-        dx = 0;
-        bytes_to_end = bytes_total;
-      }
+  g->font_atlas = (uint8_t*)calloc((size_t)atlas_w * atlas_h, 1);
+  if (NULL == g->font_atlas) {
+    return -1;
+  }
 
-      if (bytes_to_end < bytes_needed) {
+  for (k = 0, x = 0; k < RXS_MAX_CHARS; ++k) {
 
-        /* We need to read some bytes till the end, then from the start. */
-        memcpy(tmp_buffer, audio_buffer+dx, bytes_to_end-1);
-        
-        /* Read from the start. */
-        bytes_from_start = bytes_needed - bytes_to_end;
-        memcpy(tmp_buffer + bytes_to_end, audio_buffer, bytes_from_start);
-        g->audio_callback((int16_t*)tmp_buffer, nbytes, g->audio_nsamples);
+    c = &g->chars[k];
 
-        dx = bytes_from_start;
-      }
-      else {
-        /* We can read a complete chunk. */
-        g->audio_callback((int16_t*)(audio_buffer + dx), nbytes, g->audio_nsamples);
-        dx += nbytes;
-      }
+    font_scale_glyph(g->font_pixels + c->y * g->font_w + c->x, g->font_w, c->width, c->height,
+                     g->font_atlas + x, atlas_w,
+                     (FONT_SCALE(c->width) > 0) ? FONT_SCALE(c->width) : 1,
+                     (FONT_SCALE(c->height) > 0) ? FONT_SCALE(c->height) : 1);
 
-      /* Update bip / bop flags. */
-      if (is_bip != prev_is_bip) {
-        mutex_lock(&g->audio_mutex);
-          g->audio_is_bip = is_bip;
-        mutex_unlock(&g->audio_mutex);
+    c->x = x;
+    c->y = 0;
+    c->width = (FONT_SCALE(c->width) > 0) ? FONT_SCALE(c->width) : 1;
+    c->height = (FONT_SCALE(c->height) > 0) ? FONT_SCALE(c->height) : 1;
+    c->xoffset = FONT_SCALE(c->xoffset);
+    c->yoffset = FONT_SCALE(c->yoffset);
+    c->xadvance = FONT_SCALE(c->xadvance);
+    x += c->width;
+  }
+
+  g->font_line_height = FONT_SCALE(g->font_line_height);
+
+#undef FONT_SCALE
+
+  g->font_pixels = g->font_atlas;
+  g->font_w = atlas_w;
+  g->font_h = atlas_h;
+
+  font_box(g, box_w, box_h);
+
+  return 0;
+}
+
+/*
+  Sets the size of the time box: the scaled box, or larger when the scaled 
+  glyphs don't fit in it. The glyph sizes are rounded to nearest (and at 
+  least 1 pixel) while the box is rounded down, so at small sizes the clock
+  can be wider than the box. We measure the widest string ("000:00:00:00" 
+  with the widest digit at every position) from the top left of the box.
+*/
+static void font_box(video_generator* g, int box_w, int box_h) {
+
+  const char* layout = "000:00:00:00";
+  video_generator_char* c;
+  int i, k, x, adv, right, bottom;
+
+  x = 0;
+  right = 0;
+  bottom = 0;
+
+  for (i = 0; 0 != layout[i]; ++i) {
+    adv = 0;
+    for (k = 0; k < RXS_MAX_CHARS; ++k) {
+      c = &g->chars[k];
+      if (':' == layout[i] ? (':' != c->id) : (c->id < '0' || c->id > '9')) {
+        continue;
+      }
+      adv = (c->xadvance > adv) ? c->xadvance : adv;
+      right = (x + c->width > right) ? (x + c->width) : right;
+      bottom = (c->yoffset + c->height > bottom) ? (c->yoffset + c->height) : bottom;
+    }
+    x += adv;
+  }
+
+  g->text_extent_w = g->text_margin + right;
+  g->text_extent_h = g->text_margin + bottom;
+
+  /* the box is even so it covers whole chroma pixels. */
+  box_w &= ~1;
+  box_h &= ~1;
+  box_w = (g->text_extent_w > box_w) ? ((g->text_extent_w + 1) & ~1) : box_w;
+  box_h = (g->text_extent_h > box_h) ? ((g->text_extent_h + 1) & ~1) : box_h;
+
+  g->text_w = (box_w > (int)g->width) ? (int)(g->width & ~1) : box_w;
+  g->text_h = (box_h > (int)g->height) ? (int)(g->height & ~1) : box_h;
+}
+
+/* Area sampling of a sw x sh glyph into dw x dh pixels. */
+static void font_scale_glyph(const uint8_t* src, int src_stride, int sw, int sh, uint8_t* dest, int dest_stride, int dw, int dh) {
+
+  int dx, dy, sx, sy;
+  int64_t x0, x1, y0, y1, cx, cy;
+  uint64_t sum;
+  uint64_t area = (uint64_t)sw * sh;
+
+  /* in units of 1/(dw * dh): source pixel i spans [i * dw, (i + 1) * dw), destination pixel d spans [d * sw, (d + 1) * sw). */
+  for (dy = 0; dy < dh; ++dy) {
+
+    y0 = (int64_t)dy * sh;
+    y1 = y0 + sh;
+
+    for (dx = 0; dx < dw; ++dx) {
+
+      x0 = (int64_t)dx * sw;
+      x1 = x0 + sw;
+      sum = 0;
+
+      for (sy = (int)(y0 / dh); sy < sh && (int64_t)sy * dh < y1; ++sy) {
+        cy = (((int64_t)(sy + 1) * dh < y1) ? (int64_t)(sy + 1) * dh : y1) - (((int64_t)sy * dh > y0) ? (int64_t)sy * dh : y0);
+        for (sx = (int)(x0 / dw); sx < sw && (int64_t)sx * dw < x1; ++sx) {
+          cx = (((int64_t)(sx + 1) * dw < x1) ? (int64_t)(sx + 1) * dw : x1) - (((int64_t)sx * dw > x0) ? (int64_t)sx * dw : x0);
+          sum += (uint64_t)(cx * cy) * src[sy * src_stride + sx];
+        }
+      }
+
+      dest[dy * dest_stride + dx] = (uint8_t)((sum + area / 2) / area);
+    }
+  }
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          P A T T E R N S                                            */
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  The stress patterns are generated row by row with SSE2 when available. The
+  scalar fallbacks generate exactly the same pixels so the output doesn't
+  depend on the machine that generated it. 
+
+  Noise is generated by 4 interleaved xorshift32 generators that are seeded
+  per row from the seed, frame and row. Each step of the 4 lanes gives 16 
+  bytes of noise. 
+*/
+
+static uint32_t pattern_hash(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352d;
+  x ^= x >> 15;
+  x *= 0x846ca68b;
+  x ^= x >> 16;
+  return x;
+}
+
+static void pattern_noise_row(uint8_t* dest, int w, uint32_t key, uint32_t amp, int streaming) {
+  uint32_t lanes[4];
+  uint8_t tmp[16];
+  int i;
+
+  for (i = 0; i < 4; ++i) {
+    lanes[i] = pattern_hash(key + 0x9e3779b9 * (i + 1));
+    if (0 == lanes[i]) {
+      lanes[i] = 0x6d2b79f5;
+    }
+  }
+
+#if defined(HAVE_SSE2)
+  {
+    __m128i state = _mm_loadu_si128((const __m128i*)lanes);
+    __m128i zero = _mm_setzero_si128();
+    __m128i mid = _mm_set1_epi16(128);
+    __m128i gain = _mm_set1_epi16((short)amp);
+    __m128i lo, hi;
+
+    for (i = 0; i < w; i += 16) {
+      state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+      state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+      state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+      lo = _mm_unpacklo_epi8(state, zero);
+      hi = _mm_unpackhi_epi8(state, zero);
+      lo = _mm_add_epi16(_mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(lo, mid), gain), 8), mid);
+      hi = _mm_add_epi16(_mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(hi, mid), gain), 8), mid);
+      if (i + 16 <= w) {
+        store16(dest + i, _mm_packus_epi16(lo, hi), streaming);
+      }
+      else {
+        _mm_storeu_si128((__m128i*)tmp, _mm_packus_epi16(lo, hi));
+        memcpy(dest + i, tmp, w - i);
+      }
+    }
+  }
+#else
+  int k, n;
+  for (i = 0; i < w; i += 16) {
+    for (k = 0; k < 4; ++k) {
+      lanes[k] ^= lanes[k] << 13;
+      lanes[k] ^= lanes[k] >> 17;
+      lanes[k] ^= lanes[k] << 5;
+      tmp[k * 4 + 0] = (lanes[k] >> 0) & 0xff;
+      tmp[k * 4 + 1] = (lanes[k] >> 8) & 0xff;
+      tmp[k * 4 + 2] = (lanes[k] >> 16) & 0xff;
+      tmp[k * 4 + 3] = (lanes[k] >> 24) & 0xff;
+    }
+    n = (i + 16 <= w) ? 16 : (w - i);
+    for (k = 0; k < n; ++k) {
+      dest[i + k] = 128 + ((((int)tmp[k] - 128) * (int)amp) >> 8);
+    }
+  }
+#endif
+}
+
+/* 
+   Zone plate: phase = x^2 + y^2 scaled so the frequency reaches nyquist at
+   the left and right edges. We use a parabolic sine approximation on 16 bit
+   phases so it vectorizes without a table lookup. 
+*/
+static void pattern_zoneplate_row(uint8_t* dest, const uint16_t* phase, int w, uint16_t offset, int streaming) {
+  int i;
+
+#if defined(HAVE_SSE2)
+  __m128i off = _mm_set1_epi16((short)offset);
+  __m128i full = _mm_set1_epi16((short)0xffff);
+  __m128i mid = _mm_set1_epi16(128);
+  __m128i sign, p, x, q, a, b;
+
+  for (i = 0; i + 16 <= w; i += 16) {
+    p = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(phase + i)), off);
+    sign = _mm_srai_epi16(p, 15);
+    x = _mm_slli_epi16(p, 1);
+    q = _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_sub_epi16(full, x)), 7);
+    a = _mm_sub_epi16(_mm_xor_si128(q, sign), sign);
+
+    p = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(phase + i + 8)), off);
+    sign = _mm_srai_epi16(p, 15);
+    x = _mm_slli_epi16(p, 1);
+    q = _mm_srli_epi16(_mm_mulhi_epu16(x, _mm_sub_epi16(full, x)), 7);
+    b = _mm_sub_epi16(_mm_xor_si128(q, sign), sign);
+
+    store16(dest + i, _mm_packus_epi16(_mm_add_epi16(a, mid), _mm_add_epi16(b, mid)), streaming);
+  }
+#else
+  i = 0;
+#endif
+
+  for (; i < w; ++i) {
+    uint16_t p = phase[i] + offset;
+    uint16_t x = p << 1;
+    int q = (((uint32_t)x * (uint16_t)(0xffff - x)) >> 16) >> 7;
+    dest[i] = (p & 0x8000) ? (128 - q) : (128 + q);
+  }
+}
+
+static void pattern_checkerboard_row(uint8_t* dest, int w, int odd, int streaming) {
+  int i;
+  uint8_t a = odd ? 0xeb : 0x10;
+  uint8_t b = odd ? 0x10 : 0xeb;
+
+#if defined(HAVE_SSE2)
+  __m128i v = _mm_set1_epi16((short)((b << 8) | a));
+  for (i = 0; i + 16 <= w; i += 16) {
+    store16(dest + i, v, streaming);
+  }
+#else
+  i = 0;
+#endif
+
+  for (; i < w; ++i) {
+    dest[i] = (i & 1) ? b : a;
+  }
+}
+
+static void pattern_ramp_row(uint8_t* dest, const uint8_t* ramp, int w, uint8_t offset, int streaming) {
+  int i;
+
+#if defined(HAVE_SSE2)
+  __m128i off = _mm_set1_epi8((char)offset);
+  for (i = 0; i + 16 <= w; i += 16) {
+    store16(dest + i, _mm_add_epi8(_mm_loadu_si128((const __m128i*)(ramp + i)), off), streaming);
+  }
+#else
+  i = 0;
+#endif
+
+  for (; i < w; ++i) {
+    dest[i] = (uint8_t)(ramp[i] + offset);
+  }
+}
+
+static int pattern_init(video_generator* g) {
+  double k;
+  double dx;
+  uint32_t i;
+
+  if (!g) { return -1; } 
+
+  if (0 != g->streaming_stores) {
+    g->stream_row = (uint8_t*)malloc(g->width);
+    if (NULL == g->stream_row) { return -5; } 
+  }
+
+  switch (g->pattern) {
+
+    case VIDEO_GENERATOR_PATTERN_BARS: {
+      g->bars_row = (uint8_t*)calloc(g->width * 2, 1);
+      if (NULL == g->bars_row) { return -6; } 
+      bars_init(g);
+      return 0;
+    }
+
+    case VIDEO_GENERATOR_PATTERN_NOISE:
+    case VIDEO_GENERATOR_PATTERN_CHECKERBOARD: {
+      return 0;
+    }
+
+    case VIDEO_GENERATOR_PATTERN_ZONEPLATE: {
+      /* d(phase)/dx = 2 * dx * k and must be 0.5 cycle (32768) at dx = width / 2. */
+      g->pattern_phase = (uint16_t*)malloc(sizeof(uint16_t) * g->width);
+      if (NULL == g->pattern_phase) { return -2; } 
+      k = 32768.0 / g->width;
+      for (i = 0; i < g->width; ++i) {
+        dx = (double)i - (g->width * 0.5);
+        g->pattern_phase[i] = (uint16_t)((uint64_t)(dx * dx * k) & 0xffff);
+      }
+      return 0;
+    }
+
+    case VIDEO_GENERATOR_PATTERN_GRADIENT: {
+      g->pattern_ramp = (uint8_t*)malloc(g->width);
+      if (NULL == g->pattern_ramp) { return -3; } 
+      for (i = 0; i < g->width; ++i) {
+        g->pattern_ramp[i] = (uint8_t)((i * 256) / g->width);
+      }
+      return 0;
+    }
+
+    default: {
+      return -4;
+    }
+  }
+}
+
+static void pattern_clear(video_generator* g) {
+
+  if (!g) { return; } 
+
+  if (NULL != g->pattern_phase) {
+    free(g->pattern_phase);
+    g->pattern_phase = NULL;
+  }
+
+  if (NULL != g->pattern_ramp) {
+    free(g->pattern_ramp);
+    g->pattern_ramp = NULL;
+  }
+
+  if (NULL != g->bars_row) {
+    free(g->bars_row);
+    g->bars_row = NULL;
+  }
+
+  if (NULL != g->stream_row) {
+    free(g->stream_row);
+    g->stream_row = NULL;
+  }
+}
+
+int video_generator_pattern_from_string(const char* name, uint32_t* pattern) {
+
+  if (!name) { return -1; } 
+  if (!pattern) { return -2; } 
+
+  if (0 == strcmp(name, "bars"))              { *pattern = VIDEO_GENERATOR_PATTERN_BARS; }
+  else if (0 == strcmp(name, "noise"))        { *pattern = VIDEO_GENERATOR_PATTERN_NOISE; }
+  else if (0 == strcmp(name, "zoneplate"))    { *pattern = VIDEO_GENERATOR_PATTERN_ZONEPLATE; }
+  else if (0 == strcmp(name, "checkerboard")) { *pattern = VIDEO_GENERATOR_PATTERN_CHECKERBOARD; }
+  else if (0 == strcmp(name, "gradient"))     { *pattern = VIDEO_GENERATOR_PATTERN_GRADIENT; }
+  else { return -3; }
+
+  return 0;
+}
+
+/* Draws the luma rows y0 until y1 and the matching chroma rows. */
+static void pattern_draw(video_generator* g, uint32_t y0, uint32_t y1) {
+  uint32_t j;
+  uint32_t key;
+  uint32_t half_w = g->width / 2;
+  uint32_t half_h = g->height / 2;
+  uint32_t cy0 = y0 / 2;
+  uint32_t cy1 = y1 / 2;
+  double k, dy;
+  uint16_t row_phase;
+  uint8_t offset;
+  uint8_t* dest;
+  uint8_t* row;
+  int streaming;
+
+  switch (g->pattern) {
+
+    case VIDEO_GENERATOR_PATTERN_NOISE: {
+      key = pattern_hash(g->seed ^ pattern_hash((uint32_t)g->frame));
+      for (j = y0; j < y1; ++j) {
+        dest = g->y + j * g->strides[0];
+        row = stream_row_begin(g, dest, &streaming);
+        pattern_noise_row(row, g->width, key + j, g->noise_amplitude, streaming);
+        stream_row_end(g, dest, row, g->width);
+      }
+      key = pattern_hash(key);
+      for (j = cy0; j < cy1; ++j) {
+        dest = g->u + j * g->strides[1];
+        row = stream_row_begin(g, dest, &streaming);
+        pattern_noise_row(row, half_w, key + j, g->noise_amplitude, streaming);
+        stream_row_end(g, dest, row, half_w);
+        dest = g->v + j * g->strides[2];
+        row = stream_row_begin(g, dest, &streaming);
+        pattern_noise_row(row, half_w, key + half_h + j, g->noise_amplitude, streaming);
+        stream_row_end(g, dest, row, half_w);
+      }
+      break;
+    }
+
+    case VIDEO_GENERATOR_PATTERN_ZONEPLATE: {
+      k = 32768.0 / g->width;
+      for (j = y0; j < y1; ++j) {
+        dy = (double)j - (g->height * 0.5);
+        row_phase = (uint16_t)((uint64_t)(dy * dy * k) & 0xffff);
+        dest = g->y + j * g->strides[0];
+        row = stream_row_begin(g, dest, &streaming);
+        pattern_zoneplate_row(row, g->pattern_phase, g->width, row_phase + (uint16_t)(g->frame * 2048), streaming);
+        stream_row_end(g, dest, row, g->width);
+      }
+      plane_set(g, g->u + cy0 * g->strides[1], 0x80, (cy1 - cy0) * g->strides[1]);
+      plane_set(g, g->v + cy0 * g->strides[2], 0x80, (cy1 - cy0) * g->strides[2]);
+      break;
+    }
+
+    case VIDEO_GENERATOR_PATTERN_CHECKERBOARD: {
+      for (j = y0; j < y1; ++j) {
+        dest = g->y + j * g->strides[0];
+        row = stream_row_begin(g, dest, &streaming);
+        pattern_checkerboard_row(row, g->width, (j + g->frame) & 1, streaming);
+        stream_row_end(g, dest, row, g->width);
+      }
+      plane_set(g, g->u + cy0 * g->strides[1], 0x80, (cy1 - cy0) * g->strides[1]);
+      plane_set(g, g->v + cy0 * g->strides[2], 0x80, (cy1 - cy0) * g->strides[2]);
+      break;
+    }
+
+    case VIDEO_GENERATOR_PATTERN_GRADIENT: {
+      offset = (uint8_t)(g->frame * 4);
+      for (j = y0; j < y1; ++j) {
+        dest = g->y + j * g->strides[0];
+        row = stream_row_begin(g, dest, &streaming);
+        pattern_ramp_row(row, g->pattern_ramp, g->width, offset, streaming);
+        stream_row_end(g, dest, row, g->width);
+      }
+      for (j = cy0; j < cy1; ++j) {
+        plane_set(g, g->u + j * g->strides[1], (uint8_t)((j * 256) / half_h + offset), half_w);
+        dest = g->v + j * g->strides[2];
+        row = stream_row_begin(g, dest, &streaming);
+        pattern_ramp_row(row, g->pattern_ramp, half_w, (uint8_t)(128 - offset), streaming);
+        stream_row_end(g, dest, row, half_w);
+      }
+      break;
+    }
+  }
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          B A R S                                                    */
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  Every row of the bars pattern is the same except for the moving bar, so we 
+  compose one luma, u and v row once and copy it into the planes. Each row is
+  written only once, so it can be streamed.
+*/
+
+static void bars_init(video_generator* g) {
+  uint8_t* y = g->bars_row;
+  uint8_t* u = g->bars_row + g->width;
+  uint8_t* v = u + g->width / 2;
+  int bw = g->width / 7;
+  int i, dx;
+  int colors[] = { 
+    255, 255, 255,  // white
+    255, 255, 0,    // yellow
+    0,   255, 255,  // cyan
+    0,   255, 0,    // green
+    255, 0,   255,  // magenta
+    255, 0,   0,    // red
+    0,   0,   255   // blue
+  };
+
+  for (i = 0; i < 7; ++i) {
+    dx = i * 3;
+    memset(y + i * bw, RGB2Y(colors[dx + 0], colors[dx + 1], colors[dx + 2]), bw);
+    memset(u + (i * bw) / 2, RGB2U(colors[dx + 0], colors[dx + 1], colors[dx + 2]), bw / 2);
+    memset(v + (i * bw) / 2, RGB2V(colors[dx + 0], colors[dx + 1], colors[dx + 2]), bw / 2);
+  }
+}
+
+/* Draws the bars and the moving bar that starts at `start_y` into the rows between clip_y0 and clip_y1. */
+static void bars_draw(video_generator* g, int32_t start_y, int32_t nlines, int yc, int uc, int vc) {
+  int32_t j;
+  uint32_t half_w = g->width / 2;
+  const uint8_t* u = g->bars_row + g->width;
+  const uint8_t* v = u + half_w;
+
+  for (j = (int32_t)g->clip_y0; j < (int32_t)g->clip_y1; ++j) {
+    if (j >= start_y && j < (start_y + nlines)) {
+      plane_set(g, g->y + j * g->strides[0], yc, g->width);
+    }
+    else {
+      plane_copy(g, g->y + j * g->strides[0], g->bars_row, g->width);
+    }
+  }
+
+  for (j = (int32_t)(g->clip_y0 / 2); j < (int32_t)(g->clip_y1 / 2); ++j) {
+    if (j >= (start_y / 2) && j < (start_y / 2 + nlines / 2)) {
+      plane_set(g, g->u + j * g->strides[1], uc, half_w);
+      plane_set(g, g->v + j * g->strides[2], vc, half_w);
+    }
+    else {
+      plane_copy(g, g->u + j * g->strides[1], u, half_w);
+      plane_copy(g, g->v + j * g->strides[2], v, half_w);
+    }
+  }
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          T I M E L I N E                                            */
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  The timeline draws a blocky background (16x16 luma blocks) that is unique
+  per scene and a number of moving rectangles on top. Everything is computed 
+  from the frame number. When the previous frame is still in the buffer we
+  only restore the background where the objects were and draw them at their
+  new position; all restores happen before all draws so overlapping objects
+  are handled correctly.
+*/
+
+static int timeline_init(video_generator* g, video_generator_settings* cfg) {
+  uint32_t i;
+  
+  g->scenes = NULL;
+  g->num_scenes = 0;
+  g->timeline_nframes = 0;
+  g->timeline_rects = NULL;
+  g->timeline_nrects = 0;
+  g->timeline_valid = 0;
+  g->timeline_prev_frame = 0;
+  g->scene = 0;
+
+  if (0 == cfg->num_scenes) {
+    return 0;
+  }
+
+  if (NULL == cfg->scenes) {
+    printf("Error: num_scenes is set but scenes is NULL.\n");
+    return -1;
+  }
+
+  for (i = 0; i < cfg->num_scenes; ++i) {
+    if (0 == cfg->scenes[i].num_frames) {
+      printf("Error: scene %u has no frames.\n", i);
+      return -2;
+    }
+    if (cfg->scenes[i].num_objects > VIDEO_GENERATOR_MAX_OBJECTS) {
+      printf("Error: scene %u has too many objects: %u, max is %d.\n", i, cfg->scenes[i].num_objects, VIDEO_GENERATOR_MAX_OBJECTS);
+      return -3;
+    }
+    g->timeline_nframes += cfg->scenes[i].num_frames;
+  }
+
+  g->scenes = (video_generator_scene*)malloc(sizeof(video_generator_scene) * cfg->num_scenes);
+  if (NULL == g->scenes) {
+    return -4;
+  }
+
+  g->timeline_rects = (int*)malloc(sizeof(int) * 4 * VIDEO_GENERATOR_MAX_OBJECTS);
+  if (NULL == g->timeline_rects) {
+    free(g->scenes);
+    g->scenes = NULL;
+    return -5;
+  }
+
+  memcpy(g->scenes, cfg->scenes, sizeof(video_generator_scene) * cfg->num_scenes);
+  g->num_scenes = cfg->num_scenes;
+
+  return 0;
+}
+
+static void timeline_clear(video_generator* g) {
+
+  if (NULL != g->scenes) {
+    free(g->scenes);
+    g->scenes = NULL;
+  }
+
+  if (NULL != g->timeline_rects) {
+    free(g->timeline_rects);
+    g->timeline_rects = NULL;
+  }
+
+  g->num_scenes = 0;
+  g->timeline_nframes = 0;
+  g->timeline_nrects = 0;
+  g->timeline_valid = 0;
+}
+
+/* Bounce `p` between 0 and `range`. */
+static int64_t timeline_reflect(int64_t p, int64_t range) {
+  int64_t period;
+
+  if (range <= 0) {
+    return 0;
+  }
+
+  period = range * 2;
+  p %= period;
+  if (p < 0) {
+    p += period;
+  }
+  if (p > range) {
+    p = period - p;
+  }
+
+  return p;
+}
+
+static void timeline_background_plane(uint8_t* plane, uint32_t stride, uint32_t seed, int shift, int lo, int range, int x, int y, int w, int h, int ox, int oy) {
+  int i, j, run;
+  uint32_t px, by, val;
+  uint8_t* row;
+  int block = 1 << shift;
+
+  for (j = y; j < (y + h); ++j) {
+    row = plane + j * stride;
+    by = (uint32_t)(j + oy) >> shift;
+    i = x;
+    while (i < (x + w)) {
+      px = (uint32_t)(i + ox);
+      run = block - (px & (block - 1));
+      if (run > (x + w) - i) {
+        run = (x + w) - i;
+      }
+      val = pattern_hash(seed ^ ((px >> shift) * 0x9e3779b1) ^ (by * 0x85ebca77));
+      memset(row + i, lo + (val % range), run);
+      i += run;
+    }
+  }
+}
+
+static void timeline_background(video_generator* g, uint32_t seed, int x, int y, int w, int h, int ox, int oy) {
+  timeline_background_plane(g->y, g->strides[0], seed, 4, 16, 220, x, y, w, h, ox, oy);
+  timeline_background_plane(g->u, g->strides[1], seed ^ 0x55555555, 3, 64, 128, x / 2, y / 2, w / 2, h / 2, ox >> 1, oy >> 1);
+  timeline_background_plane(g->v, g->strides[2], seed ^ 0xaaaaaaaa, 3, 64, 128, x / 2, y / 2, w / 2, h / 2, ox >> 1, oy >> 1);
+}
+
+/* Scales the frame towards black, `a` is 0-256. */
+static void timeline_fade(video_generator* g, int a) {
+  uint32_t i;
+
+  for (i = 0; i < g->ybytes; ++i) {
+    g->y[i] = 16 + ((((int)g->y[i] - 16) * a) >> 8);
+  }
+
+  for (i = 0; i < g->ubytes; ++i) {
+    g->u[i] = 128 + ((((int)g->u[i] - 128) * a) >> 8);
+    g->v[i] = 128 + ((((int)g->v[i] - 128) * a) >> 8);
+  }
+}
+
+static void timeline_draw(video_generator* g) {
+  video_generator_scene* sc = NULL;
+  uint64_t pos;
+  uint64_t t;
+  uint32_t i, s, hash;
+  int64_t range_x, range_y, px, py, vx, vy;
+  double angle;
+  int size, ox, oy, a, can_update, is_delta;
+  int* rect;
+
+  /* find the scene and the frame within the scene. */
+  pos = g->frame % g->timeline_nframes;
+  for (s = 0; s < g->num_scenes; ++s) {
+    if (pos < g->scenes[s].num_frames) {
+      break;
+    }
+    pos -= g->scenes[s].num_frames;
+  }
+  
+  sc = &g->scenes[s];
+  t = pos;
+  ox = (int)(sc->pan_x * (int64_t)t);
+  oy = (int)(sc->pan_y * (int64_t)t);
+
+  a = timeline_alpha(sc, t);
+
+  size = (0 != sc->object_size) ? sc->object_size : (g->height / 10);
+  size = (size > (int)g->height) ? (int)g->height : size;
+  size = (size > (int)g->width) ? (int)g->width : size;
+  size &= ~1;
+  size = (size < 2) ? 2 : size;
+
+  can_update = (1 == g->timeline_valid
+                && g->timeline_prev_frame + 1 == g->frame
+                && g->scene == s
+                && 0 == sc->pan_x 
+                && 0 == sc->pan_y
+                && 256 == a) ? 1 : 0;
+
+  /* 
+     Compared to the previous frame only the objects moved when it was the
+     frame before in the same still scene, and both are opaque. This 
+     doesn't depend on what's in the buffer, unlike `can_update`.
+  */
+  is_delta = (g->timeline_prev_frame + 1 == g->frame
+              && g->scene == s
+              && 0 == sc->pan_x 
+              && 0 == sc->pan_y
+              && 256 == a
+              && 256 == timeline_alpha(sc, (0 == t) ? (sc->num_frames - 1) : (t - 1))) ? 1 : 0;
+
+  if (1 == is_delta) {
+    for (i = 0; i < g->timeline_nrects; ++i) {
+      rect = g->timeline_rects + i * 4;
+      dirty_add(g, rect[0], rect[1], rect[2], rect[3]);
+    }
+  }
+  else {
+    dirty_full(g);
+  }
+
+  if (1 == can_update) {
+    for (i = 0; i < g->timeline_nrects; ++i) {
+      rect = g->timeline_rects + i * 4;
+      timeline_background(g, sc->seed, rect[0], rect[1], rect[2], rect[3], ox, oy);
+    }
+  }
+  else {
+    timeline_background(g, sc->seed, 0, 0, g->width, g->height, ox, oy);
+  }
+
+  /* positions are in 1/256 pixels */
+  range_x = (int64_t)(g->width - size) << 8;
+  range_y = (int64_t)(g->height - size) << 8;
+
+  for (i = 0; i < sc->num_objects; ++i) {
+    hash = pattern_hash(sc->seed + 0x9e3779b9 * (i + 1));
+    angle = (hash & 0xffff) * (6.28318530718 / 65536.0);
+    vx = (int64_t)(cos(angle) * sc->object_speed * 256.0);
+    vy = (int64_t)(sin(angle) * sc->object_speed * 256.0);
+    hash = pattern_hash(hash);
+    px = (range_x > 0) ? (int64_t)(hash % (uint32_t)range_x) : 0;
+    hash = pattern_hash(hash);
+    py = (range_y > 0) ? (int64_t)(hash % (uint32_t)range_y) : 0;
+    px = timeline_reflect(px + vx * (int64_t)t, range_x) >> 8;
+    py = timeline_reflect(py + vy * (int64_t)t, range_y) >> 8;
+
+    rect = g->timeline_rects + i * 4;
+    rect[0] = (int)px & ~1;
+    rect[1] = (int)py & ~1;
+    rect[2] = size;
+    rect[3] = size;
+
+    hash = pattern_hash(hash);
+    fill(g, rect[0], rect[1], size, size, hash & 0xff, (hash >> 8) & 0xff, (hash >> 16) & 0xff);
+
+    if (1 == is_delta) {
+      dirty_add(g, rect[0], rect[1], size, size);
+    }
+  }
+
+  if (256 != a) {
+    timeline_fade(g, a);
+  }
+
+  g->timeline_nrects = sc->num_objects;
+  g->timeline_valid = (256 == a) ? 1 : 0;
+  g->timeline_prev_frame = g->frame;
+  g->scene = s;
+}
+
+/* Opacity of frame `t` of the scene, 0-256, from the fade in and fade out. */
+static int timeline_alpha(video_generator_scene* sc, uint64_t t) {
+  int a = 256;
+  int f;
+
+  if (0 != sc->fade_in && t < sc->fade_in) {
+    a = (int)((t * 256) / sc->fade_in);
+  }
+  if (0 != sc->fade_out && t + sc->fade_out >= sc->num_frames) {
+    f = (int)(((sc->num_frames - t - 1) * 256) / sc->fade_out);
+    a = (f < a) ? f : a;
+  }
+
+  return a;
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          R E N D I T I O N S                                        */
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  Every rendition is a generator without audio, faults and slices. A native
+  rendition is updated with the frame number of the main generator; its 
+  time box uses the audio state of the main generator (`audio_source`).
+
+  A downscaled rendition is created with an area (box) filter: every output
+  pixel is the average of the input pixels it covers, weighted by how much
+  of each input pixel it covers. The filter is separable; the weights of 
+  both directions are 14 bit fixed point and sum to exactly 1 << 14. The 
+  vertical pass does the most work and is done with SSE2; it writes the
+  rows with 7 fractional bits so the horizontal pass can use 32 bit sums.
+*/
+
+struct video_generator_scaler {
+  scaler_axis axes[4];                                    /* luma x, luma y, chroma x, chroma y. */
+  int16_t* row;                                           /* result of the vertical pass. */
+};
+
+/* `align`: the number of taps is rounded up to a multiple of this; the extra weights are zero. */
+static int scaler_axis_init(scaler_axis* axis, uint32_t src, uint32_t dst, uint32_t align) {
+  uint32_t d, k, first, last, s0, span;
+  uint64_t start, end, lo, hi, cum, prev;
+
+  axis->dst = dst;
+  axis->ntaps = 0;
+  axis->start = NULL;
+  axis->weights = NULL;
+
+  if (0 == dst || dst > src) {
+    return -1;
+  }
+
+  /* output d covers [d * src, (d + 1) * src) in units of 1/dst input pixel. */
+  for (d = 0; d < dst; ++d) {
+    first = (uint32_t)(((uint64_t)d * src) / dst);
+    last = (uint32_t)((((uint64_t)(d + 1) * src) + dst - 1) / dst) - 1;
+    axis->ntaps = ((last - first + 1) > axis->ntaps) ? (last - first + 1) : axis->ntaps;
+  }
+
+  span = axis->ntaps;
+  axis->ntaps = ((span + align - 1) / align) * align;
+
+  axis->start = (uint32_t*)malloc(sizeof(uint32_t) * dst);
+  axis->weights = (uint16_t*)calloc((size_t)dst * axis->ntaps, sizeof(uint16_t));
+  if (NULL == axis->start || NULL == axis->weights) {
+    return -2;
+  }
+
+  for (d = 0; d < dst; ++d) {
+
+    start = (uint64_t)d * src;
+    end = start + src;
+    first = (uint32_t)(start / dst);
+    last = (uint32_t)((end + dst - 1) / dst) - 1;
+
+    /* keep all taps inside the input. */
+    s0 = (first + span > src) ? (src - span) : first;
+    axis->start[d] = s0;
+
+    cum = 0;
+    prev = 0;
+    for (k = first; k <= last; ++k) {
+      lo = ((uint64_t)k * dst > start) ? (uint64_t)k * dst : start;
+      hi = ((uint64_t)(k + 1) * dst < end) ? (uint64_t)(k + 1) * dst : end;
+      cum += hi - lo;
+      axis->weights[d * axis->ntaps + (k - s0)] = (uint16_t)(((cum << 14) / src) - prev);
+      prev = (cum << 14) / src;
+    }
+  }
+
+  return 0;
+}
+
+static void scaler_axis_clear(scaler_axis* axis) {
+  free(axis->start);
+  free(axis->weights);
+  axis->start = NULL;
+  axis->weights = NULL;
+}
+
+/* Weighted sum of `ntaps` rows, starting at `src`, into `dest` (7 fractional bits). */
+static void scaler_vertical(int16_t* dest, const uint8_t* src, uint32_t stride, uint32_t w, const uint16_t* weights, uint32_t ntaps) {
+  uint32_t i, k;
+  int32_t sum;
+
+#if defined(HAVE_SSE2)
+  __m128i zero = _mm_setzero_si128();
+  __m128i round = _mm_set1_epi32(64);
+  __m128i acc0, acc1, acc2, acc3, wk, a, b, lo, hi;
+  
+  for (i = 0; i + 16 <= w; i += 16) {
+    acc0 = _mm_setzero_si128();
+    acc1 = _mm_setzero_si128();
+    acc2 = _mm_setzero_si128();
+    acc3 = _mm_setzero_si128();
+    for (k = 0; k < ntaps; k += 2) {
+      a = _mm_loadu_si128((const __m128i*)(src + k * stride + i));
+      if (k + 1 < ntaps) {
+        b = _mm_loadu_si128((const __m128i*)(src + (k + 1) * stride + i));
+        wk = _mm_set1_epi32((int)weights[k] | ((int)weights[k + 1] << 16));
+      }
+      else {
+        b = zero;
+        wk = _mm_set1_epi32((int)weights[k]);
+      }
+      /* interleave the two rows so each madd multiplies a pixel pair with its weight pair. */
+      lo = _mm_unpacklo_epi8(a, b);
+      hi = _mm_unpackhi_epi8(a, b);
+      acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), wk));
+      acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), wk));
+      acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), wk));
+      acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), wk));
+    }
+    acc0 = _mm_srai_epi32(_mm_add_epi32(acc0, round), 7);
+    acc1 = _mm_srai_epi32(_mm_add_epi32(acc1, round), 7);
+    acc2 = _mm_srai_epi32(_mm_add_epi32(acc2, round), 7);
+    acc3 = _mm_srai_epi32(_mm_add_epi32(acc3, round), 7);
+    _mm_storeu_si128((__m128i*)(dest + i + 0), _mm_packs_epi32(acc0, acc1));
+    _mm_storeu_si128((__m128i*)(dest + i + 8), _mm_packs_epi32(acc2, acc3));
+  }
+#else
+  i = 0;
+#endif
+
+  for (; i < w; ++i) {
+    sum = 0;
+    for (k = 0; k < ntaps; ++k) {
+      sum += weights[k] * src[k * stride + i];
+    }
+    dest[i] = (int16_t)((sum + 64) >> 7);
+  }
+}
+
+static void scaler_plane(video_generator_scaler* sc, scaler_axis* ax, scaler_axis* ay, 
+                         uint8_t* dest, uint32_t dest_stride, 
+                         const uint8_t* src, uint32_t src_stride, uint32_t src_w)
+{
+  uint32_t i, j, k;
+  uint32_t sum;
+  const uint16_t* w;
+  const int16_t* row;
+
+  for (j = 0; j < ay->dst; ++j) {
+
+    scaler_vertical(sc->row, src + ay->start[j] * src_stride, src_stride, src_w, ay->weights + j * ay->ntaps, ay->ntaps);
+
+    i = 0;
+
+#if defined(HAVE_SSE2)
+    /* four outputs at a time, 8 taps per madd; the row has room for the padded taps. */
+    {
+      __m128i round = _mm_set1_epi32(1 << 20);
+      __m128i m0, m1, m2, m3, t0, t1;
+      uint8_t* out = dest + j * dest_stride;
+      int32_t packed;
+      
+      for (; i + 4 <= ax->dst; i += 4) {
+        m0 = _mm_setzero_si128();
+        m1 = _mm_setzero_si128();
+        m2 = _mm_setzero_si128();
+        m3 = _mm_setzero_si128();
+        for (k = 0; k < ax->ntaps; k += 8) {
+          w = ax->weights + i * ax->ntaps + k;
+          m0 = _mm_add_epi32(m0, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sc->row + ax->start[i + 0] + k)), _mm_loadu_si128((const __m128i*)(w))));
+          m1 = _mm_add_epi32(m1, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sc->row + ax->start[i + 1] + k)), _mm_loadu_si128((const __m128i*)(w + ax->ntaps))));
+          m2 = _mm_add_epi32(m2, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sc->row + ax->start[i + 2] + k)), _mm_loadu_si128((const __m128i*)(w + 2 * ax->ntaps))));
+          m3 = _mm_add_epi32(m3, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sc->row + ax->start[i + 3] + k)), _mm_loadu_si128((const __m128i*)(w + 3 * ax->ntaps))));
+        }
+        /* horizontal sums of m0..m3 into one register. */
+        t0 = _mm_add_epi32(_mm_unpacklo_epi32(m0, m1), _mm_unpackhi_epi32(m0, m1));
+        t1 = _mm_add_epi32(_mm_unpacklo_epi32(m2, m3), _mm_unpackhi_epi32(m2, m3));
+        t0 = _mm_add_epi32(_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1));
+        t0 = _mm_srai_epi32(_mm_add_epi32(t0, round), 21);
+        t0 = _mm_packs_epi32(t0, t0);
+        packed = _mm_cvtsi128_si32(_mm_packus_epi16(t0, t0));
+        memcpy(out + i, &packed, 4);
+      }
+    }
+#endif
+
+    for (; i < ax->dst; ++i) {
+      w = ax->weights + i * ax->ntaps;
+      row = sc->row + ax->start[i];
+      sum = 0;
+      for (k = 0; k < ax->ntaps; ++k) {
+        sum += (uint32_t)w[k] * (uint32_t)row[k];
+      }
+      dest[j * dest_stride + i] = (uint8_t)((sum + (1u << 20)) >> 21);
+    }
+  }
+}
+
+static int renditions_init(video_generator* g, video_generator_settings* cfg) {
+  video_generator_settings rcfg;
+  video_generator_rendition* rd;
+  video_generator* r;
+  video_generator_scaler* sc;
+  uint32_t i;
+  int err = 0;
+
+  g->renditions = NULL;
+  g->num_renditions = 0;
+  g->rendition_mode = VIDEO_GENERATOR_RENDITION_NATIVE;
+  g->scaler = NULL;
+  g->audio_source = g;
+
+  if (0 == cfg->num_renditions) {
+    return 0;
+  }
+
+  if (NULL == cfg->renditions || cfg->num_renditions > VIDEO_GENERATOR_MAX_RENDITIONS) {
+    printf("Error: invalid renditions, max is %d.\n", VIDEO_GENERATOR_MAX_RENDITIONS);
+    return -1;
+  }
+
+  for (i = 0; i < cfg->num_renditions; ++i) {
+    rd = &cfg->renditions[i];
+    if (0 == rd->width || 0 == rd->height || (rd->width & 1) || (rd->height & 1)) {
+      printf("Error: rendition %u must have an even width and height.\n", i);
+      return -2;
+    }
+    if (VIDEO_GENERATOR_RENDITION_DOWNSCALE == rd->mode && (rd->width > cfg->width || rd->height > cfg->height)) {
+      printf("Error: rendition %u (%ux%u) is larger than the frame and can't be downscaled.\n", i, rd->width, rd->height);
+      return -3;
+    }
+    if (VIDEO_GENERATOR_RENDITION_NATIVE != rd->mode && VIDEO_GENERATOR_RENDITION_DOWNSCALE != rd->mode) {
+      printf("Error: rendition %u has an invalid mode: %u\n", i, rd->mode);
+      return -4;
+    }
+  }
+
+  g->renditions = (video_generator*)calloc(cfg->num_renditions, sizeof(video_generator));
+  if (NULL == g->renditions) {
+    return -5;
+  }
+
+  for (i = 0; i < cfg->num_renditions; ++i) {
+
+    rd = &cfg->renditions[i];
+    r = &g->renditions[i];
+
+    memset(&rcfg, 0x00, sizeof(rcfg));
+    rcfg.width = rd->width;
+    rcfg.height = rd->height;
+    rcfg.fps = cfg->fps;
+    rcfg.pattern = cfg->pattern;
+    rcfg.noise_amplitude = cfg->noise_amplitude;
+    rcfg.seed = cfg->seed;
+    rcfg.scenes = cfg->scenes;
+    rcfg.num_scenes = cfg->num_scenes;
+    rcfg.streaming_stores = cfg->streaming_stores;
+
+    if (0 != video_generator_init(&rcfg, r)) {
+      printf("Error: cannot initialize rendition %u.\n", i);
+      err = -6;
+      break;
+    }
+
+    g->num_renditions++;
+    r->audio_source = g;
+    r->rendition_mode = rd->mode;
+
+    if (VIDEO_GENERATOR_RENDITION_DOWNSCALE != rd->mode) {
+      continue;
+    }
+
+    sc = (video_generator_scaler*)calloc(1, sizeof(video_generator_scaler));
+    if (NULL == sc) {
+      err = -7;
+      break;
+    }
+
+    r->scaler = sc;
+    /* the horizontal taps are padded to 8 so the row gets room to read past its end. */
+    if (0 != scaler_axis_init(&sc->axes[0], g->width, r->width, 8)
+        || 0 != scaler_axis_init(&sc->axes[1], g->height, r->height, 1)
+        || 0 != scaler_axis_init(&sc->axes[2], g->width / 2, r->width / 2, 8)
+        || 0 != scaler_axis_init(&sc->axes[3], g->height / 2, r->height / 2, 1)
+        || NULL == (sc->row = (int16_t*)calloc(g->width + sc->axes[0].ntaps + sc->axes[2].ntaps, sizeof(int16_t))))
+      {
+        printf("Error: cannot create the scaler for rendition %u.\n", i);
+        err = -8;
+        break;
+      }
+  }
+
+  if (0 != err) {
+    renditions_clear(g);
+  }
+
+  return err;
+}
+
+static void renditions_clear(video_generator* g) {
+  video_generator* r;
+  uint32_t i, k;
+
+  for (i = 0; i < g->num_renditions; ++i) {
+    r = &g->renditions[i];
+    if (NULL != r->scaler) {
+      for (k = 0; k < 4; ++k) {
+        scaler_axis_clear(&r->scaler->axes[k]);
+      }
+      free(r->scaler->row);
+      free(r->scaler);
+      r->scaler = NULL;
+    }
+    video_generator_clear(r);
+  }
+
+  free(g->renditions);
+  g->renditions = NULL;
+  g->num_renditions = 0;
+}
+
+/* Creates the renditions for the frame that was just generated, `frame` is its number. */
+static void renditions_update(video_generator* g, uint64_t frame) {
+  video_generator* r;
+  video_generator_scaler* sc;
+  uint32_t i;
+
+  for (i = 0; i < g->num_renditions; ++i) {
+
+    r = &g->renditions[i];
+    r->fault_flags = g->fault_flags;
+    r->timestamp = g->timestamp;
+
+    /* a repeated frame keeps the previous picture. */
+    if (0 != (g->fault_flags & VIDEO_GENERATOR_FAULT_REPEATED)) {
+      r->frame = frame + 1;
+      r->num_dirty_rects = 0;
+      continue;
+    }
+
+    if (VIDEO_GENERATOR_RENDITION_NATIVE == r->rendition_mode) {
+      r->frame = frame;
+      video_generator_update(r);
+      r->fault_flags = g->fault_flags;
+      r->timestamp = g->timestamp;
+      continue;
+    }
+
+    sc = r->scaler;
+    scaler_plane(sc, &sc->axes[0], &sc->axes[1], r->y, r->strides[0], g->y, g->strides[0], g->width);
+    scaler_plane(sc, &sc->axes[2], &sc->axes[3], r->u, r->strides[1], g->u, g->strides[1], g->width / 2);
+    scaler_plane(sc, &sc->axes[2], &sc->axes[3], r->v, r->strides[2], g->v, g->strides[2], g->width / 2);
+    dirty_scale(r, g);
+    r->frame = frame + 1;
+  }
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                    D I R T Y   R E C T A N G L E S                                  */
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  Called by `video_generator_update()` before the frame is drawn with the
+  position of the moving bar and the time box. It compares them with the 
+  previous frame and sets `dirty_rects` to the rows of the old and new bar
+  and to the time box when it changed. The timeline adds its objects itself.
+*/
+static void dirty_frame(video_generator* g, int bar_y, int bar_h, int box_x, int box_y, uint32_t box_color) {
+  int32_t y0, y1;
+  uint64_t seconds;
+
+  /* the chroma rows of the bar are [bar_y / 2, bar_y / 2 + bar_h / 2). */
+  y0 = bar_y & ~1;
+  y1 = bar_y + bar_h;
+  y1 = ((2 * (bar_y / 2 + bar_h / 2)) > y1) ? (2 * (bar_y / 2 + bar_h / 2)) : y1;
+  seconds = g->frame / g->fps_den;
+
+  g->num_dirty_rects = 0;
+
+  if (0 == g->dirty_valid) {
+    dirty_full(g);
+  }
+  else if (0 != g->num_scenes) {
+    /* the timeline adds its own rects. */
+  }
+  else if (VIDEO_GENERATOR_PATTERN_BARS != g->pattern) {
+    dirty_full(g);
+  }
+  else {
+    dirty_add(g, 0, g->dirty_bar_y0, g->width, g->dirty_bar_y1 - g->dirty_bar_y0);
+    dirty_add(g, 0, y0, g->width, y1 - y0);
+  }
+
+  if (1 == g->dirty_valid
+      && (box_color != g->dirty_box_color || seconds != g->dirty_box_seconds))
+    {
+      /* the clock can be larger than the box when the box was clipped to a tiny frame. */
+      dirty_add(g, box_x, box_y,
+                (g->text_extent_w > g->text_w) ? g->text_extent_w : g->text_w,
+                (g->text_extent_h > g->text_h) ? g->text_extent_h : g->text_h);
+    }
+
+  g->dirty_bar_y0 = y0;
+  g->dirty_bar_y1 = y1;
+  g->dirty_box_color = box_color;
+  g->dirty_box_seconds = seconds;
+  g->dirty_valid = 1;
+}
+
+/* 
+   Adds a rect to `dirty_rects`, clipped to the frame and aligned to 2
+   pixels. When the bounding box of the rect and one we already have isn't
+   larger than both together they are merged; when the list is full all
+   rects are merged into one.
+*/
+static void dirty_add(video_generator* g, int x, int y, int w, int h) {
+  video_generator_rect* r;
+  int x0, y0, x1, y1;
+  int bx0, by0, bx1, by1;
+  uint32_t i;
+
+  x0 = (x < 0) ? 0 : x;
+  y0 = (y < 0) ? 0 : y;
+  x1 = ((x + w) > (int)g->width) ? (int)g->width : (x + w);
+  y1 = ((y + h) > (int)g->height) ? (int)g->height : (y + h);
+  x0 &= ~1;
+  y0 &= ~1;
+  x1 = (x1 + 1) & ~1;
+  y1 = (y1 + 1) & ~1;
+
+  if (x1 <= x0 || y1 <= y0) {
+    return;
+  }
+
+  i = 0;
+  while (i < g->num_dirty_rects) {
+
+    r = &g->dirty_rects[i];
+    bx0 = ((int)r->x < x0) ? (int)r->x : x0;
+    by0 = ((int)r->y < y0) ? (int)r->y : y0;
+    bx1 = ((int)(r->x + r->width) > x1) ? (int)(r->x + r->width) : x1;
+    by1 = ((int)(r->y + r->height) > y1) ? (int)(r->y + r->height) : y1;
+
+    if ((int64_t)(bx1 - bx0) * (by1 - by0) > (int64_t)r->width * r->height + (int64_t)(x1 - x0) * (y1 - y0)) {
+      ++i;
+      continue;
+    }
+
+    /* merge, and check the bigger rect against the others again. */
+    x0 = bx0;
+    y0 = by0;
+    x1 = bx1;
+    y1 = by1;
+    g->num_dirty_rects--;
+    g->dirty_rects[i] = g->dirty_rects[g->num_dirty_rects];
+    i = 0;
+  }
+
+  if (VIDEO_GENERATOR_MAX_DIRTY_RECTS == g->num_dirty_rects) {
+    for (i = 0; i < g->num_dirty_rects; ++i) {
+      r = &g->dirty_rects[i];
+      x0 = ((int)r->x < x0) ? (int)r->x : x0;
+      y0 = ((int)r->y < y0) ? (int)r->y : y0;
+      x1 = ((int)(r->x + r->width) > x1) ? (int)(r->x + r->width) : x1;
+      y1 = ((int)(r->y + r->height) > y1) ? (int)(r->y + r->height) : y1;
+    }
+    g->num_dirty_rects = 0;
+  }
+
+  r = &g->dirty_rects[g->num_dirty_rects];
+  r->x = x0;
+  r->y = y0;
+  r->width = x1 - x0;
+  r->height = y1 - y0;
+  g->num_dirty_rects++;
+}
+
+static void dirty_full(video_generator* g) {
+  g->dirty_rects[0].x = 0;
+  g->dirty_rects[0].y = 0;
+  g->dirty_rects[0].width = g->width;
+  g->dirty_rects[0].height = g->height;
+  g->num_dirty_rects = 1;
+}
+
+/* 
+   Sets the rects of the downscaled rendition `r` from the rects of `g`. An
+   output pixel is the average of the input pixels it covers, so it changes 
+   when one of those changed; we add one pixel for the rounding.
+*/
+static void dirty_scale(video_generator* r, video_generator* g) {
+  video_generator_rect* d;
+  uint64_t x0, y0, x1, y1;
+  uint32_t i;
+
+  r->num_dirty_rects = 0;
+
+  for (i = 0; i < g->num_dirty_rects; ++i) {
+    d = &g->dirty_rects[i];
+    x0 = ((uint64_t)d->x * r->width) / g->width;
+    y0 = ((uint64_t)d->y * r->height) / g->height;
+    x1 = ((uint64_t)(d->x + d->width) * r->width + g->width - 1) / g->width;
+    y1 = ((uint64_t)(d->y + d->height) * r->height + g->height - 1) / g->height;
+    dirty_add(r, (int)x0 - 1, (int)y0 - 1, (int)(x1 - x0) + 2, (int)(y1 - y0) + 2);
+  }
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          F R A M E   C A C H E                                      */
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  The cache file starts with a `cache_header`, followed by one byte per frame 
+  that is 1 when the frame is stored. The frames start at `data_offset` and 
+  are `frame_stride` bytes apart; both are page aligned. A new cache is 
+  written to `<path>.<pid>.tmp` and renamed to `<path>` when all frames of 
+  the cycle are stored, so another run never sees a partial cache. The key
+  is a hash of everything that changes the pixels; bump CACHE_VERSION when
+  the drawing code changes.
+*/
+
+#define CACHE_MAGIC "VGCACHE"
+#define CACHE_VERSION 1
+
+typedef struct cache_header cache_header;
+
+struct cache_header {
+  char magic[8];                                          /* CACHE_MAGIC. */
+  uint32_t version;                                       /* CACHE_VERSION. */
+  uint32_t complete;                                      /* 1 when all frames are stored. */
+  uint64_t key;                                           /* hash of the settings, see cache_key(). */
+  uint32_t width;                                         /* width of the frames. */
+  uint32_t height;                                        /* height of the frames. */
+  uint64_t nframes;                                       /* number of frames in the cycle. */
+  uint64_t frame_bytes;                                   /* number of bytes of one frame (the y, u and v planes). */
+  uint64_t frame_stride;                                  /* distance between the frames. */
+  uint64_t data_offset;                                   /* offset of the first frame. */
+};
+
+struct video_generator_cache {
+  int fd;                                                 /* the cache file. */
+  uint8_t* map;                                           /* the mapped file. */
+  uint64_t map_bytes;                                     /* size of the file. */
+  cache_header* header;                                   /* points to the start of `map`. */
+  uint8_t* stored;                                        /* one byte per frame, 1 when stored. */
+  uint64_t nmissing;                                      /* number of frames that aren't stored yet. */
+  char* path;                                             /* the final path of the cache. */
+  char* tmp_path;                                         /* the path we write to, NULL when the file has its final name. */
+};
+
+/* Number of frames after which the picture repeats, 0 when it never does. */
+static uint64_t cache_period(video_generator* g) {
+
+  if (0 != g->num_scenes) {
+    return g->timeline_nframes;
+  }
+
+  switch (g->pattern) {
+    case VIDEO_GENERATOR_PATTERN_BARS:         { return 5 * (uint64_t)g->fps_den; } /* the moving bar.         */
+    case VIDEO_GENERATOR_PATTERN_ZONEPLATE:    { return 32;                       } /* phase += 2048, 16 bits. */
+    case VIDEO_GENERATOR_PATTERN_CHECKERBOARD: { return 2;                        }
+    case VIDEO_GENERATOR_PATTERN_GRADIENT:     { return 64;                       } /* offset += 4, 8 bits.    */
+    default:                                   { return 0;                        } /* noise.                  */
+  }
+}
+
+/* FNV-1a */
+static uint64_t cache_hash(uint64_t h, const void* data, size_t nbytes) {
+  const uint8_t* p = (const uint8_t*)data;
+  size_t i;
+
+  for (i = 0; i < nbytes; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ull;
+  }
+
+  return h;
+}
+
+static uint64_t cache_key(video_generator* g) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  uint32_t values[8];
+
+  values[0] = CACHE_VERSION;
+  values[1] = g->width;
+  values[2] = g->height;
+  values[3] = (uint32_t)g->fps_num;
+  values[4] = (uint32_t)g->fps_den;
+  values[5] = g->pattern;
+  values[6] = g->noise_amplitude;
+  values[7] = g->seed;
+
+  h = cache_hash(h, values, sizeof(values));
+  h = cache_hash(h, &g->num_scenes, sizeof(g->num_scenes));
+
+  if (0 != g->num_scenes) {
+    h = cache_hash(h, g->scenes, sizeof(video_generator_scene) * g->num_scenes);
+  }
+
+  return h;
+}
+
+static int cache_init(video_generator* g, video_generator_settings* cfg) {
+
+#if defined(_WIN32)
+
+  g->cache = NULL;
+  g->frames_cached = 0;
+
+  if (NULL != cfg->cache_path) {
+    printf("Error: the frame cache is not supported on Windows.\n");
+    return -1;
+  }
+
+  return 0;
+
+#else
+
+  video_generator_cache* c;
+  cache_header* h;
+  struct stat st;
+  uint64_t nframes, key, page, stride, offset, total;
+  size_t len;
+
+  g->cache = NULL;
+  g->frames_cached = 0;
+
+  if (NULL == cfg->cache_path) {
+    return 0;
+  }
+
+  nframes = cache_period(g);
+  if (0 == nframes) {
+    printf("Error: the noise pattern never repeats and can't be cached.\n");
+    return -1;
+  }
+
+  key = cache_key(g);
+  page = (uint64_t)sysconf(_SC_PAGESIZE);
+  stride = ((g->nbytes + page - 1) / page) * page;
+  offset = ((sizeof(cache_header) + nframes + page - 1) / page) * page;
+  total = offset + nframes * stride;
+
+  c = (video_generator_cache*)calloc(1, sizeof(video_generator_cache));
+  if (NULL == c) {
+    return -2;
+  }
+
+  c->fd = -1;
+  g->cache = c;
+
+  len = strlen(cfg->cache_path);
+  c->path = (char*)malloc(len + 1);
+  if (NULL == c->path) {
+    cache_clear(g);
+    return -3;
+  }
+  memcpy(c->path, cfg->cache_path, len + 1);
+
+  /* reuse the cache of a previous run when it was made with the same settings. */
+  c->fd = open(c->path, O_RDONLY);
+  if (c->fd >= 0) {
+
+    if (0 == fstat(c->fd, &st) && (uint64_t)st.st_size == total) {
+      c->map = (uint8_t*)mmap(NULL, total, PROT_READ, MAP_SHARED, c->fd, 0);
+      c->map = (MAP_FAILED == (void*)c->map) ? NULL : c->map;
+    }
+
+    h = (cache_header*)c->map;
+    if (NULL != h
+        && 0 == memcmp(h->magic, CACHE_MAGIC, sizeof(h->magic))
+        && CACHE_VERSION == h->version
+        && 1 == h->complete
+        && key == h->key
+        && g->width == h->width
+        && g->height == h->height
+        && nframes == h->nframes
+        && g->nbytes == h->frame_bytes
+        && stride == h->frame_stride
+        && offset == h->data_offset)
+      {
+        c->map_bytes = total;
+        c->header = h;
+        c->stored = c->map + sizeof(cache_header);
+        c->nmissing = 0;
+        madvise(c->map, total, MADV_WILLNEED);
+        return 0;
+      }
+
+    if (NULL != c->map) {
+      munmap(c->map, total);
+      c->map = NULL;
+    }
+    close(c->fd);
+    c->fd = -1;
+  }
+
+  /* render a new cache; the frames are stored while they are generated. */
+  c->tmp_path = (char*)malloc(len + 32);
+  if (NULL == c->tmp_path) {
+    cache_clear(g);
+    return -4;
+  }
+  snprintf(c->tmp_path, len + 32, "%s.%ld.tmp", c->path, (long)getpid());
+
+  c->fd = open(c->tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (c->fd < 0) {
+    printf("Error: cannot create the frame cache %s.\n", c->tmp_path);
+    free(c->tmp_path);
+    c->tmp_path = NULL;
+    cache_clear(g);
+    return -5;
+  }
+
+  /* reserve the space now, running out of disk while writing into the map is fatal (SIGBUS). */
+#if defined(__linux)
+  if (0 != posix_fallocate(c->fd, 0, total)) {
+#else
+  if (0 != ftruncate(c->fd, total)) {
+#endif
+    printf("Error: cannot allocate %llu bytes for the frame cache.\n", (unsigned long long)total);
+    cache_clear(g);
+    return -6;
+  }
+
+  c->map = (uint8_t*)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+  if (MAP_FAILED == (void*)c->map) {
+    printf("Error: cannot map the frame cache.\n");
+    c->map = NULL;
+    cache_clear(g);
+    return -7;
+  }
+
+  c->map_bytes = total;
+  c->header = (cache_header*)c->map;
+  c->stored = c->map + sizeof(cache_header);
+  c->nmissing = nframes;
+
+  h = c->header;
+  memcpy(h->magic, CACHE_MAGIC, sizeof(h->magic));
+  h->version = CACHE_VERSION;
+  h->complete = 0;
+  h->key = key;
+  h->width = g->width;
+  h->height = g->height;
+  h->nframes = nframes;
+  h->frame_bytes = g->nbytes;
+  h->frame_stride = stride;
+  h->data_offset = offset;
+  memset(c->stored, 0x00, nframes);
+
+  return 0;
+
+#endif
+}
+
+static void cache_clear(video_generator* g) {
+
+  video_generator_cache* c = g->cache;
+
+  if (NULL == c) {
+    return;
+  }
+
+#if !defined(_WIN32)
+  if (NULL != c->map) {
+    munmap(c->map, c->map_bytes);
+  }
+  if (c->fd >= 0) {
+    close(c->fd);
+  }
+  /* an incomplete cache is useless for the next run. */
+  if (NULL != c->tmp_path) {
+    unlink(c->tmp_path);
+  }
+#endif
+
+  free(c->tmp_path);
+  free(c->path);
+  free(c);
+
+  g->cache = NULL;
+}
+
+/* Copies the current frame from the cache, returns 0 when it was cached. */
+static int cache_replay(video_generator* g) {
+
+  video_generator_cache* c = g->cache;
+  uint64_t pos, t;
+  uint32_t s;
+
+  if (NULL == c) {
+    return -1;
+  }
+
+  pos = g->frame % c->header->nframes;
+  if (0 == c->stored[pos]) {
+    return -1;
+  }
+
+  VIDEO_GENERATOR_TRACE_BEGIN(trace_replay);
+  plane_copy(g, g->y, c->map + c->header->data_offset + pos * c->header->frame_stride, g->nbytes);
+  VIDEO_GENERATOR_TRACE_END(trace_replay, "cache replay");
+
+  /* the buffer no longer contains a frame the timeline drew itself. */
+  if (0 != g->num_scenes) {
+    g->timeline_valid = 0;
+    t = g->frame % g->timeline_nframes;
+    for (s = 0; s < g->num_scenes && t >= g->scenes[s].num_frames; ++s) {
+      t -= g->scenes[s].num_frames;
+    }
+    g->scene = s;
+  }
+
+  g->frames_cached++;
+
+  return 0;
+}
+
+/* Stores the frame we just rendered when it isn't in the cache yet. */
+static void cache_store(video_generator* g) {
+
+  video_generator_cache* c = g->cache;
+  uint64_t pos;
+
+  if (0 == c->nmissing) {
+    return;
+  }
+
+  pos = g->frame % c->header->nframes;
+  if (0 != c->stored[pos]) {
+    return;
+  }
+
+  memcpy(c->map + c->header->data_offset + pos * c->header->frame_stride, g->y, g->nbytes);
+  c->stored[pos] = 1;
+  c->nmissing--;
+
+  if (0 != c->nmissing) {
+    return;
+  }
+
+  c->header->complete = 1;
+
+#if !defined(_WIN32)
+  if (0 != rename(c->tmp_path, c->path)) {
+    printf("Error: cannot rename the frame cache to %s, it's only used by this run.\n", c->path);
+    return;
+  }
+#endif
+
+  free(c->tmp_path);
+  c->tmp_path = NULL;
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          F A U L T S                                                */
+/* ----------------------------------------------------------------------------------- */
+
+static int faults_init(video_generator* g, video_generator_settings* cfg) {
+  
+  video_generator_faults* f = &g->faults;
+
+  memset(f, 0x00, sizeof(*f));
+  g->fault_prev = NULL;
+  g->fault_prev_valid = 0;
+  g->fault_flags = 0;
+  g->frames_dropped = 0;
+  g->frames_repeated = 0;
+  g->audio_periods_skipped = 0;
+  g->audio_periods_doubled = 0;
+
+  if (NULL == cfg->faults) {
+    return 0;
+  }
+
+  memcpy(f, cfg->faults, sizeof(*f));
+
+  if (f->audio_jitter > VIDEO_GENERATOR_JITTER_EXPONENTIAL) { return -1; } 
+  if (f->audio_skip_probability < 0.0 || f->audio_skip_probability > 1.0) { return -2; } 
+  if (f->audio_double_probability < 0.0 || f->audio_double_probability > 1.0) { return -3; } 
+  if (f->video_drop_probability < 0.0 || f->video_drop_probability > 1.0) { return -4; } 
+  if (f->video_repeat_probability < 0.0 || f->video_repeat_probability > 1.0) { return -5; } 
+  if (f->audio_skew_ppm <= -1000000) { return -6; } 
+
+  /* we keep our own copy: the buffer we rendered into can be gone when we repeat it. */
+  if (0.0 != f->video_repeat_probability) {
+    g->fault_prev = (uint8_t*)malloc(g->nbytes);
+    if (NULL == g->fault_prev) { return -7; } 
+  }
+
+  return 0;
+}
+
+/* Remembers the picture we just showed, so the next frame can repeat it. */
+static void fault_store(video_generator* g) {
+
+  if (NULL == g->fault_prev) {
+    return;
+  }
+
+  plane_copy(g, g->fault_prev, g->y, g->nbytes);
+  g->fault_prev_valid = 1;
+}
+
+/* Returns a number in [0, 1) that only depends on the seed, salt and index. */
+static double fault_chance(uint32_t seed, uint32_t salt, uint64_t index) {
+  uint32_t h = pattern_hash(seed ^ salt);
+  h = pattern_hash(h ^ (uint32_t)index);
+  h = pattern_hash(h ^ (uint32_t)(index >> 32));
+  return h * (1.0 / 4294967296.0);
+}
+
+/* The extra delay in ns for audio period `index`. */
+static uint64_t fault_jitter(video_generator_faults* f, uint64_t index) {
+  double u0, u1, us;
+
+  if (VIDEO_GENERATOR_JITTER_NONE == f->audio_jitter || 0 == f->audio_jitter_us) {
+    return 0;
+  }
+
+  u0 = fault_chance(f->seed, 0x6a697430, index);
+  u1 = fault_chance(f->seed, 0x6a697431, index);
+
+  switch (f->audio_jitter) {
+    case VIDEO_GENERATOR_JITTER_UNIFORM: {
+      us = u0 * f->audio_jitter_us;
+      break;
+    }
+    case VIDEO_GENERATOR_JITTER_NORMAL: {
+      /* Box-Muller, we only use the positive half. */
+      us = fabs(sqrt(-2.0 * log(1.0 - u0)) * cos(6.28318530718 * u1)) * f->audio_jitter_us;
+      break;
+    }
+    case VIDEO_GENERATOR_JITTER_EXPONENTIAL: {
+      us = -log(1.0 - u0) * f->audio_jitter_us;
+      break;
+    }
+    default: {
+      us = 0.0;
+      break;
+    }
+  }
+
+  return (uint64_t)(us * 1000.0);
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          A U D I O  G E N E R A T O R                               */
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  The audio is a sequence of events that loops. Instead of rendering the
+  whole loop up front we keep a position in the sequence and synthesize
+  each period when it's due, so the memory we need doesn't depend on the
+  length of the sequence. Without `audio_events` we use the classic 4
+  second loop with the bip at 1 second and the bop at 3 seconds.
+*/
+static int audio_sequence_init(video_generator* g, video_generator_settings* cfg) {
+
+  video_generator_audio_event* ev;
+  uint64_t total_ms = 0;
+  uint32_t i;
+
+  if (!g) { return -1; }
+  if (!cfg) { return -2; }
+  if (0 != cfg->num_audio_events && NULL == cfg->audio_events) { return -3; }
+
+  g->audio_num_events = (0 == cfg->num_audio_events) ? 5 : cfg->num_audio_events;
+  g->audio_events = (video_generator_audio_event*)malloc(sizeof(video_generator_audio_event) * g->audio_num_events);
+  g->audio_event_ends = (uint64_t*)malloc(sizeof(uint64_t) * g->audio_num_events);
+  if (NULL == g->audio_events || NULL == g->audio_event_ends) {
+    audio_sequence_clear(g);
+    return -4;
+  }
+
+  if (0 != cfg->num_audio_events) {
+    memcpy(g->audio_events, cfg->audio_events, sizeof(video_generator_audio_event) * g->audio_num_events);
+  }
+  else {
+    memset(g->audio_events, 0x00, sizeof(video_generator_audio_event) * g->audio_num_events);
+    g->audio_events[0].duration_ms = 1000;
+    g->audio_events[1].type = VIDEO_GENERATOR_AUDIO_TONE;
+    g->audio_events[1].duration_ms = 100;
+    g->audio_events[1].frequency = g->audio_bip_frequency;
+    g->audio_events[1].marker = VIDEO_GENERATOR_AUDIO_MARKER_BIP;
+    g->audio_events[2].duration_ms = 1900;
+    g->audio_events[3].type = VIDEO_GENERATOR_AUDIO_TONE;
+    g->audio_events[3].duration_ms = 100;
+    g->audio_events[3].frequency = g->audio_bop_frequency;
+    g->audio_events[3].marker = VIDEO_GENERATOR_AUDIO_MARKER_BOP;
+    g->audio_events[4].duration_ms = 900;
+  }
+
+  for (i = 0; i < g->audio_num_events; ++i) {
+
+    ev = &g->audio_events[i];
+
+    if (ev->type > VIDEO_GENERATOR_AUDIO_SWEEP
+        || 0 == ev->duration_ms
+        || ev->marker > VIDEO_GENERATOR_AUDIO_MARKER_BOP
+        || ev->amplitude > 32767)
+      {
+        printf("Error: audio event %u is invalid.\n", i);
+        audio_sequence_clear(g);
+        return -5;
+      }
+
+    if (VIDEO_GENERATOR_AUDIO_SILENCE != ev->type) {
+      if (ev->frequency <= 0.0 || ev->frequency >= (g->audio_samplerate / 2)
+          || (VIDEO_GENERATOR_AUDIO_SWEEP == ev->type && (ev->frequency_end <= 0.0 || ev->frequency_end >= (g->audio_samplerate / 2))))
+        {
+          printf("Error: the frequency of audio event %u must be between 0 and %u.\n", i, g->audio_samplerate / 2);
+          audio_sequence_clear(g);
+          return -6;
+        }
+    }
+
+    if (0 == ev->amplitude) {
+      ev->amplitude = VIDEO_GENERATOR_AUDIO_AMPLITUDE;
+    }
+
+    /* the ends are computed from the total so rounding doesn't add up. */
+    total_ms += ev->duration_ms;
+    g->audio_event_ends[i] = (total_ms * g->audio_samplerate) / 1000;
+    if (g->audio_event_ends[i] <= ((0 == i) ? 0 : g->audio_event_ends[i - 1])) {
+      printf("Error: audio event %u is shorter than one sample.\n", i);
+      audio_sequence_clear(g);
+      return -7;
+    }
+  }
+
+  g->audio_event = 0;
+  g->audio_position = 0;
+  g->audio_phase = 0.0;
+
+  return 0;
+}
+
+static void audio_sequence_clear(video_generator* g) {
+
+  if (NULL != g->audio_events) {
+    free(g->audio_events);
+    g->audio_events = NULL;
+  }
+
+  if (NULL != g->audio_event_ends) {
+    free(g->audio_event_ends);
+    g->audio_event_ends = NULL;
+  }
+
+  g->audio_num_events = 0;
+  g->audio_event = 0;
+  g->audio_position = 0;
+}
+
+/*
+  Returns the VIDEO_GENERATOR_AUDIO_MARKER_* bits (1 << marker) that the 
+  time box of the current frame shows: the marker of the event that plays
+  at the first sample of the frame and of the events that started after 
+  the first sample of the previous frame. So the color changes at the first
+  frame that starts at or after the first sample of the event, never before
+  the sound, and an event that is shorter than a frame still colors one 
+  frame. This only depends on the frame number and the sequence, which 
+  doesn't change after init, so we don't have to sync with the audio thread.
+*/
+uint32_t video_generator_markers(video_generator* g) {
+
+  video_generator* s;
+  uint64_t lo, hi, total, pos, start, end, n;
+  uint32_t markers = 0;
+  uint32_t i;
+
+  if (!g) { return 0; } 
+
+  s = g->audio_source;
+  if (NULL == s || 0 == s->audio_num_events) {
+    return 0;
+  }
+
+  hi = ((g->frame * s->audio_samplerate * g->fps_num) / g->fps_den) + 1;
+  lo = (0 == g->frame) ? 0 : (((g->frame - 1) * s->audio_samplerate * g->fps_num) / g->fps_den) + 1;
+  total = s->audio_event_ends[s->audio_num_events - 1];
+  n = ((hi - lo) < total) ? (hi - lo) : total;
+  pos = lo % total;
+
+  for (i = 0; s->audio_event_ends[i] <= pos; ++i) {
+  }
+
+  /* walk over the samples (previous frame, this frame]; the last one is the first sample of this frame. */
+  while (n > 0) {
+    start = (0 == i) ? 0 : s->audio_event_ends[i - 1];
+    end = s->audio_event_ends[i];
+    if (start == pos || (end - pos) >= n) {
+      markers |= (1u << s->audio_events[i].marker);
+    }
+    if ((end - pos) >= n) {
+      break;
+    }
+    n -= end - pos;
+    pos = end;
+    i++;
+    if (i == s->audio_num_events) {
+      i = 0;
+      pos = 0;
+    }
+  }
+
+  return markers & ~(1u << VIDEO_GENERATOR_AUDIO_MARKER_NONE);
+}
+
+/*
+  Synthesizes the next `nframes` frames of the sequence into `out`. Only 
+  called from the audio thread.
+*/
+static void audio_render(video_generator* g, int16_t* out, uint32_t nframes) {
+
+  video_generator_audio_event* ev;
+  uint64_t start, end;
+  uint32_t prev_type;
+  uint32_t n;
+  double freq, dfreq;
+
+  while (nframes > 0) {
+
+    ev = &g->audio_events[g->audio_event];
+    start = (0 == g->audio_event) ? 0 : g->audio_event_ends[g->audio_event - 1];
+    end = g->audio_event_ends[g->audio_event];
+    n = (uint32_t)(((end - g->audio_position) < nframes) ? (end - g->audio_position) : nframes);
+
+    if (VIDEO_GENERATOR_AUDIO_SILENCE == ev->type) {
+      memset((uint8_t*)out, 0x00, sizeof(int16_t) * n * g->audio_nchannels);
+    }
+    else {
+
+      /* a tone after silence starts at phase 0, otherwise we continue the previous oscillator. */
+      if (start == g->audio_position) {
+        prev_type = g->audio_events[(0 == g->audio_event) ? (g->audio_num_events - 1) : (g->audio_event - 1)].type;
+        if (VIDEO_GENERATOR_AUDIO_SILENCE == prev_type) {
+          g->audio_phase = 0.0;
+        }
+      }
+
+      /* frequency in cycles per sample at our position, and its change per sample for a sweep. */
+      freq = ev->frequency / g->audio_samplerate;
+      dfreq = 0.0;
+      if (VIDEO_GENERATOR_AUDIO_SWEEP == ev->type) {
+        dfreq = ((ev->frequency_end - ev->frequency) / g->audio_samplerate) / (double)(end - start);
+        freq += dfreq * (double)(g->audio_position - start);
+      }
+
+      audio_oscillator(out, n, g->audio_nchannels, ev->channels, (float)ev->amplitude, &g->audio_phase, &freq, dfreq);
+    }
+
+    out += n * g->audio_nchannels;
+    nframes -= n;
+    g->audio_position += n;
+
+    if (g->audio_position == end) {
+      g->audio_event++;
+      if (g->audio_event == g->audio_num_events) {
+        g->audio_event = 0;
+        g->audio_position = 0;
+      }
+    }
+  }
+}
+
+/*
+  Phase continuous sine oscillator that writes `nframes` frames to the
+  channels in the `channels` mask (0 = all). The phase (in cycles) and 
+  frequency (in cycles per sample) are kept in doubles and advanced per 4 
+  samples; the 4 samples in between are evaluated in one vector with a 
+  polynomial sine that is accurate to a few millionths, far below one step 
+  of int16. `dfreq` is added to the frequency every sample for a sweep.
+*/
+static void audio_oscillator(int16_t* out, uint32_t nframes, uint32_t nchannels, uint32_t channels, float amplitude, double* phase, double* freq, double dfreq) {
+
+  int16_t s[4];
+  double p = *phase;
+  double f = *freq;
+  uint32_t i, k, c, n;
+  float fo, fd;
+
+#if defined(HAVE_SSE2)
+  const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  const __m128 chirp = _mm_setr_ps(0.0f, 0.0f, 1.0f, 3.0f);  /* k * (k - 1) / 2 */
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 two_pi = _mm_set1_ps(6.28318530718f);
+  const __m128 amp = _mm_set1_ps(amplitude);
+  __m128 x, a, sg, t, t2, y;
+  __m128i si;
+#else
+  static const float lane[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+  static const float chirp[4] = { 0.0f, 0.0f, 1.0f, 3.0f };
+  float x, a, t, t2, y;
+#endif
+
+  for (i = 0; i < nframes; i += 4) {
+
+    fo = (float)f;
+    fd = (float)dfreq;
+
+#if defined(HAVE_SSE2)
+    /* phase of the 4 samples, wrapped to [-0.5, 0.5) cycles. */
+    x = _mm_add_ps(_mm_set1_ps((float)p), _mm_add_ps(_mm_mul_ps(lane, _mm_set1_ps(fo)), _mm_mul_ps(chirp, _mm_set1_ps(fd))));
+    x = _mm_sub_ps(x, _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(x, half))));
+
+    /* sin(2 pi x) = sin(2 pi (0.5 - x)): fold |x| into [0, 0.25]. */
+    sg = _mm_and_ps(x, sign);
+    a = _mm_andnot_ps(sign, x);
+    a = _mm_min_ps(a, _mm_sub_ps(half, a));
+    t = _mm_mul_ps(a, two_pi);
+    t2 = _mm_mul_ps(t, t);
+    y = _mm_add_ps(_mm_set1_ps(-1.0f / 39916800.0f), _mm_mul_ps(t2, _mm_set1_ps(1.0f / 6227020800.0f)));
+    y = _mm_add_ps(_mm_set1_ps(1.0f / 362880.0f), _mm_mul_ps(t2, y));
+    y = _mm_add_ps(_mm_set1_ps(-1.0f / 5040.0f), _mm_mul_ps(t2, y));
+    y = _mm_add_ps(_mm_set1_ps(1.0f / 120.0f), _mm_mul_ps(t2, y));
+    y = _mm_add_ps(_mm_set1_ps(-1.0f / 6.0f), _mm_mul_ps(t2, y));
+    y = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(t2, y));
+    y = _mm_or_ps(_mm_mul_ps(_mm_mul_ps(y, t), amp), sg);
+
+    si = _mm_cvtps_epi32(y);
+    si = _mm_packs_epi32(si, si);
+    _mm_storel_epi64((__m128i*)s, si);
+#else
+    for (k = 0; k < 4; ++k) {
+      x = (float)p + (lane[k] * fo + chirp[k] * fd);
+      x = x - (float)(int)(x + 0.5f);
+      a = (x < 0.0f) ? -x : x;
+      a = (a < (0.5f - a)) ? a : (0.5f - a);
+      t = a * 6.28318530718f;
+      t2 = t * t;
+      y = -1.0f / 39916800.0f + t2 * (1.0f / 6227020800.0f);
+      y = 1.0f / 362880.0f + t2 * y;
+      y = -1.0f / 5040.0f + t2 * y;
+      y = 1.0f / 120.0f + t2 * y;
+      y = -1.0f / 6.0f + t2 * y;
+      y = 1.0f + t2 * y;
+      y = y * t * amplitude;
+      y = (x < 0.0f) ? -y : y;
+      s[k] = (int16_t)lrintf(y);
+    }
+#endif
+
+    /* route to the channels. */
+    n = ((nframes - i) < 4) ? (nframes - i) : 4;
+    for (k = 0; k < n; ++k) {
+      for (c = 0; c < nchannels; ++c) {
+        out[c] = (0 == channels || 0 != (channels & (1u << c))) ? s[k] : 0;
+      }
+      out += nchannels;
+    }
+
+    /* advance the phase by n samples: sum of f + j * dfreq for j = 0..n-1. */
+    p += n * f + dfreq * (0.5 * n * (n - 1));
+    f += n * dfreq;
+    p -= floor(p);
+  }
+
+  *phase = p;
+  *freq = f;
+}
+
+static void* audio_thread(void* gen) {
+  video_generator* g;
+  video_generator_timestamp ts;
+  uint8_t must_stop;
+  uint64_t now, start, due, period;
+  double delay;
+  uint32_t nbytes = 0; 
+  int ncalls = 0;
+
+  /* get the handle. */
+  must_stop = 0;
+  g = (video_generator*)gen;
+  if (NULL == g) {
+    printf("Not supposed to happen but the audio thread cannot get a handle to the generator.\n");
+    exit(1);
+  }
+  
+  /* init */
+  now = 0;
+  period = 0;
+  nbytes = g->audio_nsamples * sizeof(int16_t) * g->audio_nchannels;
+
+  /* duration of one period in ns; a skewed clock runs faster (ppm > 0) or slower. */
+  delay = (g->audio_nsamples * ((double)1.0/g->audio_samplerate) * 1e9);
+  delay = delay * (1e6 / (1e6 + g->faults.audio_skew_ppm));
+
+  VIDEO_GENERATOR_TRACE_THREAD("audio");
+
+  start = ns();
+
+  while (1) {
+
+    mutex_lock(&g->audio_mutex);
+      must_stop = g->audio_thread_must_stop;
+    mutex_unlock(&g->audio_mutex);
+
+    if (1 == must_stop) {
+      break;
+    }
+
+    /* periods are scheduled on absolute times so jitter doesn't accumulate. */
+    due = start + (uint64_t)(period * delay) + fault_jitter(&g->faults, period);
+    now = ns();
+    if (now < due) {
+      /* sleep in small steps so we can stop in time. */
+      sleep_ns((due - now) > 2000000 ? 2000000 : (due - now));
+      continue;
+    }
+
+    /* how late we woke up, in ns. */
+    VIDEO_GENERATOR_TRACE_INSTANT("audio wakeup", (int64_t)(now - due));
+
+    /* synthesize the period. */
+    audio_render(g, g->audio_buffer, g->audio_nsamples);
+
+    /* A period can be lost or delivered twice when we simulate faults. */
+    ncalls = 1;
+    if (0.0 != g->faults.audio_skip_probability
+        && fault_chance(g->faults.seed, 0x736b6970, period) < g->faults.audio_skip_probability) 
+      {
+        ncalls = 0;
       }
-      if (is_bop != prev_is_bop) {
-        mutex_lock(&g->audio_mutex);
-          g->audio_is_bop = is_bop;
-        mutex_unlock(&g->audio_mutex);
+    else if (0.0 != g->faults.audio_double_probability
+             && fault_chance(g->faults.seed, 0x64626c65, period) < g->faults.audio_double_probability) 
+      {
+        ncalls = 2;
       }
 
-      timeout = now + delay;
-      prev_is_bip = is_bip;
-      prev_is_bop = is_bop;
+    if (1 != ncalls) {
+      mutex_lock(&g->audio_mutex);
+        g->audio_periods_skipped += (0 == ncalls) ? 1 : 0;
+        g->audio_periods_doubled += (2 == ncalls) ? 1 : 0;
+      mutex_unlock(&g->audio_mutex);
+    }
+
+    /* the samples of a skipped period are lost, the next period doesn't start earlier. */
+    ts.pts = (int64_t)(period * g->audio_nsamples);
+    ts.timebase_num = 1;
+    ts.timebase_den = g->audio_samplerate;
+    ts.sample = period * g->audio_nsamples;
+    ts.capture_ns = start + (uint64_t)(period * delay);
+
+    while (ncalls > 0) {
+      VIDEO_GENERATOR_TRACE_BEGIN(trace_callback);
+      g->audio_callback(g->audio_buffer, nbytes, g->audio_nsamples, &ts);
+      VIDEO_GENERATOR_TRACE_END(trace_callback, "audio callback");
+      ncalls--;
     }
+
+    period++;
   }
 
-  free(tmp_buffer);
-  tmp_buffer = NULL;
+  VIDEO_GENERATOR_TRACE_THREAD_EXIT();
 
   return NULL;
 }
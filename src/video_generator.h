@@ -34,6 +34,12 @@
   video_generator_init()       - initialize, see below for the declaration.
   video_generator_update()     - generate a new video frame, see below for the declaration.
   video_generator_clear()      - frees allocated memory, see below for the declaration. 
+  video_generator_set_buffer() - render into your own buffer of `nbytes` bytes (e.g. shared memory), 
+                                 pass NULL to render into our own buffer again. This changes 
+                                 the y, u, v and planes members.
+  video_generator_pattern_from_string() - converts "bars", "noise", "zoneplate", "checkerboard" or
+                                 "gradient" into a VIDEO_GENERATOR_PATTERN_* value, returns < 0
+                                 for an unknown name.
 
 
   Settings:
@@ -49,6 +55,263 @@
   bip_frequency    - the frequency that is used for the bip sound (e.g. 700).
   bop_frequency    - the frequency that is used for the bop sound (e.g. 1500).
   audio_callback   - set this t the audio callback that will receive the audio buffer. 
+  pattern          - the content that is drawn below the time box, one of the 
+                     VIDEO_GENERATOR_PATTERN_* values. 0 (the default) draws the 
+                     color bars with the moving bar.
+  noise_amplitude  - amplitude of the VIDEO_GENERATOR_PATTERN_NOISE content, 0-255. 
+                     0 is flat gray, 255 uses the full 8 bit range.
+  seed             - seed for the noise pattern. The same seed, frame number and 
+                     size always generate the same pixels.
+
+  scenes           - optional array with scenes, see "Timeline" below.
+  num_scenes       - number of elements in `scenes`.
+  faults           - optional capture faults to simulate, see "Faults" below.
+  slice_rows       - render and hand over the frame in slices of this many luma rows, 
+                     a multiple of VIDEO_GENERATOR_SLICE_ALIGN. See "Slices" below.
+  slice_callback   - called for each slice, required when slice_rows is set.
+  slice_user       - passed into the slice callback.
+  renditions       - optional array with extra resolutions to generate, see "Renditions" below.
+  num_renditions   - number of elements in `renditions`, max VIDEO_GENERATOR_MAX_RENDITIONS.
+  streaming_stores - 1 to write the planes with non-temporal stores that bypass 
+                     the cache, see "Streaming stores" below.
+  cache_path       - file with one pre-rendered cycle of frames that is replayed, 
+                     see "Frame cache" below.
+  audio_events     - optional array with the audio sequence, see "Audio sequence" below.
+  num_audio_events - number of elements in `audio_events`.
+
+  Make sure to zero the settings (e.g. memset) before you set the members you
+  need so new settings get their default values.
+
+  Patterns
+  --------
+
+  The default bars pattern compresses to almost nothing. To put an encoder
+  under real bitrate pressure you can select one of the stress patterns. 
+  The time box is always drawn on top. Its size follows the resolution: 
+  it's 360x100 at 1280x720, 540x150 at 1920x1080, etc. The digits are 
+  scaled once in `video_generator_init()`, drawing them is a copy.
+
+  VIDEO_GENERATOR_PATTERN_BARS          - 7 vertical color bars and a moving horizontal bar.
+  VIDEO_GENERATOR_PATTERN_NOISE         - per pixel noise in all planes, changes every frame.
+  VIDEO_GENERATOR_PATTERN_ZONEPLATE     - circular zone plate up to the Nyquist frequency, with moving phase.
+  VIDEO_GENERATOR_PATTERN_CHECKERBOARD  - 1 pixel luma checkerboard that inverts every frame.
+  VIDEO_GENERATOR_PATTERN_GRADIENT      - horizontal luma ramp and chroma ramps that sweep every frame.
+
+  Timeline
+  --------
+
+  To reproduce rate control and lookahead worst cases you can pass a list of 
+  scenes. When `num_scenes` is not 0 the pattern is replaced by the timeline.
+  Scenes are played back to back and the timeline loops after the last one.
+  Each scene has a blocky background that is unique for the scene, so going 
+  from one scene to the next is a hard cut. A scene describes:
+
+  num_frames       - the number of frames of the scene.
+  num_objects      - the number of independently moving rectangles (max VIDEO_GENERATOR_MAX_OBJECTS).
+  object_size      - width and height of the rectangles in pixels, 0 = height / 10.
+  object_speed     - speed of the objects in pixels per frame. They bounce off the edges.
+  pan_x, pan_y     - global pan of the background in pixels per frame.
+  fade_in          - number of frames to fade in from black at the start of the scene.
+  fade_out         - number of frames to fade out to black at the end of the scene.
+  seed             - seed for the background and the objects.
+
+  Everything is a function of the frame number so the same timeline always 
+  gives the same frames. When there is no pan and no fade only the rectangles 
+  of the objects (where they were and where they are now) are redrawn; this
+  depends on the previous frame still being in the buffer. The `scene` member
+  of the generator holds the index of the scene of the last generated frame. 
+
+  Faults
+  ------
+
+  Real capture devices deliver audio late, drop frames and run their clocks 
+  a bit apart. To exercise the resync logic of encoders you can pass a
+  `video_generator_faults` with the faults you want. Every decision is made 
+  by hashing the seed with the index of the audio period or video frame, 
+  so the same seed always gives the same faults, independent of timing.
+
+  seed                     - seed for all fault decisions.
+  audio_jitter             - VIDEO_GENERATOR_JITTER_{NONE, UNIFORM, NORMAL, EXPONENTIAL}.
+  audio_jitter_us          - uniform: max delay, normal: standard deviation 
+                             (only the positive half is used), exponential: mean delay.
+                             The callback is called later than it should by this amount; 
+                             the next periods are still scheduled on time.
+  audio_skew_ppm           - the audio clock runs this many parts per million faster 
+                             (> 0) or slower (< 0) than the nominal 44100hz.
+  audio_skip_probability   - probability (0-1) that a period of audio is lost; the 
+                             callback isn't called for it.
+  audio_double_probability - probability (0-1) that a period is delivered twice.
+  video_drop_probability   - probability (0-1) that `video_generator_update()` drops a 
+                             frame: the frame number skips one, like a capture device 
+                             that missed a frame.
+  video_repeat_probability - probability (0-1) that `video_generator_update()` repeats 
+                             the previous picture for the new frame number. The
+                             generator keeps a copy of every shown picture for this, 
+                             so it costs an extra frame copy per update.
+
+  The `fault_flags` member has the VIDEO_GENERATOR_FAULT_* flags of the last frame
+  and the counters below it keep track of all injected faults.
+
+  Slices
+  ------
+
+  Low latency encoders can start on the top of a frame before the bottom is 
+  rendered. When `slice_rows` is set, `video_generator_update()` renders the
+  frame from top to bottom in groups of `slice_rows` luma rows (and the 
+  `slice_rows / 2` chroma rows that belong to them) and calls the slice 
+  callback as soon as all planes of a group are ready. The callback is 
+  called from the thread that calls `video_generator_update()`. 
+
+  Every slice has the time since the start of the frame; the generator keeps
+  the time to the first slice in `slice_first_ns` with its max and total.
+  The output is exactly the same as without slices. Note that the timeline
+  is drawn completely before the first slice because it redraws parts of the
+  previous frame.
+
+  Renditions
+  ----------
+
+  For adaptive bitrate testing one generator can create the whole ladder in
+  one `video_generator_update()`. Pass the extra resolutions in `renditions`;
+  the settings `width` and `height` are the top rendition. After each update
+  `renditions[i]` of the generator is a `video_generator` with the same frame
+  number, time text and bip/bop state as the main frame, and its own planes:
+
+     video_generator* r = &gen.renditions[0];
+     encode(r->y, r->u, r->v, r->width, r->height);
+
+  A rendition is either drawn natively at its resolution (the pattern, 
+  timeline and time box) or, with 
+  VIDEO_GENERATOR_RENDITION_DOWNSCALE, is an area (box) downscale of the main 
+  frame, like a real ladder that is scaled from one source. Drawing natively
+  is the cheapest: the patterns are fast to draw and a native rendition only
+  costs its own pixels, while a downscale reads the whole main frame and
+  takes about twice as long as drawing it. Renditions don't have their own audio 
+  thread, faults or slices; a repeated frame is repeated in all renditions. 
+
+  Streaming stores
+  ----------------
+
+  A 4K frame is larger than the cache of most machines, so writing it pushes 
+  the working set of everything else on the machine (e.g. the encoder that 
+  runs next to the generator) out of the cache. With `streaming_stores` the 
+  patterns, the neutral chroma planes and the copy of a repeated frame are 
+  written with non-temporal (SSE2 streaming) stores that go straight to 
+  memory. The output is exactly the same. The bars pattern composes one row
+  of bars at init and streams it (or the color of the moving bar) into every
+  row, so each row is written once. Only the small time box and the text 
+  are drawn on top with regular stores.
+
+  Streaming is not free: the frame is not in the cache when the consumer 
+  reads it, and a generator that runs alone is sometimes faster with 
+  regular stores. It pays off when the frame is large, the consumer runs on 
+  another core and doesn't read the frame straight away (or reads it with 
+  DMA). Measure with `video_generator_bench` on the target machine. The
+  stores are fenced before a slice is handed over and at the end of 
+  `video_generator_update()`, so the frame is complete for other threads.
+
+  Frame cache
+  -----------
+
+  Except for the noise pattern the picture repeats: the moving bar after 5 
+  seconds, the zone plate after 32 frames, the gradient after 64, the 
+  checkerboard after 2 and a timeline after all its scenes; only the time box
+  changes. With `cache_path` the generator stores the frames of the first
+  cycle in a memory mapped file, and after that copies every frame from the
+  file and only draws the time box. At 4K this turns the generator into a 
+  memcpy that is bound by memory bandwidth.
+
+  The file is reused by the next run with the same settings (size, fps, 
+  pattern, seed and scenes), so the first cycle is only rendered once. While
+  it's being written the file is called `<cache_path>.<pid>.tmp` and it gets
+  its final name when the cycle is complete; an incomplete file is removed 
+  by `video_generator_clear()`. The file holds a whole cycle: 125 frames of 
+  1.4 MB at 720p25, 300 frames of 12 MB at 2160p60 (3.6 GB), so keep it on
+  a disk with enough space and enough memory to keep it in the page cache. 
+  Renditions are drawn as usual. The cache uses mmap() and is not available
+  on Windows. `frames_cached` counts the frames that came from the cache.
+
+  Timestamps
+  ----------
+
+  Every frame and every audio period carries a `video_generator_timestamp`, 
+  so a muxer doesn't have to build its own timebase. After 
+  `video_generator_update()` the `timestamp` member describes the frame (it's
+  also in each slice and each rendition); the audio callback gets the 
+  timestamp of its period. All values are integers, so they don't drift:
+
+     pts           - presentation time in units of timebase_num / timebase_den
+                     seconds. Video: the frame number with a 1/fps timebase;
+                     a dropped frame skips a pts. Audio: the index of the first 
+                     sample of the period with a 1/44100 timebase; a skipped 
+                     period leaves a gap and a doubled period is delivered 
+                     twice with the same pts.
+     sample        - index of the first audio sample of the period. For a 
+                     video frame the index of the audio sample that plays at
+                     the start of the frame (pts * 44100 / fps, rounded down),
+                     0 when the generator has no audio.
+     capture_ns    - when the frame or period was captured, on the clock of 
+                     `video_generator_now_ns()`. For video the start of the 
+                     update. For audio the time the period is due, without 
+                     the simulated jitter, so the callback time minus 
+                     capture_ns is the delivery delay. Audio and video use
+                     the same clock; with `audio_skew_ppm` the audio clock 
+                     drifts against it like a real device.
+
+  Dirty rectangles
+  ----------------
+
+  After `video_generator_update()` the `dirty_rects` member lists the areas
+  of the frame that changed since the previous frame, so a screen content
+  encoder or a transport that sends differences doesn't have to compare 
+  the frames itself. The rects are not found by comparing pixels but come 
+  from what the update drew: the rows of the moving bar where it was and 
+  where it is, the time box when the time or the bip/bop color changed, and
+  the objects of a timeline scene without pan or fade. Patterns that change
+  everywhere (noise, zone plate, checkerboard, gradient), the first frame, 
+  a new scene and a fading or panning scene give one rect with the whole 
+  frame. A repeated frame has no rects.
+
+  The rects are in luma pixels, aligned to 2 pixels so they cover whole 
+  chroma samples (divide by 2 for the chroma planes), and may include some
+  pixels that didn't change but never miss one. Rects that overlap are 
+  merged; when there are more than VIDEO_GENERATOR_MAX_DIRTY_RECTS they are
+  merged into one. Each rendition has its own rects and the frames of the 
+  pool (`video_generator_pool.h`) carry a copy. When you skip frames, 
+  combine the rects of all frames since the last one you used.
+
+  Audio sequence
+  --------------
+
+  By default the audio is a 4 second loop with a bip after 1 second and a bop
+  after 3 seconds. You can pass your own sequence in `audio_events`; the 
+  events are played back to back and the sequence loops after the last one.
+  An event describes:
+
+  type             - VIDEO_GENERATOR_AUDIO_SILENCE, VIDEO_GENERATOR_AUDIO_TONE or 
+                     VIDEO_GENERATOR_AUDIO_SWEEP (linear from `frequency` to `frequency_end`).
+  duration_ms      - length of the event in milliseconds.
+  frequency        - frequency of the tone or the start of the sweep, in hz (< 22050).
+  frequency_end    - frequency at the end of the sweep.
+  amplitude        - peak value of the samples, 0 = VIDEO_GENERATOR_AUDIO_AMPLITUDE.
+  channels         - bit mask of the channels that play the event (bit 0 is 
+                     left), 0 = all channels. The other channels are silent.
+  marker           - VIDEO_GENERATOR_AUDIO_MARKER_BIP or _BOP to turn the time 
+                     box blue or red while the event plays, like the bip and bop.
+                     A frame shows the color when the event plays at its start
+                     or started after the start of the previous frame, so the
+                     color never comes before the sound and a short event 
+                     still colors one frame. The time box doesn't 
+                     wait for the audio thread; `video_generator_markers()` 
+                     returns the markers of the current frame.
+
+  The samples are synthesized for every period (1024 samples) into a buffer 
+  of one period, so a sequence of an hour costs the memory of its events. A 
+  tone or sweep that follows another one continues its phase, one that 
+  follows silence starts at phase 0. Events start at the sample of their
+  offset in the sequence (`sum of duration_ms * 44100 / 1000`), so long 
+  sequences don't drift. Use the bip and bop frequencies for the markers if
+  you want to measure the A/V offset with `video_generator_monitor.h`.
 
   Specification
   ---------------
@@ -121,6 +384,36 @@
 #define VIDEO_GENERATOR_H
 
 #define RXS_MAX_CHARS 11
+
+#define VIDEO_GENERATOR_PATTERN_BARS 0
+#define VIDEO_GENERATOR_PATTERN_NOISE 1
+#define VIDEO_GENERATOR_PATTERN_ZONEPLATE 2
+#define VIDEO_GENERATOR_PATTERN_CHECKERBOARD 3
+#define VIDEO_GENERATOR_PATTERN_GRADIENT 4
+#define VIDEO_GENERATOR_MAX_OBJECTS 1024
+
+#define VIDEO_GENERATOR_JITTER_NONE 0
+#define VIDEO_GENERATOR_JITTER_UNIFORM 1
+#define VIDEO_GENERATOR_JITTER_NORMAL 2
+#define VIDEO_GENERATOR_JITTER_EXPONENTIAL 3
+
+#define VIDEO_GENERATOR_FAULT_DROPPED 0x01                    /* one frame was dropped before this one. */
+#define VIDEO_GENERATOR_FAULT_REPEATED 0x02                   /* this frame repeats the previous picture. */
+#define VIDEO_GENERATOR_SLICE_ALIGN 16                        /* slice_rows must be a multiple of this. */
+#define VIDEO_GENERATOR_MAX_DIRTY_RECTS 32                    /* max number of rects in `dirty_rects`. */
+
+#define VIDEO_GENERATOR_AUDIO_SILENCE 0
+#define VIDEO_GENERATOR_AUDIO_TONE 1
+#define VIDEO_GENERATOR_AUDIO_SWEEP 2
+#define VIDEO_GENERATOR_AUDIO_MARKER_NONE 0
+#define VIDEO_GENERATOR_AUDIO_MARKER_BIP 1
+#define VIDEO_GENERATOR_AUDIO_MARKER_BOP 2
+#define VIDEO_GENERATOR_AUDIO_AMPLITUDE 10000                 /* default peak value of a tone or sweep. */
+
+#define VIDEO_GENERATOR_RENDITION_NATIVE 0                    /* the rendition is drawn at its own resolution. */
+#define VIDEO_GENERATOR_RENDITION_DOWNSCALE 1                 /* the rendition is a box downscale of the main frame. */
+#define VIDEO_GENERATOR_MAX_RENDITIONS 8
+
 #include <stdint.h>
 
 #if defined(__cplusplus)
@@ -135,8 +428,10 @@ extern "C" {
 
   struct thread;                                                 /* Forward declared. */
   struct mutex;                                                  /* Forward declared. */
+  struct cond;                                                   /* Forward declared. */
   typedef struct thread thread;
   typedef struct mutex mutex;
+  typedef struct cond cond;
   typedef void*(*thread_function)(void* param);                  /* The thread function you need to write. */
 
   thread* thread_alloc(thread_function func, void* param);       /* Create a new thread handle. Don't forget to call thread_free(). */ 
@@ -146,6 +441,10 @@ extern "C" {
   int mutex_destroy(mutex* m);                                   /* Destroy the mutex. */
   int mutex_lock(mutex* m);                                      /* Lock the mutex. */
   int mutex_unlock(mutex* m);                                    /* Unlock the mutex. */
+  int cond_init(cond* c);                                        /* Initialize a condition variable. */
+  int cond_destroy(cond* c);                                     /* Destroy the condition variable. */
+  int cond_wait(cond* c, mutex* m);                              /* Unlock `m`, wait until signalled and lock `m` again. Can wake up spuriously. */
+  int cond_signal(cond* c);                                      /* Wake up one waiting thread. */
 
   /* ------------------------------------------------------------------------- */
 
@@ -164,6 +463,10 @@ extern "C" {
     struct mutex {
       HANDLE handle;
     };
+
+    struct cond {
+      HANDLE handle;                                             /* auto reset event. */
+    };
     
     DWORD WINAPI thread_wrapper_function(LPVOID param);
 
@@ -182,6 +485,10 @@ extern "C" {
     struct mutex {
       pthread_mutex_t handle;
     };
+
+    struct cond {
+      pthread_cond_t handle;
+    };
     
     void* thread_function_wrapper(void* t);
 
@@ -194,6 +501,15 @@ extern "C" {
 typedef struct video_generator video_generator;
 typedef struct video_generator_settings video_generator_settings;
 typedef struct video_generator_char video_generator_char;
+typedef struct video_generator_scene video_generator_scene;
+typedef struct video_generator_faults video_generator_faults;
+typedef struct video_generator_slice video_generator_slice;
+typedef struct video_generator_rendition video_generator_rendition;
+typedef struct video_generator_scaler video_generator_scaler;  /* Opaque, see video_generator.c */
+typedef struct video_generator_cache video_generator_cache;    /* Opaque, see video_generator.c */
+typedef struct video_generator_timestamp video_generator_timestamp;
+typedef struct video_generator_audio_event video_generator_audio_event;
+typedef struct video_generator_rect video_generator_rect;
 
 /* 
    When we generate audio we do this from a separate thread to make sure we
@@ -207,8 +523,18 @@ typedef struct video_generator_char video_generator_char;
    @param samples        The samples that you need to process. 
    @param nbytes         The number of bytes in `samples`
    @param nframes        The number of frames in `samples`.   
+   @param ts             Timestamp of the first frame in `samples`, see "Timestamps" above.
+*/
+typedef void(*video_generator_audio_callback)(const int16_t* samples, uint32_t nbytes, uint32_t nframes, const video_generator_timestamp* ts); 
+
+/*
+   In slice mode this is called from `video_generator_update()` each time a
+   group of rows is ready; see "Slices" above.
+
+   @param slice          Describes the rows that are ready.
+   @param user           The `slice_user` of the settings.
 */
-typedef void(*video_generator_audio_callback)(const int16_t* samples, uint32_t nbytes, uint32_t nframes); 
+typedef void(*video_generator_slice_callback)(video_generator_slice* slice, void* user);
 
 struct video_generator_char {
   int id;
@@ -221,6 +547,72 @@ struct video_generator_char {
   int xadvance;
 };
 
+struct video_generator_scene {
+  uint32_t num_frames;
+  uint32_t num_objects;
+  uint32_t object_size;
+  uint32_t object_speed;
+  int32_t pan_x;
+  int32_t pan_y;
+  uint32_t fade_in;
+  uint32_t fade_out;
+  uint32_t seed;
+};
+
+struct video_generator_faults {
+  uint32_t seed;
+  uint32_t audio_jitter;
+  uint32_t audio_jitter_us;
+  int32_t audio_skew_ppm;
+  double audio_skip_probability;
+  double audio_double_probability;
+  double video_drop_probability;
+  double video_repeat_probability;
+};
+
+struct video_generator_audio_event {
+  uint32_t type;
+  uint32_t duration_ms;
+  double frequency;
+  double frequency_end;
+  uint16_t amplitude;
+  uint32_t channels;
+  uint32_t marker;
+};
+
+struct video_generator_rect {
+  uint32_t x;                                             /* left column, even. */
+  uint32_t y;                                             /* top row, even. */
+  uint32_t width;                                         /* width, even. */
+  uint32_t height;                                        /* height, even. */
+};
+
+struct video_generator_timestamp {
+  int64_t pts;                                            /* presentation time in units of the timebase. */
+  uint32_t timebase_num;                                  /* timebase numerator, 1. */
+  uint32_t timebase_den;                                  /* timebase denominator, the fps for video and the samplerate for audio. */
+  uint64_t sample;                                        /* index of the first audio sample of the period or frame. */
+  uint64_t capture_ns;                                    /* capture time, on the clock of video_generator_now_ns(). */
+};
+
+struct video_generator_slice {
+  uint64_t frame;                                         /* frame number. */
+  uint32_t index;                                         /* index of the slice in the frame, 0 is the top. */
+  uint32_t nslices;                                       /* number of slices in a frame. */
+  uint32_t y;                                             /* first luma row of the slice. */
+  uint32_t nrows;                                         /* number of luma rows; the last slice can be smaller. */
+  uint8_t* planes[3];                                     /* first row of the slice in the y, u and v planes. */
+  uint32_t strides[3];                                    /* strides of the planes. */
+  uint64_t elapsed_ns;                                    /* time between the start of the frame and the moment this slice was ready. */
+  video_generator_timestamp timestamp;                    /* timestamp of the frame. */
+};
+
+struct video_generator_rendition {
+  uint32_t width;                                         /* width of the rendition, even. */
+  uint32_t height;                                        /* height of the rendition, even. */
+  uint32_t mode;                                          /* VIDEO_GENERATOR_RENDITION_NATIVE or VIDEO_GENERATOR_RENDITION_DOWNSCALE. */
+};
+
 struct video_generator_settings {
   uint32_t width;
   uint32_t height;
@@ -228,6 +620,21 @@ struct video_generator_settings {
   uint16_t bip_frequency;
   uint16_t bop_frequency;
   video_generator_audio_callback audio_callback;
+  uint32_t pattern;
+  uint8_t noise_amplitude;
+  uint32_t seed;
+  video_generator_scene* scenes;
+  uint32_t num_scenes;
+  video_generator_faults* faults;
+  uint32_t slice_rows;
+  video_generator_slice_callback slice_callback;
+  void* slice_user;
+  video_generator_rendition* renditions;
+  uint32_t num_renditions;
+  uint8_t streaming_stores;
+  const char* cache_path;
+  video_generator_audio_event* audio_events;
+  uint32_t num_audio_events;
 };
 
 struct video_generator {
@@ -243,6 +650,7 @@ struct video_generator {
   uint32_t ubytes;                                        /* number of bytes in the u-plane. */
   uint32_t vbytes;                                        /* number of bytes in the v-plane. */
   uint32_t nbytes;                                        /* total number of bytes in the allocated buffer for the yuv420p buffer. */
+  uint8_t* buffer;                                        /* the yuv420p buffer that we allocated, see `video_generator_set_buffer()`. */
   uint8_t* planes[3];                                     /* pointers to the planes (similar to the y, u and v members). */ 
   uint32_t strides[3];                                    /* strides for the separate planes. */
   int fps_num;                                            /* framerate numerator e.g. 1. */
@@ -250,33 +658,93 @@ struct video_generator {
   double fps;                                             /* framerate in microseconds, 1 fps == 1.000.000 us. */
   double step;                                            /* used to create/translate the moving bar. */
   double perc;                                            /* position of the moving bar in percentages. */
-  video_generator_char chars[RXS_MAX_CHARS];              /* bitmap characters, `0-9` and `:` */
-  int font_w;                                             /* width of the bitmap (which is stored in video_generator.c). */
-  int font_h;                                             /* height of the bitmap (which is stored in video_generator.c). */
+  video_generator_char chars[RXS_MAX_CHARS];              /* bitmap characters, `0-9` and `:`, scaled for our resolution. */
+  const uint8_t* font_pixels;                             /* the 8 bit bitmap with the characters, font_w x font_h. */
+  int font_w;                                             /* width of the bitmap. */
+  int font_h;                                             /* height of the bitmap. */
   int font_line_height;
+  uint8_t* font_atlas;                                    /* the scaled bitmap that font_pixels points to, NULL when we use the original. */
+  int text_w;                                             /* width of the time box. */
+  int text_h;                                             /* height of the time box. */
+  int text_margin;                                        /* distance between the edge of the time box and the text. */
+  int text_extent_w;                                      /* right edge of the widest clock, from the left of the time box. */
+  int text_extent_h;                                      /* bottom edge of the clock, from the top of the time box. */
+  uint32_t pattern;                                       /* one of the VIDEO_GENERATOR_PATTERN_* values. */
+  uint32_t noise_amplitude;                               /* amplitude of the noise pattern, 0-255. */
+  uint32_t seed;                                          /* seed for the noise pattern. */
+  uint16_t* pattern_phase;                                /* zone plate: per column phase, (x - cx)^2 * k, wraps at 16 bits. */
+  uint8_t* pattern_ramp;                                  /* gradient: per column ramp value. */
+  uint8_t* bars_row;                                      /* bars: one composed luma row followed by one u and one v row. */
+  uint8_t* stream_row;                                    /* with streaming stores: scratch row for the pattern rows that don't start on 16 bytes. */
+  video_generator_scene* scenes;                          /* copy of the scenes of the timeline. */
+  uint32_t num_scenes;                                    /* number of scenes, 0 when the timeline isn't used. */
+  uint64_t timeline_nframes;                              /* total number of frames of all scenes. */
+  uint32_t scene;                                         /* index of the scene of the last generated frame. */
+  int* timeline_rects;                                    /* x, y, w, h of the objects in the last frame. */
+  uint32_t timeline_nrects;                               /* number of rects in `timeline_rects`. */
+  uint8_t timeline_valid;                                 /* 1 when the buffer contains the previous frame, without fade, so we can only redraw the objects. */
+  uint64_t timeline_prev_frame;                           /* frame number of the previous timeline frame. */
+  video_generator_faults faults;                          /* copy of the faults, all zero when not used. */
+  uint8_t* fault_prev;                                    /* copy of the previous picture, used to repeat it; NULL when frames are never repeated. */
+  uint8_t fault_prev_valid;                               /* 1 when `fault_prev` holds a picture. */
+  uint32_t fault_flags;                                   /* VIDEO_GENERATOR_FAULT_* flags of the last frame. */
+  uint64_t frames_dropped;                                /* number of dropped video frames. */
+  uint64_t frames_repeated;                               /* number of repeated video frames. */
+  uint32_t slice_rows;                                    /* number of luma rows per slice, 0 when slices aren't used. */
+  video_generator_slice_callback slice_callback;          /* called for every slice that is ready. */
+  void* slice_user;                                       /* passed into the slice callback. */
+  uint32_t clip_y0;                                       /* first row that is drawn, the first row of the current slice. */
+  uint32_t clip_y1;                                       /* end of the rows that are drawn. */
+  uint64_t slice_first_ns;                                /* time from the start of the last frame until its first slice. */
+  uint64_t slice_first_max_ns;                            /* largest `slice_first_ns` so far. */
+  uint64_t slice_first_total_ns;                          /* sum of all `slice_first_ns`, divide by `slice_nframes` for the average. */
+  uint64_t slice_nframes;                                 /* number of frames that were handed over in slices. */
+  video_generator* renditions;                            /* the extra renditions, each has its own y, u, v planes. */
+  uint32_t num_renditions;                                /* number of elements in `renditions`. */
+  uint32_t rendition_mode;                                /* for a rendition: how it's created. */
+  video_generator_scaler* scaler;                         /* for a downscaled rendition: the filter tables. */
+  video_generator* audio_source;                          /* generator with the audio state we use for the time box, ourself or the parent of a rendition. */
+  uint8_t streaming_stores;                               /* 1 when the planes are written with non-temporal stores. */
+  video_generator_cache* cache;                           /* the frame cache, NULL when not used. */
+  uint64_t frames_cached;                                 /* number of frames that were copied from the cache. */
+  video_generator_timestamp timestamp;                    /* timestamp of the last generated frame. */
+  video_generator_rect dirty_rects[VIDEO_GENERATOR_MAX_DIRTY_RECTS]; /* areas that changed since the previous frame, see "Dirty rectangles". */
+  uint32_t num_dirty_rects;                               /* number of elements in `dirty_rects`. */
+  uint8_t dirty_valid;                                    /* 1 when we know what the previous frame looked like. */
+  int32_t dirty_bar_y0;                                   /* first row of the moving bar in the previous frame. */
+  int32_t dirty_bar_y1;                                   /* end row of the moving bar in the previous frame. */
+  uint32_t dirty_box_color;                               /* rgb color of the time box in the previous frame. */
+  uint64_t dirty_box_seconds;                             /* time in the time box of the previous frame. */
 
   /* Audio */
   uint16_t audio_nchannels;                               /* number of audio channels, for now always 2. */
-  uint8_t audio_nseconds;                                 /* the number of seconds of audio we have in the audio_buffer. Always 4. */
   uint16_t audio_samplerate;                              /* for now always: 44100 */
   uint16_t audio_bip_frequency;                           /* frequency for the bip sound, 600hz. */
   uint16_t audio_bop_frequency;                           /* frequency for the bop sound, 300hz. */
-  uint32_t audio_bip_millis;                              /* number of millis for the bip sound */ 
-  uint32_t audio_bop_millis;                              /* number of millis for the bop sound */ 
   uint32_t audio_nbytes;                                  /* number of bytes in audio_buffer. */
   uint64_t audio_nsamples;                                /* number of samples that are passed to the audio callback whenever needed. */
-  int16_t* audio_buffer;                                  /* this will contain the audio samples */
+  int16_t* audio_buffer;                                  /* the samples of one period, synthesized by the audio thread. */
+  video_generator_audio_event* audio_events;              /* copy of the audio sequence, or the default bip/bop sequence. */
+  uint64_t* audio_event_ends;                             /* sample offset of the end of each event in the sequence. */
+  uint32_t audio_num_events;                              /* number of elements in `audio_events`. */
+  uint32_t audio_event;                                   /* index of the event that is playing. */
+  uint64_t audio_position;                                /* offset of the next sample in the sequence. */
+  double audio_phase;                                     /* phase of the oscillator in cycles, 0-1. */
   video_generator_audio_callback audio_callback;          /* will be called from the thread when the user needs to process audio. */
   thread* audio_thread;                                   /* the audio callback is called from another thread to simulate microphone input.*/
   mutex audio_mutex;                                      /* used to sync. shared data */
   uint8_t audio_thread_must_stop;                         /* is set to 1 when the thread needs to stop */
-  uint8_t audio_is_bip;                                   /* is set to 1 as soon as the bip audio part it passed into the callback. */
-  uint8_t audio_is_bop;                                   /* is set to 1 as soon as the bop audio part is passed into the callback. */ 
+  uint64_t audio_periods_skipped;                         /* number of audio periods that were not delivered (faults), protected by audio_mutex. */
+  uint64_t audio_periods_doubled;                         /* number of audio periods that were delivered twice (faults), protected by audio_mutex. */
 };
 
 int video_generator_init(video_generator_settings* cfg, video_generator* g);
 int video_generator_update(video_generator* g);
 int video_generator_clear(video_generator* g);
+int video_generator_set_buffer(video_generator* g, uint8_t* buffer);
+uint64_t video_generator_now_ns();
+uint32_t video_generator_markers(video_generator* g);
+int video_generator_pattern_from_string(const char* name, uint32_t* pattern);
 
 #if defined(__cplusplus)
 } /* extern "C" */
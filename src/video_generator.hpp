@@ -0,0 +1,777 @@
+/*
+
+  Video Generator - C++ API
+  ==========================
+
+  Header only C++17 wrapper around the C library.
+
+  vg::Generator     - owns a `video_generator` and its audio thread. The
+                      destructor stops the audio thread and frees all memory.
+                      Move only; the C struct lives on the heap because the
+                      audio thread keeps a pointer to it.
+  vg::Frame         - move only frame with its own, aligned, buffer in one of
+                      the vg::PixelFormat layouts with 8 or 10 bit samples.
+  vg::span          - std::span when available (C++20), otherwise a minimal
+                      replacement with the same interface.
+
+  `Generator::update()` runs the C code path and gives access to the yuv420p
+  planes of the generator. `Generator::render(frame)` renders the next frame
+  directly into a `vg::Frame` using a renderer that is specialized at compile
+  time on the pixel format, the bit depth and the SIMD level; the SIMD level
+  is detected once and used to select the instantiation, so the per pixel
+  loops don't contain any branches. The default bars pattern is rendered
+  natively in the target format. The other patterns, the timeline and the
+  generators that use video faults, renditions, the frame cache or slices 
+  are rendered by the C code and then converted by a specialized kernel.
+
+  Note that the native bars path doesn't track what changed: it sets 
+  `dirty_rects` to the whole frame.
+
+  <example>
+
+     video_generator_settings cfg;
+     memset(&cfg, 0x00, sizeof(cfg));
+     cfg.width = 1920;
+     cfg.height = 1080;
+     cfg.fps = 60;
+
+     vg::Generator gen(cfg);
+     vg::Frame frame = gen.make_frame(vg::PixelFormat::NV12, 10);
+
+     while (running) {
+       gen.render(frame);
+       encode(frame.plane<uint16_t>(0), frame.plane<uint16_t>(1));
+     }
+
+  </example>
+ */
+
+#ifndef VIDEO_GENERATOR_HPP
+#define VIDEO_GENERATOR_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include <video_generator.h>
+
+#if defined(__has_include)
+#  if __has_include(<span>) && __cplusplus > 201703L
+#    include <span>
+#  endif
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#  define VG_HAVE_X86
+#  include <emmintrin.h>
+#  if defined(__GNUC__)
+#    include <immintrin.h>
+#    define VG_HAVE_AVX2
+#    define VG_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#endif
+
+namespace vg {
+
+  /* ----------------------------------------------------------------------------------- */
+  /*                          S P A N                                                    */
+  /* ----------------------------------------------------------------------------------- */
+
+#if defined(__cpp_lib_span)
+
+  template<class T> using span = std::span<T>;
+
+#else
+
+  template<class T>
+  class span {
+  public:
+    using element_type = T;
+    using value_type = typename std::remove_cv<T>::type;
+    using size_type = std::size_t;
+    using pointer = T*;
+    using iterator = T*;
+
+    constexpr span() noexcept : ptr(nullptr), count(0) { }
+    constexpr span(T* p, size_type n) noexcept : ptr(p), count(n) { }
+    template<class U, class = typename std::enable_if<std::is_convertible<U(*)[], T(*)[]>::value>::type>
+    constexpr span(const span<U>& other) noexcept : ptr(other.data()), count(other.size()) { }
+
+    constexpr T* data() const noexcept { return ptr; }
+    constexpr size_type size() const noexcept { return count; }
+    constexpr size_type size_bytes() const noexcept { return count * sizeof(T); }
+    constexpr bool empty() const noexcept { return 0 == count; }
+    constexpr T& operator[](size_type i) const { return ptr[i]; }
+    constexpr T* begin() const noexcept { return ptr; }
+    constexpr T* end() const noexcept { return ptr + count; }
+    constexpr span<T> subspan(size_type offset, size_type n) const { return span<T>(ptr + offset, n); }
+
+  private:
+    T* ptr;
+    size_type count;
+  };
+
+#endif
+
+  /* ----------------------------------------------------------------------------------- */
+  /*                          F O R M A T S                                              */
+  /* ----------------------------------------------------------------------------------- */
+
+  enum class PixelFormat {
+    I420,                                                 /* 3 planes: Y, U, V. 10 bit samples are LSB aligned (yuv420p10le). */
+    NV12                                                  /* 2 planes: Y, interleaved UV. 10 bit samples are MSB aligned (P010). */
+  };
+
+  enum class Simd {
+    Scalar,
+    SSE2,
+    AVX2
+  };
+
+  /* Compile time description of a format + bit depth. */
+  template<PixelFormat F, int Depth>
+  struct FormatTraits {
+    static_assert(8 == Depth || 10 == Depth, "Only 8 and 10 bit are supported.");
+    using sample = typename std::conditional<8 == Depth, uint8_t, uint16_t>::type;
+    static constexpr int nplanes = (PixelFormat::I420 == F) ? 3 : 2;
+    static constexpr int shift = (8 == Depth) ? 0 : (PixelFormat::I420 == F) ? 2 : 8;     /* from 8 bit to the stored value. */
+    static constexpr sample scale(uint8_t v) { return (sample)((sample)v << shift); }
+  };
+
+  /* ----------------------------------------------------------------------------------- */
+  /*                          F R A M E                                                  */
+  /* ----------------------------------------------------------------------------------- */
+
+  class Frame {
+  public:
+    Frame() = default;
+
+    Frame(uint32_t w, uint32_t h, PixelFormat fmt, int bitdepth)
+      :width(w)
+      ,height(h)
+      ,format(fmt)
+      ,depth(bitdepth)
+    {
+      if (0 == w || 0 == h || (w & 1) || (h & 1)) {
+        throw std::invalid_argument("vg::Frame: width and height must be even and > 0.");
+      }
+      if (8 != bitdepth && 10 != bitdepth) {
+        throw std::invalid_argument("vg::Frame: only 8 and 10 bit are supported.");
+      }
+
+      size_t bps = (8 == depth) ? 1 : 2;
+      size_t ysize = bps * w * h;
+      size_t csize = bps * (w / 2) * (h / 2);
+      nbytes = ysize + 2 * csize;
+
+      void* mem = nullptr;
+#if defined(_WIN32)
+      mem = _aligned_malloc(nbytes, 64);
+#else
+      if (0 != posix_memalign(&mem, 64, nbytes)) {
+        mem = nullptr;
+      }
+#endif
+      if (nullptr == mem) {
+        throw std::bad_alloc();
+      }
+
+      buffer.reset((uint8_t*)mem);
+      offsets[0] = 0;
+      strides[0] = w;
+      if (PixelFormat::I420 == format) {
+        nplanes = 3;
+        offsets[1] = ysize;
+        offsets[2] = ysize + csize;
+        strides[1] = w / 2;
+        strides[2] = w / 2;
+      }
+      else {
+        nplanes = 2;
+        offsets[1] = ysize;
+        strides[1] = w;
+      }
+    }
+
+    Frame(const Frame&) = delete;
+    Frame& operator=(const Frame&) = delete;
+    Frame(Frame&&) noexcept = default;
+    Frame& operator=(Frame&&) noexcept = default;
+
+    /* Samples of plane `i`; T must be uint8_t for 8 bit and uint16_t for 10 bit. */
+    template<class T>
+    span<T> plane(int i) const {
+      if (sizeof(T) != ((8 == depth) ? 1u : 2u) || i < 0 || i >= nplanes) {
+        throw std::out_of_range("vg::Frame::plane: invalid plane or sample type.");
+      }
+      return span<T>((T*)(buffer.get() + offsets[i]), (size_t)strides[i] * plane_height(i));
+    }
+
+    uint32_t plane_height(int i) const { return (0 == i) ? height : height / 2; }
+    span<uint8_t> bytes() const { return span<uint8_t>(buffer.get(), nbytes); }
+
+  public:
+    uint32_t width = 0;
+    uint32_t height = 0;
+    PixelFormat format = PixelFormat::I420;
+    int depth = 8;
+    int nplanes = 0;
+    uint32_t strides[3] = { 0, 0, 0 };                    /* in samples; for the NV12 UV plane this is 2 * (width / 2). */
+    uint64_t frame = 0;                                   /* frame number of the generator that was rendered into this frame. */
+    video_generator_timestamp timestamp = {};             /* timestamp of the frame, see "Timestamps" in video_generator.h. */
+
+  private:
+    struct free_deleter {
+      void operator()(uint8_t* p) const {
+#if defined(_WIN32)
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+      }
+    };
+
+    std::unique_ptr<uint8_t, free_deleter> buffer;
+    size_t offsets[3] = { 0, 0, 0 };
+    size_t nbytes = 0;
+  };
+
+  /* ----------------------------------------------------------------------------------- */
+  /*                          K E R N E L S                                              */
+  /* ----------------------------------------------------------------------------------- */
+
+  namespace detail {
+
+    /* Fills `n` elements with `value`; E is a sample or, for NV12 chroma, a UV pair. */
+    template<class E, Simd S>
+    struct Fill {
+      static inline void row(E* dst, E value, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+          dst[i] = value;
+        }
+      }
+    };
+
+#if defined(VG_HAVE_X86)
+
+    template<class E>
+    inline __m128i broadcast128(E value) {
+      if constexpr (1 == sizeof(E)) { return _mm_set1_epi8((char)value); }
+      else if constexpr (2 == sizeof(E)) { return _mm_set1_epi16((short)value); }
+      else { return _mm_set1_epi32((int)value); }
+    }
+
+    template<class E>
+    struct Fill<E, Simd::SSE2> {
+      static inline void row(E* dst, E value, size_t n) {
+        constexpr size_t lanes = 16 / sizeof(E);
+        __m128i v = broadcast128(value);
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes) {
+          _mm_storeu_si128((__m128i*)(dst + i), v);
+        }
+        for (; i < n; ++i) {
+          dst[i] = value;
+        }
+      }
+    };
+
+#endif
+
+#if defined(VG_HAVE_AVX2)
+
+    template<class E>
+    VG_TARGET_AVX2 inline void fill_row_avx2(E* dst, E value, size_t n) {
+      constexpr size_t lanes = 32 / sizeof(E);
+      __m256i v;
+      if constexpr (1 == sizeof(E)) { v = _mm256_set1_epi8((char)value); }
+      else if constexpr (2 == sizeof(E)) { v = _mm256_set1_epi16((short)value); }
+      else { v = _mm256_set1_epi32((int)value); }
+      size_t i = 0;
+      for (; i + lanes <= n; i += lanes) {
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+      }
+      for (; i < n; ++i) {
+        dst[i] = value;
+      }
+    }
+
+    template<class E>
+    struct Fill<E, Simd::AVX2> {
+      static inline void row(E* dst, E value, size_t n) {
+        fill_row_avx2<E>(dst, value, n);
+      }
+    };
+
+#endif
+
+    /* Widens/shifts a row of 8 bit samples into the target sample type. */
+    template<class T, int Shift, Simd S>
+    struct Copy {
+      static inline void row(T* dst, const uint8_t* src, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+          dst[i] = (T)((T)src[i] << Shift);
+        }
+      }
+    };
+
+#if defined(VG_HAVE_X86)
+
+    template<int Shift, Simd S>
+    struct Copy<uint16_t, Shift, S> {
+      static inline void row(uint16_t* dst, const uint8_t* src, size_t n) {
+        size_t i = 0;
+        if constexpr (Simd::Scalar != S) {
+          __m128i zero = _mm_setzero_si128();
+          for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            _mm_storeu_si128((__m128i*)(dst + i + 0), _mm_slli_epi16(_mm_unpacklo_epi8(v, zero), Shift));
+            _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_slli_epi16(_mm_unpackhi_epi8(v, zero), Shift));
+          }
+        }
+        for (; i < n; ++i) {
+          dst[i] = (uint16_t)(src[i] << Shift);
+        }
+      }
+    };
+
+#endif
+
+    /* Interleaves a row of u and v into NV12 chroma. */
+    template<class T, int Shift, Simd S>
+    struct Interleave {
+      static inline void row(T* dst, const uint8_t* u, const uint8_t* v, size_t n) {
+        size_t i = 0;
+#if defined(VG_HAVE_X86)
+        if constexpr (Simd::Scalar != S && 1 == sizeof(T)) {
+          for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(u + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(v + i));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + 0), _mm_unpacklo_epi8(a, b));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_unpackhi_epi8(a, b));
+          }
+        }
+        else if constexpr (Simd::Scalar != S && 8 == Shift) {
+          /* P010: the 8 bit value ends up in the high byte. */
+          __m128i zero = _mm_setzero_si128();
+          for (; i + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(u + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(v + i));
+            __m128i lo = _mm_unpacklo_epi8(a, b);
+            __m128i hi = _mm_unpackhi_epi8(a, b);
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + 0), _mm_unpacklo_epi8(zero, lo));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + 8), _mm_unpackhi_epi8(zero, lo));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_unpacklo_epi8(zero, hi));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i + 24), _mm_unpackhi_epi8(zero, hi));
+          }
+        }
+#endif
+        for (; i < n; ++i) {
+          dst[2 * i + 0] = (T)((T)u[i] << Shift);
+          dst[2 * i + 1] = (T)((T)v[i] << Shift);
+        }
+      }
+    };
+
+    struct Yuv {
+      uint8_t y, u, v;
+    };
+
+    inline int clip(int x) { return (x > 255) ? 255 : (x < 0) ? 0 : x; }
+
+    inline Yuv rgb_to_yuv(int r, int g, int b) {
+      Yuv c;
+      c.y = (uint8_t)clip(((  66 * r + 129 * g +  25 * b + 128) >> 8) +  16);
+      c.u = (uint8_t)clip((( -38 * r -  74 * g + 112 * b + 128) >> 8) + 128);
+      c.v = (uint8_t)clip((( 112 * r -  94 * g -  18 * b + 128) >> 8) + 128);
+      return c;
+    }
+
+    /* Everything that `video_generator_update()` computes for the bars pattern. */
+    struct BarsLayout {
+      int bar_w;
+      Yuv bars[8];                                        /* the 7 bars, and black for the remaining columns. */
+      int moving_y;                                       /* first line of the moving bar. */
+      int moving_n;                                       /* number of lines of the moving bar. */
+      Yuv moving;
+      int box_x, box_y, box_w, box_h;
+      Yuv box;
+      char text[32];
+    };
+
+    inline int layout_bars(video_generator* g, BarsLayout& l) {
+
+      static const int colors[] = {
+        255, 255, 255,
+        255, 255, 0,
+        0,   255, 255,
+        0,   255, 0,
+        255, 0,   255,
+        255, 0,   0,
+        0,   0,   255
+      };
+
+      int h = g->height - 1;
+      int bar_h = g->height / 5;
+      int start_y;
+      uint32_t markers;
+      int text_r = 0, text_g = 0, text_b = 0;
+      double perc;
+      uint64_t seconds, minutes, hours, days;
+
+      perc = (g->frame % (5 * g->fps_den)) * g->step;
+      start_y = (int)(-bar_h + perc * (h + bar_h));
+      if (start_y < 0) {
+        l.moving_n = bar_h + start_y;
+        start_y = 0;
+      }
+      else if (start_y + bar_h > h) {
+        l.moving_n = h - start_y;
+      }
+      else {
+        l.moving_n = bar_h;
+      }
+      l.moving_y = start_y;
+
+      perc = ((g->frame + 1) % (5 * g->fps_den)) * g->step;
+      l.moving = rgb_to_yuv((int)(255 - perc * 255), (int)(30 + perc * 235), (int)(150 + perc * 205));
+
+      l.bar_w = g->width / 7;
+      for (int i = 0; i < 7; ++i) {
+        l.bars[i] = rgb_to_yuv(colors[i * 3 + 0], colors[i * 3 + 1], colors[i * 3 + 2]);
+      }
+      l.bars[7].y = 0;
+      l.bars[7].u = 0;
+      l.bars[7].v = 0;
+
+      /* the same markers as the C code path. */
+      markers = video_generator_markers(g);
+      if (0 != (markers & (1u << VIDEO_GENERATOR_AUDIO_MARKER_BIP))) { text_b = 255; }
+      if (0 != (markers & (1u << VIDEO_GENERATOR_AUDIO_MARKER_BOP))) { text_r = 255; text_b = 0; }
+
+      l.box = rgb_to_yuv(text_r, text_g, text_b);
+      l.box_w = g->text_w;
+      l.box_h = g->text_h;
+      l.box_x = ((int)g->width / 2) - (l.box_w / 2);
+      l.box_y = ((int)g->height / 2) - (l.box_h / 2);
+
+      seconds = g->frame / g->fps_den;
+      minutes = seconds / 60;
+      hours = minutes / 60;
+      days = hours / 24;
+      snprintf(l.text, sizeof(l.text), "%03llu:%02llu:%02llu:%02llu",
+               (unsigned long long)days, (unsigned long long)(hours % 24),
+               (unsigned long long)(minutes % 60), (unsigned long long)(seconds % 60));
+
+      return 0;
+    }
+
+    template<PixelFormat F, int Depth, Simd S>
+    struct Renderer {
+
+      using traits = FormatTraits<F, Depth>;
+      using T = typename traits::sample;
+      using Pair = typename std::conditional<1 == sizeof(T), uint16_t, uint32_t>::type;
+
+      /* Fills [x0, x1) of chroma row `j` with the given color. */
+      static inline void chroma_span(Frame& f, uint32_t j, int x0, int x1, const Yuv& c) {
+        if (x1 <= x0) {
+          return;
+        }
+        if constexpr (PixelFormat::I420 == F) {
+          Fill<T, S>::row(f.plane<T>(1).data() + j * f.strides[1] + x0, traits::scale(c.u), x1 - x0);
+          Fill<T, S>::row(f.plane<T>(2).data() + j * f.strides[2] + x0, traits::scale(c.v), x1 - x0);
+        }
+        else {
+          Pair p = (Pair)((Pair)traits::scale(c.u) | ((Pair)traits::scale(c.v) << (8 * sizeof(T))));
+          Fill<Pair, S>::row((Pair*)(f.plane<T>(1).data() + j * f.strides[1]) + x0, p, x1 - x0);
+        }
+      }
+
+      static inline void luma_span(Frame& f, uint32_t j, int x0, int x1, uint8_t y) {
+        if (x1 > x0) {
+          Fill<T, S>::row(f.plane<T>(0).data() + j * f.strides[0] + x0, traits::scale(y), x1 - x0);
+        }
+      }
+
+      static void bars(video_generator* g, Frame& f) {
+
+        BarsLayout l;
+        layout_bars(g, l);
+
+        int w = (int)f.width;
+        int cw = w / 2;
+        int box_x0 = (l.box_x < 0) ? 0 : l.box_x;
+        int box_x1 = (l.box_x + l.box_w > w) ? w : l.box_x + l.box_w;
+
+        /* luma */
+        for (uint32_t j = 0; j < f.height; ++j) {
+          int jj = (int)j;
+          if (jj >= l.moving_y && jj < l.moving_y + l.moving_n) {
+            luma_span(f, j, 0, w, l.moving.y);
+          }
+          else {
+            for (int i = 0; i < 7; ++i) {
+              luma_span(f, j, i * l.bar_w, (i + 1) * l.bar_w, l.bars[i].y);
+            }
+            luma_span(f, j, 7 * l.bar_w, w, 0);
+          }
+          if (jj >= l.box_y && jj < l.box_y + l.box_h) {
+            luma_span(f, j, box_x0, box_x1, l.box.y);
+          }
+        }
+
+        /* chroma, same rules as `fill()` in video_generator.c */
+        int cmov0 = l.moving_y / 2;
+        int cmov1 = cmov0 + l.moving_n / 2;
+        int cbox0 = l.box_y / 2;
+        int cbox1 = cbox0 + l.box_h / 2;
+        for (uint32_t j = 0; j < f.height / 2; ++j) {
+          int jj = (int)j;
+          if (jj >= cmov0 && jj < cmov1) {
+            chroma_span(f, j, 0, cw, l.moving);
+          }
+          else {
+            /* with an odd bar width there is a black column between the bars. */
+            for (int i = 0; i < 7; ++i) {
+              int x0 = (i * l.bar_w) / 2;
+              int x1 = x0 + l.bar_w / 2;
+              chroma_span(f, j, x0, x1, l.bars[i]);
+              chroma_span(f, j, x1, ((i + 1) * l.bar_w) / 2, l.bars[7]);
+            }
+            chroma_span(f, j, (7 * l.bar_w) / 2, cw, l.bars[7]);
+          }
+          if (jj >= cbox0 && jj < cbox1) {
+            chroma_span(f, j, box_x0 / 2, box_x1 / 2, l.box);
+          }
+        }
+
+        text(g, f, l.text, l.box_x + g->text_margin, l.box_y + g->text_margin);
+      }
+
+      /* Copies the glyphs into the luma plane, clipped to the frame. */
+      static void text(video_generator* g, Frame& f, const char* str, int x, int y) {
+
+        T* dst = f.plane<T>(0).data();
+
+        for (const char* c = str; '\0' != *c; ++c) {
+
+          video_generator_char* kar = nullptr;
+          for (int k = 0; k < RXS_MAX_CHARS; ++k) {
+            if (g->chars[k].id == *c) {
+              kar = &g->chars[k];
+              break;
+            }
+          }
+
+          if (nullptr == kar) {
+            continue;
+          }
+
+          int x0 = (x < 0) ? -x : 0;
+          int x1 = ((x + kar->width) > (int)f.width) ? ((int)f.width - x) : kar->width;
+
+          for (int j = 0; j < kar->height; ++j) {
+            int dy = y + kar->yoffset + j;
+            if (dy < 0 || dy >= (int)f.height) {
+              continue;
+            }
+            const uint8_t* src = g->font_pixels + (kar->y + j) * g->font_w + kar->x;
+            T* row = dst + (size_t)dy * f.strides[0] + x;
+            for (int i = x0; i < x1; ++i) {
+              row[i] = traits::scale(src[i]);
+            }
+          }
+
+          x += kar->xadvance;
+        }
+      }
+
+      /* Converts the yuv420p frame of the generator. */
+      static void convert(video_generator* g, Frame& f) {
+
+        for (uint32_t j = 0; j < f.height; ++j) {
+          Copy<T, traits::shift, S>::row(f.plane<T>(0).data() + j * f.strides[0], g->y + j * g->strides[0], f.width);
+        }
+
+        for (uint32_t j = 0; j < f.height / 2; ++j) {
+          if constexpr (PixelFormat::I420 == F) {
+            Copy<T, traits::shift, S>::row(f.plane<T>(1).data() + j * f.strides[1], g->u + j * g->strides[1], f.width / 2);
+            Copy<T, traits::shift, S>::row(f.plane<T>(2).data() + j * f.strides[2], g->v + j * g->strides[2], f.width / 2);
+          }
+          else {
+            Interleave<T, traits::shift, S>::row(f.plane<T>(1).data() + j * f.strides[1], g->u + j * g->strides[1], g->v + j * g->strides[2], f.width / 2);
+          }
+        }
+      }
+    };
+
+    inline Simd detect_simd() {
+#if defined(VG_HAVE_AVX2)
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2")) {
+        return Simd::AVX2;
+      }
+#endif
+#if defined(VG_HAVE_X86)
+      return Simd::SSE2;
+#else
+      return Simd::Scalar;
+#endif
+    }
+
+    typedef void(*render_function)(video_generator* g, Frame& f);
+
+    template<PixelFormat F, int Depth>
+    inline render_function select(Simd s, bool bars) {
+      switch (s) {
+#if defined(VG_HAVE_AVX2)
+        case Simd::AVX2: { return bars ? &Renderer<F, Depth, Simd::AVX2>::bars : &Renderer<F, Depth, Simd::AVX2>::convert; }
+#endif
+#if defined(VG_HAVE_X86)
+        case Simd::SSE2: { return bars ? &Renderer<F, Depth, Simd::SSE2>::bars : &Renderer<F, Depth, Simd::SSE2>::convert; }
+#endif
+        default: { return bars ? &Renderer<F, Depth, Simd::Scalar>::bars : &Renderer<F, Depth, Simd::Scalar>::convert; }
+      }
+    }
+
+    inline render_function select(PixelFormat f, int depth, Simd s, bool bars) {
+      if (PixelFormat::I420 == f) {
+        return (8 == depth) ? select<PixelFormat::I420, 8>(s, bars) : select<PixelFormat::I420, 10>(s, bars);
+      }
+      return (8 == depth) ? select<PixelFormat::NV12, 8>(s, bars) : select<PixelFormat::NV12, 10>(s, bars);
+    }
+
+  } /* namespace detail */
+
+  /* ----------------------------------------------------------------------------------- */
+  /*                          G E N E R A T O R                                          */
+  /* ----------------------------------------------------------------------------------- */
+
+  class Generator {
+  public:
+    explicit Generator(const video_generator_settings& settings, Simd simd = detail::detect_simd())
+      :gen(new video_generator())
+      ,cfg(settings)
+      ,simd_level(simd)
+    {
+      memset(gen.get(), 0x00, sizeof(video_generator));
+      int r = video_generator_init(&cfg, gen.get());
+      if (0 != r) {
+        gen.reset();
+        throw std::runtime_error("vg::Generator: cannot initialize the video generator (" + std::to_string(r) + ").");
+      }
+    }
+
+    ~Generator() {
+      if (gen) {
+        video_generator_clear(gen.get());
+      }
+    }
+
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+
+    Generator(Generator&& other) noexcept
+      :gen(std::move(other.gen))
+      ,cfg(other.cfg)
+      ,simd_level(other.simd_level)
+    {
+    }
+
+    Generator& operator=(Generator&& other) noexcept {
+      if (this != &other) {
+        if (gen) {
+          video_generator_clear(gen.get());
+        }
+        gen = std::move(other.gen);
+        cfg = other.cfg;
+        simd_level = other.simd_level;
+      }
+      return *this;
+    }
+
+    /* Generates the next yuv420p frame using the C code path. */
+    void update() {
+      int r = video_generator_update(gen.get());
+      if (0 != r) {
+        throw std::runtime_error("vg::Generator: failed to update (" + std::to_string(r) + ").");
+      }
+    }
+
+    /* Renders the next frame into `f` using the specialized kernels. */
+    void render(Frame& f) {
+
+      video_generator* g = gen.get();
+
+      if (f.width != g->width || f.height != g->height) {
+        throw std::invalid_argument("vg::Generator::render: the frame size doesn't match the generator.");
+      }
+
+      /* only the plain bars are rendered natively, everything else needs the C code path. */
+      bool bars = (VIDEO_GENERATOR_PATTERN_BARS == g->pattern
+                   && 0 == g->num_scenes
+                   && 0 == g->num_renditions
+                   && NULL == g->cache
+                   && 0 == g->slice_rows
+                   && 0.0 == g->faults.video_drop_probability
+                   && 0.0 == g->faults.video_repeat_probability);
+      detail::render_function fn = detail::select(f.format, f.depth, simd_level, bars);
+
+      f.frame = g->frame;
+
+      if (bars) {
+        g->timestamp.pts = (int64_t)g->frame;
+        g->timestamp.timebase_num = g->fps_num;
+        g->timestamp.timebase_den = g->fps_den;
+        g->timestamp.sample = (g->frame * g->audio_samplerate * g->fps_num) / g->fps_den;
+        g->timestamp.capture_ns = video_generator_now_ns();
+        g->fault_flags = 0;
+        g->dirty_rects[0].x = 0;
+        g->dirty_rects[0].y = 0;
+        g->dirty_rects[0].width = g->width;
+        g->dirty_rects[0].height = g->height;
+        g->num_dirty_rects = 1;
+        g->dirty_valid = 0;
+        fn(g, f);
+        g->frame++;
+      }
+      else {
+        update();
+        fn(g, f);
+      }
+
+      f.timestamp = g->timestamp;
+    }
+
+    Frame make_frame(PixelFormat format = PixelFormat::I420, int depth = 8) const {
+      return Frame(gen->width, gen->height, format, depth);
+    }
+
+    span<const uint8_t> y() const { return span<const uint8_t>(gen->y, gen->ybytes); }
+    span<const uint8_t> u() const { return span<const uint8_t>(gen->u, gen->ubytes); }
+    span<const uint8_t> v() const { return span<const uint8_t>(gen->v, gen->vbytes); }
+    span<const uint8_t> bytes() const { return span<const uint8_t>(gen->y, gen->nbytes); }
+
+    uint64_t frame() const { return gen->frame; }
+    uint32_t width() const { return gen->width; }
+    uint32_t height() const { return gen->height; }
+    Simd simd() const { return simd_level; }
+    video_generator* get() { return gen.get(); }
+    const video_generator* get() const { return gen.get(); }
+
+  private:
+    std::unique_ptr<video_generator> gen;
+    video_generator_settings cfg;
+    Simd simd_level;
+  };
+
+} /* namespace vg */
+
+#endif
@@ -0,0 +1,284 @@
+/*
+
+  video_generator_bench - streaming stores benchmark
+  ---------------------------------------------------
+
+  Measures what `streaming_stores` does for the generator and for a thread
+  that runs next to it. The consumer thread stands in for an encoder: it
+  keeps reading and writing a working set that fits in the last level cache
+  (8 MB by default) and counts how many bytes it gets through. Every test
+  runs for the same time:
+
+      consumer alone          - the consumer with the cache to itself.
+      generator alone         - frames/sec with regular and streaming stores.
+      generator + consumer    - both running; the consumer slows down when
+                                the frames push its working set out of the
+                                cache.
+
+      video_generator_bench -s 3840x2160 -p noise -t 5 -w 8
+
+  Use a working set that is close to the size of your last level cache and
+  a frame that is larger than it, otherwise there is nothing to evict. The
+  results depend a lot on the machine (and on what else is running), so
+  compare runs on the same machine.
+
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <video_generator.h>
+
+/* ----------------------------------------------------------------------------------- */
+
+typedef struct consumer consumer;
+
+struct consumer {
+  pthread_t thread;
+  uint8_t* data;                        /* the working set. */
+  size_t nbytes;                        /* size of the working set. */
+  volatile int must_run;                /* set to 0 to stop the thread. */
+  uint64_t bytes;                       /* number of bytes that were processed. */
+  uint64_t checksum;                    /* keeps the compiler from removing the loop. */
+};
+
+/* ----------------------------------------------------------------------------------- */
+
+static void print_usage(const char* prog);
+static uint64_t now_ns();
+static void* consumer_thread(void* user);
+static int consumer_start(consumer* c);
+static int consumer_stop(consumer* c);
+static double run_generator(video_generator_settings* cfg, double duration, uint64_t* nframes);
+static void sleep_seconds(double duration);
+
+/* ----------------------------------------------------------------------------------- */
+
+int main(int argc, char** argv) {
+
+  video_generator_settings cfg;
+  consumer cons;
+  double duration = 3.0;
+  double working_set_mb = 8.0;
+  double elapsed;
+  double fps[2];
+  double consumer_alone;
+  double consumer_gbs[2];
+  uint64_t nframes;
+  uint64_t start;
+  int opt;
+  int i;
+
+  static struct option long_options[] = {
+    { "size",            required_argument, 0, 's' },
+    { "pattern",         required_argument, 0, 'p' },
+    { "duration",        required_argument, 0, 't' },
+    { "working-set",     required_argument, 0, 'w' },
+    { "help",            no_argument,       0, 'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  memset(&cfg, 0x00, sizeof(cfg));
+  cfg.width = 3840;
+  cfg.height = 2160;
+  cfg.fps = 60;
+  cfg.bip_frequency = 500;
+  cfg.bop_frequency = 1500;
+  cfg.noise_amplitude = 128;
+  cfg.pattern = VIDEO_GENERATOR_PATTERN_NOISE;
+
+  while (-1 != (opt = getopt_long(argc, argv, "s:p:t:w:h", long_options, NULL))) {
+    switch (opt) {
+      case 's': {
+        if (2 != sscanf(optarg, "%ux%u", &cfg.width, &cfg.height)) {
+          fprintf(stderr, "Error: invalid size %s, use e.g. 1920x1080.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 't': { duration = atof(optarg);              break; }
+      case 'w': { working_set_mb = atof(optarg);        break; }
+      case 'p': {
+        if (0 != video_generator_pattern_from_string(optarg, &cfg.pattern)) {
+          fprintf(stderr, "Error: unknown pattern %s.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'h': {
+        print_usage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+      default: {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  if (0 != (cfg.width & 1) || 0 != (cfg.height & 1) || duration <= 0.0 || working_set_mb <= 0.0) {
+    fprintf(stderr, "Error: width and height must be even, the duration and working set > 0.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  memset(&cons, 0x00, sizeof(cons));
+  cons.nbytes = ((size_t)(working_set_mb * 1024.0 * 1024.0) + 63) & ~(size_t)63;
+  cons.data = (uint8_t*)malloc(cons.nbytes);
+  if (NULL == cons.data) {
+    fprintf(stderr, "Error: cannot allocate the working set.\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(cons.data, 0x01, cons.nbytes);
+
+  printf("frame: %ux%u, %.1f MB per frame, working set: %.1f MB, %.1f seconds per test.\n\n",
+         cfg.width, cfg.height, (cfg.width * cfg.height * 1.5) / (1024.0 * 1024.0),
+         cons.nbytes / (1024.0 * 1024.0), duration);
+
+  /* consumer alone */
+  if (0 != consumer_start(&cons)) {
+    exit(EXIT_FAILURE);
+  }
+  start = now_ns();
+  sleep_seconds(duration);
+  consumer_stop(&cons);
+  elapsed = (now_ns() - start) / 1e9;
+  consumer_alone = cons.bytes / (elapsed * 1e9);
+
+  /* generator alone and with the consumer, with regular (0) and streaming (1) stores. */
+  for (i = 0; i < 2; ++i) {
+
+    cfg.streaming_stores = i;
+
+    fps[i] = run_generator(&cfg, duration, &nframes);
+    if (fps[i] < 0.0) {
+      exit(EXIT_FAILURE);
+    }
+
+    if (0 != consumer_start(&cons)) {
+      exit(EXIT_FAILURE);
+    }
+    start = now_ns();
+    if (run_generator(&cfg, duration, &nframes) < 0.0) {
+      exit(EXIT_FAILURE);
+    }
+    consumer_stop(&cons);
+    elapsed = (now_ns() - start) / 1e9;
+    consumer_gbs[i] = cons.bytes / (elapsed * 1e9);
+  }
+
+  printf("                        generator      consumer\n");
+  printf("consumer alone          %9s      %6.2f GB/s\n", "-", consumer_alone);
+  printf("regular stores          %7.1f fps      %6.2f GB/s (%5.1f%%)\n", fps[0], consumer_gbs[0], 100.0 * consumer_gbs[0] / consumer_alone);
+  printf("streaming stores        %7.1f fps      %6.2f GB/s (%5.1f%%)\n", fps[1], consumer_gbs[1], 100.0 * consumer_gbs[1] / consumer_alone);
+  printf("\nThe generator fps are measured without the consumer, the percentages are relative to the consumer alone.\n");
+
+  free(cons.data);
+  cons.data = NULL;
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options]\n\n"
+          "  -s, --size WxH             resolution, default 3840x2160.\n"
+          "  -p, --pattern NAME         bars, noise, zoneplate, checkerboard or gradient, default noise.\n"
+          "  -t, --duration SECONDS     duration of each test, default 3.\n"
+          "  -w, --working-set MB       size of the working set of the consumer, default 8.\n",
+          prog);
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_seconds(double duration) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)duration;
+  ts.tv_nsec = (long)((duration - ts.tv_sec) * 1e9);
+  nanosleep(&ts, NULL);
+}
+
+/* Generates frames for `duration` seconds, returns the frames/sec or < 0 on error. */
+static double run_generator(video_generator_settings* cfg, double duration, uint64_t* nframes) {
+
+  video_generator gen;
+  uint64_t start, end, now;
+
+  if (0 != video_generator_init(cfg, &gen)) {
+    fprintf(stderr, "Error: cannot initialize the generator.\n");
+    return -1.0;
+  }
+
+  *nframes = 0;
+  start = now_ns();
+  end = start + (uint64_t)(duration * 1e9);
+
+  do {
+    video_generator_update(&gen);
+    *nframes = *nframes + 1;
+    now = now_ns();
+  } while (now < end);
+
+  video_generator_clear(&gen);
+
+  return *nframes / ((now - start) / 1e9);
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  Reads and writes every cache line of the working set, like an encoder
+  that works on its reference frames and tables. It runs as fast as it can,
+  so its throughput shows how much of the working set stays in the cache.
+*/
+static void* consumer_thread(void* user) {
+
+  consumer* c = (consumer*)user;
+  uint64_t sum = 0;
+  uint64_t bytes = 0;
+  uint64_t* p;
+  size_t i, n;
+
+  p = (uint64_t*)c->data;
+  n = c->nbytes / sizeof(uint64_t);
+
+  while (0 != c->must_run) {
+    for (i = 0; i < n; i += 8) {
+      sum += p[i];
+      p[i + 4] += sum;
+    }
+    bytes += c->nbytes;
+  }
+
+  c->bytes = bytes;
+  c->checksum = sum;
+
+  return NULL;
+}
+
+static int consumer_start(consumer* c) {
+
+  c->bytes = 0;
+  c->must_run = 1;
+
+  if (0 != pthread_create(&c->thread, NULL, consumer_thread, c)) {
+    fprintf(stderr, "Error: cannot create the consumer thread.\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+static int consumer_stop(consumer* c) {
+  c->must_run = 0;
+  pthread_join(c->thread, NULL);
+  return 0;
+}
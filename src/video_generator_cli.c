@@ -0,0 +1,608 @@
+/*
+
+  video_generator - command line tool
+  ------------------------------------
+
+  Streams the generated video as Y4M or raw yuv420p to stdout (or a file) so
+  it can be piped into an encoder:
+
+      video_generator -s 1920x1080 -r 60 -t 10 | ffmpeg -i - out.mp4
+      video_generator -f raw -p noise -s 3840x2160 -n 600 > out.yuv
+
+  When stdout is a pipe on Linux the frames are handed to the pipe with
+  vmsplice(), which maps the pages of the frame into the pipe instead of
+  copying them. Because the pipe only references our pages we render into a
+  ring of buffers that is larger than the pipe can hold, so a buffer is never
+  overwritten while it's still in the pipe.
+
+  By default frames are generated as fast as possible. With --realtime the
+  frames are paced at the framerate and audio can be captured to a file with
+  --audio (the audio thread of the generator always runs in realtime).
+
+  With --rtp host:port the video is sent as RFC 4175 raw video over RTP
+  instead, paced over each frame interval, and the audio as L16 to port + 2.
+  A SDP that describes the streams is written to stderr (or --sdp file):
+
+      video_generator -s 1280x720 --rtp 127.0.0.1:5004 --sdp stream.sdp
+
+  With --cache file the first cycle of the pattern (e.g. the 5 seconds of
+  the moving bar) is stored in the file and replayed, only the time is drawn
+  for each frame. The file is reused by the next run with the same settings.
+
+  A summary with frames/sec and MB/s is written to stderr.
+
+  With --trace file the time spent in each stage (generating, writing,
+  sending, the audio callbacks) is written as Chrome trace JSON when the
+  tool stops. This needs a build with VIDEO_GENERATOR_TRACE.
+
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <video_generator.h>
+#include <video_generator_trace.h>
+
+#if defined(__linux)
+#  define HAVE_VMSPLICE
+#  define HAVE_RTP
+#  include <video_generator_rtp.h>
+#endif
+
+/* ----------------------------------------------------------------------------------- */
+
+static void print_usage(const char* prog);
+static int setup_output(video_generator* g);
+static int write_frame(video_generator* g);
+static int write_all(int fd, struct iovec* iov, int iovcnt, int use_vmsplice);
+static uint64_t now_ns();
+static void sleep_ns(uint64_t ns);
+static void on_audio(const int16_t* samples, uint32_t nbytes, uint32_t nframes, const video_generator_timestamp* ts);
+static void on_sigh(int s);
+#if defined(HAVE_RTP)
+static int setup_rtp(const char* dest);
+static int write_sdp(const char* path);
+static void print_rtp_stats(const char* name, video_generator_rtp* rtp);
+#endif
+
+/* ----------------------------------------------------------------------------------- */
+
+volatile sig_atomic_t must_run = 1;
+int out_fd = STDOUT_FILENO;
+int out_is_y4m = 1;
+int use_vmsplice = 0;
+uint8_t* ring = NULL;                 /* buffers we render into when using vmsplice. */
+uint32_t ring_size = 0;               /* number of buffers in the ring. */
+uint32_t ring_stride = 0;             /* bytes between the buffers in the ring. */
+FILE* audio_fp = NULL;
+uint64_t total_bytes = 0;
+
+#if defined(HAVE_RTP)
+video_generator_rtp rtp_video;
+video_generator_rtp rtp_audio;
+int use_rtp = 0;
+#endif
+
+static const char y4m_frame_header[] = "FRAME\n";
+
+/* ----------------------------------------------------------------------------------- */
+
+int main(int argc, char** argv) {
+
+  video_generator_settings cfg;
+  video_generator gen;
+  const char* output_path = NULL;
+  const char* audio_path = NULL;
+  const char* rtp_dest = NULL;
+  const char* sdp_path = NULL;
+  const char* trace_path = NULL;
+  double duration = 0.0;
+  uint64_t max_frames = 0;
+  int realtime = 0;
+  int no_splice = 0;
+  int opt;
+  uint64_t start, due, now, elapsed;
+  char header[256];
+  int header_len;
+  struct iovec iov;
+
+  static struct option long_options[] = {
+    { "size",            required_argument, 0, 's' },
+    { "rate",            required_argument, 0, 'r' },
+    { "duration",        required_argument, 0, 't' },
+    { "frames",          required_argument, 0, 'n' },
+    { "format",          required_argument, 0, 'f' },
+    { "pattern",         required_argument, 0, 'p' },
+    { "output",          required_argument, 0, 'o' },
+    { "audio",           required_argument, 0, 'a' },
+    { "bip",             required_argument, 0, 'b' },
+    { "bop",             required_argument, 0, 'B' },
+    { "noise-amplitude", required_argument, 0, 'A' },
+    { "seed",            required_argument, 0, 'S' },
+    { "realtime",        no_argument,       0, 'R' },
+    { "no-splice",       no_argument,       0, 'N' },
+    { "rtp",             required_argument, 0, 'U' },
+    { "sdp",             required_argument, 0, 'D' },
+    { "trace",           required_argument, 0, 'T' },
+    { "streaming-stores", no_argument,      0, 'W' },
+    { "cache",           required_argument, 0, 'C' },
+    { "help",            no_argument,       0, 'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  memset(&cfg, 0x00, sizeof(cfg));
+  cfg.width = 1280;
+  cfg.height = 720;
+  cfg.fps = 25;
+  cfg.bip_frequency = 500;
+  cfg.bop_frequency = 1500;
+  cfg.noise_amplitude = 128;
+
+  while (-1 != (opt = getopt_long(argc, argv, "s:r:t:n:f:p:o:a:b:B:A:S:RNU:D:T:WC:h", long_options, NULL))) {
+    switch (opt) {
+      case 's': {
+        if (2 != sscanf(optarg, "%ux%u", &cfg.width, &cfg.height)) {
+          fprintf(stderr, "Error: invalid size %s, use e.g. 1920x1080.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'r': { cfg.fps = atoi(optarg);               break; }
+      case 't': { duration = atof(optarg);              break; }
+      case 'n': { max_frames = strtoull(optarg, NULL, 10); break; }
+      case 'o': { output_path = optarg;                 break; }
+      case 'a': { audio_path = optarg;                  break; }
+      case 'b': { cfg.bip_frequency = atoi(optarg);     break; }
+      case 'B': { cfg.bop_frequency = atoi(optarg);     break; }
+      case 'A': { cfg.noise_amplitude = atoi(optarg);   break; }
+      case 'S': { cfg.seed = strtoul(optarg, NULL, 10); break; }
+      case 'R': { realtime = 1;                         break; }
+      case 'N': { no_splice = 1;                        break; }
+      case 'U': { rtp_dest = optarg;                    break; }
+      case 'D': { sdp_path = optarg;                    break; }
+      case 'T': { trace_path = optarg;                  break; }
+      case 'W': { cfg.streaming_stores = 1;             break; }
+      case 'C': { cfg.cache_path = optarg;              break; }
+      case 'f': {
+        if (0 == strcmp(optarg, "y4m")) {
+          out_is_y4m = 1;
+        }
+        else if (0 == strcmp(optarg, "raw")) {
+          out_is_y4m = 0;
+        }
+        else {
+          fprintf(stderr, "Error: unknown format %s, use y4m or raw.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'p': {
+        if (0 != video_generator_pattern_from_string(optarg, &cfg.pattern)) {
+          fprintf(stderr, "Error: unknown pattern %s.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'h': {
+        print_usage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+      default: {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  if (0 != (cfg.width & 1) || 0 != (cfg.height & 1) || 0 == cfg.fps) {
+    fprintf(stderr, "Error: width and height must be even and the framerate > 0.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (duration > 0.0) {
+    max_frames = (uint64_t)(duration * cfg.fps + 0.5);
+  }
+
+  if (NULL != rtp_dest) {
+#if defined(HAVE_RTP)
+    /* rtp is a live source: paced and always with audio. */
+    use_rtp = 1;
+    realtime = 1;
+    cfg.audio_callback = on_audio;
+#else
+    fprintf(stderr, "Error: rtp output is only available on Linux.\n");
+    exit(EXIT_FAILURE);
+#endif
+  }
+
+  if (NULL != audio_path) {
+    if (0 == realtime) {
+      fprintf(stderr, "Error: audio is generated in realtime, use --realtime together with --audio.\n");
+      exit(EXIT_FAILURE);
+    }
+    audio_fp = fopen(audio_path, "wb");
+    if (NULL == audio_fp) {
+      fprintf(stderr, "Error: cannot open the audio file %s.\n", audio_path);
+      exit(EXIT_FAILURE);
+    }
+    cfg.audio_callback = on_audio;
+  }
+
+  if (NULL != output_path) {
+    out_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+      fprintf(stderr, "Error: cannot open %s: %s\n", output_path, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  else if (NULL == rtp_dest && isatty(STDOUT_FILENO)) {
+    fprintf(stderr, "Error: not writing video to a terminal, pipe the output or use --output.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  signal(SIGINT, on_sigh);
+  signal(SIGTERM, on_sigh);
+  signal(SIGPIPE, SIG_IGN);
+
+#if defined(HAVE_RTP)
+  /* the audio sender must exist before the audio thread starts. */
+  if (1 == use_rtp && 0 != setup_rtp(rtp_dest)) {
+    exit(EXIT_FAILURE);
+  }
+#endif
+
+  if (0 != video_generator_init(&cfg, &gen)) {
+    fprintf(stderr, "Error: cannot initialize the video generator.\n");
+    exit(EXIT_FAILURE);
+  }
+
+#if defined(HAVE_RTP)
+  if (1 == use_rtp) {
+    if (0 != video_generator_rtp_init_video(&rtp_video, rtp_audio.host, rtp_audio.port - 2, &gen)) {
+      fprintf(stderr, "Error: cannot create the rtp video sender.\n");
+      exit(EXIT_FAILURE);
+    }
+    if (0 != write_sdp(sdp_path)) {
+      exit(EXIT_FAILURE);
+    }
+  }
+#endif
+
+  if (0 == no_splice && NULL == rtp_dest) {
+    setup_output(&gen);
+  }
+
+  if (1 == out_is_y4m && NULL == rtp_dest) {
+    header_len = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", cfg.width, cfg.height, cfg.fps);
+    iov.iov_base = header;
+    iov.iov_len = header_len;
+    if (0 != write_all(out_fd, &iov, 1, 0)) {
+      must_run = 0;
+    }
+  }
+
+  VIDEO_GENERATOR_TRACE_THREAD("main");
+
+  start = now_ns();
+
+  while (must_run && (0 == max_frames || gen.frame < max_frames)) {
+
+    if (NULL != ring) {
+      video_generator_set_buffer(&gen, ring + (gen.frame % ring_size) * ring_stride);
+    }
+
+    if (0 != video_generator_update(&gen)) {
+      fprintf(stderr, "Error: failed to generate frame %llu.\n", (unsigned long long)gen.frame);
+      break;
+    }
+
+#if defined(HAVE_RTP)
+    if (1 == use_rtp) {
+      VIDEO_GENERATOR_TRACE_BEGIN(trace_send);
+      video_generator_rtp_send_video(&rtp_video, &gen, start + ((gen.frame - 1) * 1000000000ull) / cfg.fps);
+      VIDEO_GENERATOR_TRACE_END(trace_send, "rtp send");
+      continue;
+    }
+#endif
+
+    VIDEO_GENERATOR_TRACE_BEGIN(trace_write);
+    if (0 != write_frame(&gen)) {
+      break;
+    }
+    VIDEO_GENERATOR_TRACE_END(trace_write, "write");
+
+    if (1 == realtime) {
+      due = start + (gen.frame * 1000000000ull) / cfg.fps;
+      now = now_ns();
+      if (due > now) {
+        sleep_ns(due - now);
+      }
+    }
+  }
+
+  elapsed = now_ns() - start;
+
+  fprintf(stderr, "Wrote %llu frames (%ux%u@%u) in %.3f s: %.2f frames/sec, %.2f MB/s%s.\n",
+          (unsigned long long)gen.frame,
+          cfg.width, cfg.height, cfg.fps,
+          elapsed * 1e-9,
+          gen.frame / (elapsed * 1e-9),
+          (total_bytes / (1024.0 * 1024.0)) / (elapsed * 1e-9),
+          (1 == use_vmsplice) ? ", vmsplice" : "");
+
+  if (NULL != cfg.cache_path) {
+    fprintf(stderr, "%llu frames were replayed from the cache.\n", (unsigned long long)gen.frames_cached);
+  }
+
+  video_generator_clear(&gen);
+
+  if (NULL != trace_path) {
+    video_generator_trace_dump(trace_path);
+  }
+
+#if defined(HAVE_RTP)
+  if (1 == use_rtp) {
+    print_rtp_stats("video", &rtp_video);
+    print_rtp_stats("audio", &rtp_audio);
+    video_generator_rtp_clear(&rtp_video);
+    video_generator_rtp_clear(&rtp_audio);
+  }
+#endif
+
+  if (NULL != ring) {
+    free(ring);
+    ring = NULL;
+  }
+
+  if (NULL != audio_fp) {
+    fclose(audio_fp);
+    audio_fp = NULL;
+  }
+
+  if (STDOUT_FILENO != out_fd) {
+    close(out_fd);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] > output\n\n"
+          "  -s, --size WxH             resolution, default 1280x720.\n"
+          "  -r, --rate FPS             framerate, default 25.\n"
+          "  -t, --duration SECONDS     stop after this many seconds of video.\n"
+          "  -n, --frames N             stop after N frames, default: run until interrupted.\n"
+          "  -f, --format y4m|raw       output format, default y4m.\n"
+          "  -p, --pattern NAME         bars, noise, zoneplate, checkerboard or gradient.\n"
+          "  -A, --noise-amplitude N    amplitude of the noise pattern, 0-255.\n"
+          "  -S, --seed N               seed for the noise pattern.\n"
+          "  -o, --output FILE          write to FILE instead of stdout.\n"
+          "  -R, --realtime             pace the frames at the framerate.\n"
+          "  -a, --audio FILE           write s16le, 44100hz, stereo audio to FILE (needs --realtime).\n"
+          "  -b, --bip HZ               frequency of the bip, default 500.\n"
+          "  -B, --bop HZ               frequency of the bop, default 1500.\n"
+          "  -N, --no-splice            use write() instead of vmsplice().\n"
+          "  -U, --rtp HOST:PORT        send RTP video to HOST:PORT and L16 audio to PORT + 2.\n"
+          "  -D, --sdp FILE             write the SDP of the RTP streams to FILE instead of stderr.\n"
+          "  -T, --trace FILE           write a Chrome trace JSON of all stages to FILE at exit.\n"
+          "  -W, --streaming-stores     write the frames with non-temporal stores.\n"
+          "  -C, --cache FILE           render one cycle of frames into FILE and replay it.\n",
+          prog);
+}
+
+/*
+  When the output is a pipe we grow the pipe, so one syscall can move a
+  complete frame, and allocate a ring of buffers that holds more than the
+  pipe. A buffer is reused `ring_size` frames later; at that point at most
+  a pipe full of data is still unread, which is always from newer buffers.
+*/
+static int setup_output(video_generator* g) {
+
+#if defined(HAVE_VMSPLICE)
+  struct stat st;
+  long page_size;
+  int pipe_size;
+
+  if (0 != fstat(out_fd, &st) || !S_ISFIFO(st.st_mode)) {
+    return -1;
+  }
+
+  fcntl(out_fd, F_SETPIPE_SZ, g->nbytes);
+  pipe_size = fcntl(out_fd, F_GETPIPE_SZ);
+  if (pipe_size <= 0) {
+    return -2;
+  }
+
+  page_size = sysconf(_SC_PAGESIZE);
+  page_size = (page_size > 0) ? page_size : 4096;
+  ring_stride = ((g->nbytes + page_size - 1) / page_size) * page_size;
+  ring_size = (pipe_size / ring_stride) + 2;
+
+  if (0 != posix_memalign((void**)&ring, page_size, (size_t)ring_stride * ring_size)) {
+    ring = NULL;
+    return -3;
+  }
+
+  use_vmsplice = 1;
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+static int write_frame(video_generator* g) {
+
+  struct iovec iov[2];
+  int iovcnt = 0;
+
+  if (1 == out_is_y4m) {
+    iov[iovcnt].iov_base = (void*)y4m_frame_header;
+    iov[iovcnt].iov_len = sizeof(y4m_frame_header) - 1;
+    iovcnt++;
+  }
+
+  iov[iovcnt].iov_base = g->y;
+  iov[iovcnt].iov_len = g->nbytes;
+  iovcnt++;
+
+  return write_all(out_fd, iov, iovcnt, use_vmsplice);
+}
+
+static int write_all(int fd, struct iovec* iov, int iovcnt, int splice) {
+
+  ssize_t r;
+
+  while (iovcnt > 0) {
+
+#if defined(HAVE_VMSPLICE)
+    if (1 == splice) {
+      r = vmsplice(fd, iov, iovcnt, 0);
+    }
+    else {
+      r = writev(fd, iov, iovcnt);
+    }
+#else
+    r = writev(fd, iov, iovcnt);
+#endif
+
+    if (r < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      if (EPIPE != errno) {
+        fprintf(stderr, "Error: failed to write the output: %s\n", strerror(errno));
+      }
+      return -1;
+    }
+
+    total_bytes += r;
+
+    while (iovcnt > 0 && (size_t)r >= iov->iov_len) {
+      r -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    if (iovcnt > 0) {
+      iov->iov_base = (uint8_t*)iov->iov_base + r;
+      iov->iov_len -= r;
+    }
+  }
+
+  return 0;
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_ns(uint64_t ns) {
+  struct timespec ts;
+  ts.tv_sec = ns / 1000000000ull;
+  ts.tv_nsec = ns % 1000000000ull;
+  nanosleep(&ts, NULL);
+}
+
+static void on_audio(const int16_t* samples, uint32_t nbytes, uint32_t nframes, const video_generator_timestamp* ts) {
+  if (NULL != audio_fp) {
+    fwrite(samples, nbytes, 1, audio_fp);
+  }
+#if defined(HAVE_RTP)
+  if (1 == use_rtp) {
+    video_generator_rtp_send_audio(&rtp_audio, samples, nframes, ts->sample);
+  }
+#endif
+}
+
+#if defined(HAVE_RTP)
+
+static int setup_rtp(const char* dest) {
+
+  char host[64];
+  const char* colon;
+  int port;
+
+  colon = strrchr(dest, ':');
+  if (NULL == colon || (size_t)(colon - dest) >= sizeof(host)) {
+    fprintf(stderr, "Error: invalid rtp destination %s, use e.g. 127.0.0.1:5004.\n", dest);
+    return -1;
+  }
+
+  memcpy(host, dest, colon - dest);
+  host[colon - dest] = '\0';
+  port = atoi(colon + 1);
+  if (port <= 0 || port > 65533) {
+    fprintf(stderr, "Error: invalid rtp port %s.\n", colon + 1);
+    return -2;
+  }
+
+  /* the generator always produces 44100hz stereo. */
+  if (0 != video_generator_rtp_init_audio(&rtp_audio, host, port + 2, 44100, 2)) {
+    fprintf(stderr, "Error: cannot create the rtp audio sender.\n");
+    return -3;
+  }
+
+  return 0;
+}
+
+static int write_sdp(const char* path) {
+
+  FILE* fp = stderr;
+
+  if (NULL != path) {
+    fp = fopen(path, "w");
+    if (NULL == fp) {
+      fprintf(stderr, "Error: cannot open the sdp file %s.\n", path);
+      return -1;
+    }
+  }
+
+  video_generator_rtp_print_sdp(fp, &rtp_video, &rtp_audio);
+
+  if (NULL != path) {
+    fclose(fp);
+  }
+
+  return 0;
+}
+
+static void print_rtp_stats(const char* name, video_generator_rtp* rtp) {
+
+  double secs = (rtp->last_send_ns - rtp->first_send_ns) * 1e-9;
+
+  fprintf(stderr, "RTP %s: %llu packets, %.0f packets/sec, %.2f MB/s, %llu send errors",
+          name,
+          (unsigned long long)rtp->packets_sent,
+          (secs > 0.0) ? rtp->packets_sent / secs : 0.0,
+          (secs > 0.0) ? (rtp->bytes_sent / (1024.0 * 1024.0)) / secs : 0.0,
+          (unsigned long long)rtp->send_errors);
+
+  if (0 != rtp->nbatches) {
+    fprintf(stderr, ", pacing error avg %.1f us, max %.1f us, %s",
+            (rtp->pacing_error_total / rtp->nbatches) * 1e-3,
+            rtp->pacing_error_max * 1e-3,
+            (1 == rtp->use_gso) ? "gso" : "sendmmsg");
+  }
+
+  fprintf(stderr, ".\n");
+}
+
+#endif
+
+static void on_sigh(int s) {
+  (void)s;
+  must_run = 0;
+}
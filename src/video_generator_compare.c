@@ -0,0 +1,332 @@
+/*
+
+  video_generator_compare - quality metrics tool
+  -----------------------------------------------
+
+  Compares a decoded raw yuv420p file with the video the generator creates
+  and writes the PSNR and SSIM of every frame as CSV. The reference frames
+  are rendered on the fly, so you only need the settings that were used to
+  create the video:
+
+      video_generator -f raw -s 1280x720 -n 500 | x264 ... -o out.264
+      ffmpeg -i out.264 -f rawvideo -pix_fmt yuv420p decoded.yuv
+      video_generator_compare -s 1280x720 decoded.yuv > metrics.csv
+
+  The file is mapped into memory and split into one range of frames per
+  thread; every thread renders its own reference frames. Use --first when
+  the file doesn't start at frame 0. A summary is written to stderr.
+
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <video_generator.h>
+#include <video_generator_metrics.h>
+
+#define MAX_THREADS 256
+
+/* ----------------------------------------------------------------------------------- */
+
+typedef struct worker worker;
+
+struct worker {
+  pthread_t handle;
+  video_generator_settings* cfg;
+  const uint8_t* data;                  /* first byte of the first frame of this worker. */
+  uint32_t frame_size;                  /* number of bytes of one frame in the file. */
+  uint64_t first;                       /* index of the first frame in the file. */
+  uint64_t count;                       /* number of frames to compare. */
+  uint64_t first_number;                /* frame number of the first frame in the file. */
+  video_generator_metrics_result* results;
+  int result;                           /* 0 when all frames were compared. */
+};
+
+/* ----------------------------------------------------------------------------------- */
+
+static void print_usage(const char* prog);
+static void* compare_frames(void* user);
+static uint64_t now_ns();
+
+/* ----------------------------------------------------------------------------------- */
+
+int main(int argc, char** argv) {
+
+  video_generator_settings cfg;
+  video_generator_metrics_result* results = NULL;
+  video_generator_metrics_result* res;
+  worker workers[MAX_THREADS];
+  const char* input_path = NULL;
+  const char* output_path = NULL;
+  FILE* out = stdout;
+  struct stat st;
+  uint8_t* data;
+  uint64_t first_number = 0;
+  uint64_t nframes, chunk, i, worst;
+  uint32_t frame_size;
+  uint64_t start, elapsed;
+  double sum_psnr[3] = { 0.0 };
+  double sum_ssim[3] = { 0.0 };
+  int nthreads = 0;
+  int fd, opt, k, n;
+  int err = 0;
+
+  static struct option long_options[] = {
+    { "size",            required_argument, 0, 's' },
+    { "rate",            required_argument, 0, 'r' },
+    { "pattern",         required_argument, 0, 'p' },
+    { "noise-amplitude", required_argument, 0, 'A' },
+    { "seed",            required_argument, 0, 'S' },
+    { "first",           required_argument, 0, 'F' },
+    { "threads",         required_argument, 0, 'j' },
+    { "output",          required_argument, 0, 'o' },
+    { "help",            no_argument,       0, 'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  /* same defaults as the video_generator tool. */
+  memset(&cfg, 0x00, sizeof(cfg));
+  cfg.width = 1280;
+  cfg.height = 720;
+  cfg.fps = 25;
+  cfg.noise_amplitude = 128;
+
+  while (-1 != (opt = getopt_long(argc, argv, "s:r:p:A:S:F:j:o:h", long_options, NULL))) {
+    switch (opt) {
+      case 's': {
+        if (2 != sscanf(optarg, "%ux%u", &cfg.width, &cfg.height)) {
+          fprintf(stderr, "Error: invalid size %s, use e.g. 1920x1080.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'r': { cfg.fps = atoi(optarg);                     break; }
+      case 'A': { cfg.noise_amplitude = atoi(optarg);         break; }
+      case 'S': { cfg.seed = strtoul(optarg, NULL, 10);       break; }
+      case 'F': { first_number = strtoull(optarg, NULL, 10);  break; }
+      case 'j': { nthreads = atoi(optarg);                    break; }
+      case 'o': { output_path = optarg;                       break; }
+      case 'p': {
+        if (0 != video_generator_pattern_from_string(optarg, &cfg.pattern)) {
+          fprintf(stderr, "Error: unknown pattern %s.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'h': {
+        print_usage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+      default: {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  if (optind >= argc) {
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  input_path = argv[optind];
+
+  if (0 != (cfg.width & 1) || 0 != (cfg.height & 1) || 0 == cfg.fps) {
+    fprintf(stderr, "Error: width and height must be even and the framerate > 0.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (nthreads <= 0) {
+    nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  nthreads = (nthreads < 1) ? 1 : (nthreads > MAX_THREADS) ? MAX_THREADS : nthreads;
+
+  fd = open(input_path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: cannot open %s: %s\n", input_path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  if (0 != fstat(fd, &st)) {
+    fprintf(stderr, "Error: cannot stat %s: %s\n", input_path, strerror(errno));
+    close(fd);
+    exit(EXIT_FAILURE);
+  }
+
+  frame_size = cfg.width * cfg.height + 2 * ((cfg.width / 2) * (cfg.height / 2));
+  nframes = (uint64_t)st.st_size / frame_size;
+  if (0 == nframes) {
+    fprintf(stderr, "Error: %s doesn't contain a complete %ux%u frame.\n", input_path, cfg.width, cfg.height);
+    close(fd);
+    exit(EXIT_FAILURE);
+  }
+
+  if (0 != ((uint64_t)st.st_size % frame_size)) {
+    fprintf(stderr, "Warning: ignoring %llu bytes at the end of %s.\n",
+            (unsigned long long)((uint64_t)st.st_size % frame_size), input_path);
+  }
+
+  data = (uint8_t*)mmap(NULL, nframes * frame_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == data) {
+    fprintf(stderr, "Error: cannot map %s: %s\n", input_path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  /* every thread reads its own range from front to back. */
+  madvise(data, nframes * frame_size, MADV_SEQUENTIAL);
+
+  results = (video_generator_metrics_result*)calloc(nframes, sizeof(video_generator_metrics_result));
+  if (NULL == results) {
+    fprintf(stderr, "Error: cannot allocate the results.\n");
+    munmap(data, nframes * frame_size);
+    exit(EXIT_FAILURE);
+  }
+
+  if ((uint64_t)nthreads > nframes) {
+    nthreads = (int)nframes;
+  }
+
+  chunk = (nframes + nthreads - 1) / nthreads;
+  start = now_ns();
+
+  for (k = 0, n = 0; k < nthreads; ++k) {
+    workers[k].cfg = &cfg;
+    workers[k].frame_size = frame_size;
+    workers[k].first = k * chunk;
+    workers[k].count = (workers[k].first >= nframes) ? 0 : ((nframes - workers[k].first < chunk) ? (nframes - workers[k].first) : chunk);
+    workers[k].data = data + workers[k].first * frame_size;
+    workers[k].first_number = first_number;
+    workers[k].results = results;
+    workers[k].result = 0;
+    if (0 != pthread_create(&workers[k].handle, NULL, compare_frames, &workers[k])) {
+      fprintf(stderr, "Error: cannot create thread %d.\n", k);
+      err = 1;
+      break;
+    }
+    n++;
+  }
+
+  for (k = 0; k < n; ++k) {
+    pthread_join(workers[k].handle, NULL);
+    if (0 != workers[k].result) {
+      err = 1;
+    }
+  }
+
+  elapsed = now_ns() - start;
+
+  if (0 == err && NULL != output_path) {
+    out = fopen(output_path, "w");
+    if (NULL == out) {
+      fprintf(stderr, "Error: cannot open %s: %s\n", output_path, strerror(errno));
+      err = 1;
+    }
+  }
+
+  if (0 == err) {
+
+    fprintf(out, "frame,psnr_y,psnr_u,psnr_v,psnr_yuv,ssim_y,ssim_u,ssim_v\n");
+
+    worst = 0;
+    for (i = 0; i < nframes; ++i) {
+      res = &results[i];
+      fprintf(out, "%llu,%.4f,%.4f,%.4f,%.4f,%.6f,%.6f,%.6f\n",
+              (unsigned long long)res->frame,
+              res->psnr[0], res->psnr[1], res->psnr[2], res->psnr_yuv,
+              res->ssim[0], res->ssim[1], res->ssim[2]);
+      for (k = 0; k < 3; ++k) {
+        sum_psnr[k] += res->psnr[k];
+        sum_ssim[k] += res->ssim[k];
+      }
+      if (res->psnr[0] < results[worst].psnr[0]) {
+        worst = i;
+      }
+    }
+
+    fprintf(stderr, "Compared %llu frames in %.3f s (%.2f frames/sec, %d threads).\n"
+            "Average PSNR y: %.3f, u: %.3f, v: %.3f dB, SSIM y: %.5f, u: %.5f, v: %.5f.\n"
+            "Lowest PSNR y: %.3f dB in frame %llu.\n",
+            (unsigned long long)nframes, elapsed * 1e-9, nframes / (elapsed * 1e-9), n,
+            sum_psnr[0] / nframes, sum_psnr[1] / nframes, sum_psnr[2] / nframes,
+            sum_ssim[0] / nframes, sum_ssim[1] / nframes, sum_ssim[2] / nframes,
+            results[worst].psnr[0], (unsigned long long)results[worst].frame);
+  }
+
+  if (NULL != out && stdout != out) {
+    fclose(out);
+  }
+
+  free(results);
+  munmap(data, nframes * frame_size);
+
+  return (0 == err) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static void* compare_frames(void* user) {
+
+  worker* w = (worker*)user;
+  video_generator_metrics metrics;
+  uint8_t* planes[3];
+  uint32_t strides[3];
+  uint64_t i;
+
+  if (0 == w->count) {
+    return NULL;
+  }
+
+  if (0 != video_generator_metrics_init(&metrics, w->cfg)) {
+    w->result = -1;
+    return NULL;
+  }
+
+  strides[0] = w->cfg->width;
+  strides[1] = w->cfg->width / 2;
+  strides[2] = w->cfg->width / 2;
+
+  for (i = 0; i < w->count; ++i) {
+
+    planes[0] = (uint8_t*)w->data + i * w->frame_size;
+    planes[1] = planes[0] + w->cfg->width * w->cfg->height;
+    planes[2] = planes[1] + (w->cfg->width / 2) * (w->cfg->height / 2);
+
+    if (0 != video_generator_metrics_compare(&metrics, w->first_number + w->first + i, planes, strides, &w->results[w->first + i])) {
+      w->result = -2;
+      break;
+    }
+  }
+
+  video_generator_metrics_clear(&metrics);
+
+  return NULL;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options] decoded.yuv > metrics.csv\n\n"
+          "  -s, --size WxH             resolution, default 1280x720.\n"
+          "  -r, --rate FPS             framerate, default 25.\n"
+          "  -p, --pattern NAME         bars, noise, zoneplate, checkerboard or gradient.\n"
+          "  -A, --noise-amplitude N    amplitude of the noise pattern, 0-255.\n"
+          "  -S, --seed N               seed for the noise pattern.\n"
+          "  -F, --first N              frame number of the first frame in the file, default 0.\n"
+          "  -j, --threads N            number of threads, default: one per core.\n"
+          "  -o, --output FILE          write the CSV to FILE instead of stdout.\n",
+          prog);
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
@@ -0,0 +1,556 @@
+/*
+
+  video_generator_harness - backpressure test harness
+  ----------------------------------------------------
+
+  Runs the generator in realtime against an emulated consumer (e.g. an
+  encoder or a network sender) that takes frames from a bounded queue, and
+  shows what happens when the consumer is slower than the framerate. The
+  frames are rendered into a frame pool and handed over without copies.
+
+  The consumer takes `--cost` ms per frame, plus a uniform random `--jitter`
+  or, with `--exponential`, an exponentially distributed cost with `--cost`
+  as mean. Every `--stall-every` frames it stalls for `--stall` ms (a disk
+  flush, a key frame) and every `--burst-every` frames the next
+  `--burst-frames` frames cost `--burst-cost` ms each (a scene change). The
+  consumer sleeps for the cost, so it models work that runs on another core
+  or on hardware.
+
+  When the queue is full the producer applies a policy:
+
+      block         - wait for the consumer; the source falls behind realtime.
+      drop-oldest   - drop the oldest frame in the queue, keeps the latency low.
+      drop-newest   - drop the new frame, keeps the frames in the queue.
+
+  Each policy runs for `--duration` seconds with the same random costs, then
+  the consumer drains the queue. For each policy we report the number of
+  frames that were produced, consumed and dropped, the sustained throughput
+  of the consumer, the percentiles of the latency from the moment a frame
+  should have been captured (frame number / fps) until the consumer is done
+  with it, and how far the source fell behind realtime.
+
+      video_generator_harness -s 1280x720 -r 30 -c 30 -j 10 -e 60 -l 200 -t 10
+
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <video_generator.h>
+#include <video_generator_pool.h>
+
+#define POLICY_BLOCK 0
+#define POLICY_DROP_OLDEST 1
+#define POLICY_DROP_NEWEST 2
+#define NUM_POLICIES 3
+#define MAX_QUEUE 64
+
+/* ----------------------------------------------------------------------------------- */
+
+typedef struct consumer_model consumer_model;
+typedef struct scenario scenario;
+
+struct consumer_model {
+  double cost_ms;                       /* processing time per frame, or the mean with `exponential`. */
+  double jitter_ms;                     /* uniform random extra time, 0 - jitter_ms. */
+  int exponential;                      /* 1 when the cost is exponentially distributed. */
+  uint32_t stall_every;                 /* stall every this many frames, 0 = never. */
+  double stall_ms;                      /* length of a stall. */
+  uint32_t burst_every;                 /* start a burst every this many frames, 0 = never. */
+  uint32_t burst_frames;                /* number of frames of a burst. */
+  double burst_cost_ms;                 /* cost of a frame in a burst. */
+  uint64_t seed;                        /* seed for the random costs. */
+};
+
+struct scenario {
+
+  /* settings */
+  int policy;                           /* POLICY_* */
+  uint32_t depth;                       /* max number of frames in the queue. */
+  consumer_model model;
+  uint64_t start_ns;                    /* the time of frame 0. */
+  double frame_ns;                      /* duration of a frame. */
+
+  /* the queue */
+  pthread_mutex_t mut;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  video_generator_frame* queue[MAX_QUEUE];
+  uint32_t head;                        /* index of the oldest frame. */
+  uint32_t count;                       /* number of frames in the queue. */
+  int done;                             /* set to 1 when the producer stops. */
+
+  /* results */
+  uint64_t* latencies;                  /* latency of every consumed frame in ns. */
+  uint64_t max_latencies;               /* size of `latencies`. */
+  uint64_t produced;
+  uint64_t consumed;
+  uint64_t dropped;
+  uint64_t max_lag_ns;                  /* how far the producer was behind realtime. */
+  uint32_t max_count;                   /* max number of frames in the queue. */
+  uint64_t end_ns;                      /* the time the consumer finished the last frame. */
+};
+
+/* ----------------------------------------------------------------------------------- */
+
+static void print_usage(const char* prog);
+static int parse_policy(const char* name, int* policy);
+static uint64_t now_ns();
+static void sleep_until(uint64_t t);
+static double random_unit(uint64_t* state);
+static uint64_t consumer_cost_ns(consumer_model* m, uint64_t index, uint64_t* state);
+static void* consumer_thread(void* user);
+static int run_scenario(video_generator_settings* cfg, scenario* s, double duration);
+static void print_result(scenario* s);
+static int compare_u64(const void* a, const void* b);
+
+static const char* policy_names[NUM_POLICIES] = { "block", "drop-oldest", "drop-newest" };
+
+/* ----------------------------------------------------------------------------------- */
+
+int main(int argc, char** argv) {
+
+  video_generator_settings cfg;
+  consumer_model model;
+  scenario sc;
+  double duration = 5.0;
+  uint32_t depth = 4;
+  int policy = -1;
+  int opt;
+  int i;
+
+  static struct option long_options[] = {
+    { "size",            required_argument, 0, 's' },
+    { "rate",            required_argument, 0, 'r' },
+    { "pattern",         required_argument, 0, 'p' },
+    { "duration",        required_argument, 0, 't' },
+    { "queue",           required_argument, 0, 'q' },
+    { "policy",          required_argument, 0, 'P' },
+    { "cost",            required_argument, 0, 'c' },
+    { "jitter",          required_argument, 0, 'j' },
+    { "exponential",     no_argument,       0, 'x' },
+    { "stall-every",     required_argument, 0, 'e' },
+    { "stall",           required_argument, 0, 'l' },
+    { "burst-every",     required_argument, 0, 'E' },
+    { "burst-frames",    required_argument, 0, 'k' },
+    { "burst-cost",      required_argument, 0, 'K' },
+    { "seed",            required_argument, 0, 'S' },
+    { "help",            no_argument,       0, 'h' },
+    { 0, 0, 0, 0 }
+  };
+
+  memset(&cfg, 0x00, sizeof(cfg));
+  cfg.width = 1280;
+  cfg.height = 720;
+  cfg.fps = 30;
+  cfg.bip_frequency = 500;
+  cfg.bop_frequency = 1500;
+  cfg.noise_amplitude = 128;
+
+  memset(&model, 0x00, sizeof(model));
+  model.cost_ms = 36.0;
+  model.seed = 1;
+
+  while (-1 != (opt = getopt_long(argc, argv, "s:r:p:t:q:P:c:j:xe:l:E:k:K:S:h", long_options, NULL))) {
+    switch (opt) {
+      case 's': {
+        if (2 != sscanf(optarg, "%ux%u", &cfg.width, &cfg.height)) {
+          fprintf(stderr, "Error: invalid size %s, use e.g. 1920x1080.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'r': { cfg.fps = atoi(optarg);                       break; }
+      case 't': { duration = atof(optarg);                      break; }
+      case 'q': { depth = atoi(optarg);                         break; }
+      case 'c': { model.cost_ms = atof(optarg);                 break; }
+      case 'j': { model.jitter_ms = atof(optarg);               break; }
+      case 'x': { model.exponential = 1;                        break; }
+      case 'e': { model.stall_every = atoi(optarg);             break; }
+      case 'l': { model.stall_ms = atof(optarg);                break; }
+      case 'E': { model.burst_every = atoi(optarg);             break; }
+      case 'k': { model.burst_frames = atoi(optarg);            break; }
+      case 'K': { model.burst_cost_ms = atof(optarg);           break; }
+      case 'S': { model.seed = strtoull(optarg, NULL, 10);      break; }
+      case 'p': {
+        if (0 != video_generator_pattern_from_string(optarg, &cfg.pattern)) {
+          fprintf(stderr, "Error: unknown pattern %s.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'P': {
+        if (0 != parse_policy(optarg, &policy)) {
+          fprintf(stderr, "Error: unknown policy %s, use block, drop-oldest, drop-newest or all.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      }
+      case 'h': {
+        print_usage(argv[0]);
+        exit(EXIT_SUCCESS);
+      }
+      default: {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  if (0 != (cfg.width & 1) || 0 != (cfg.height & 1) || 0 == cfg.fps || duration <= 0.0) {
+    fprintf(stderr, "Error: width and height must be even, the rate and duration > 0.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (0 == depth || depth > MAX_QUEUE) {
+    fprintf(stderr, "Error: the queue must hold 1 - %d frames.\n", MAX_QUEUE);
+    exit(EXIT_FAILURE);
+  }
+
+  if (model.cost_ms < 0.0 || model.jitter_ms < 0.0 || model.stall_ms < 0.0 || model.burst_cost_ms < 0.0) {
+    fprintf(stderr, "Error: the costs must be >= 0.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (0 == model.seed) {
+    model.seed = 1;
+  }
+
+  printf("frames: %ux%u @ %u fps (%.2f ms per frame), queue: %u, %.1f seconds per policy.\n",
+         cfg.width, cfg.height, cfg.fps, 1000.0 / cfg.fps, depth, duration);
+  printf("consumer: %.2f ms per frame", model.cost_ms);
+  if (0 != model.exponential)                        { printf(" (exponential)"); }
+  else if (model.jitter_ms > 0.0)                    { printf(" + 0-%.2f ms", model.jitter_ms); }
+  if (0 != model.stall_every)                        { printf(", stall of %.2f ms every %u frames", model.stall_ms, model.stall_every); }
+  if (0 != model.burst_every)                        { printf(", %u frames of %.2f ms every %u frames", model.burst_frames, model.burst_cost_ms, model.burst_every); }
+  printf(".\n\n");
+
+  printf("%-12s %9s %9s %9s %8s %8s %8s %8s %8s %9s %6s\n",
+         "policy", "produced", "consumed", "dropped", "fps", "p50 ms", "p90 ms", "p99 ms", "max ms", "lag ms", "queue");
+
+  for (i = 0; i < NUM_POLICIES; ++i) {
+
+    if (policy >= 0 && policy != i) {
+      continue;
+    }
+
+    memset(&sc, 0x00, sizeof(sc));
+    sc.policy = i;
+    sc.depth = depth;
+    sc.model = model;
+
+    if (0 != run_scenario(&cfg, &sc, duration)) {
+      exit(EXIT_FAILURE);
+    }
+
+    print_result(&sc);
+  }
+
+  printf("\nLatency: from the capture time of a frame (frame number / fps) until the consumer is done with it.\n"
+         "Lag: how far the source fell behind realtime. Queue: max number of frames in the queue.\n");
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [options]\n\n"
+          "  -s, --size WxH             resolution, default 1280x720.\n"
+          "  -r, --rate FPS             framerate, default 30.\n"
+          "  -p, --pattern NAME         bars, noise, zoneplate, checkerboard or gradient.\n"
+          "  -t, --duration SECONDS     duration of each policy, default 5.\n"
+          "  -q, --queue N              max number of frames in the queue, default 4.\n"
+          "  -P, --policy NAME          block, drop-oldest, drop-newest or all (default).\n"
+          "  -c, --cost MS              processing time per frame, default 36.\n"
+          "  -j, --jitter MS            add a uniform random 0 - MS to the cost.\n"
+          "  -x, --exponential          exponentially distributed cost with --cost as mean.\n"
+          "  -e, --stall-every N        stall every N frames.\n"
+          "  -l, --stall MS             length of a stall.\n"
+          "  -E, --burst-every N        start a burst every N frames.\n"
+          "  -k, --burst-frames N       number of frames of a burst.\n"
+          "  -K, --burst-cost MS        cost of a frame in a burst.\n"
+          "  -S, --seed N               seed for the random costs, default 1.\n",
+          prog);
+}
+
+static int parse_policy(const char* name, int* policy) {
+
+  if (0 == strcmp(name, "block"))             { *policy = POLICY_BLOCK; }
+  else if (0 == strcmp(name, "drop-oldest"))  { *policy = POLICY_DROP_OLDEST; }
+  else if (0 == strcmp(name, "drop-newest"))  { *policy = POLICY_DROP_NEWEST; }
+  else if (0 == strcmp(name, "all"))          { *policy = -1; }
+  else { return -1; }
+
+  return 0;
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)(t / 1000000000ull);
+  ts.tv_nsec = (long)(t % 1000000000ull);
+  while (0 != clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) { }
+}
+
+/* xorshift64*, returns [0, 1). */
+static double random_unit(uint64_t* state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return ((x * 0x2545f4914f6cdd1dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t consumer_cost_ns(consumer_model* m, uint64_t index, uint64_t* state) {
+
+  double ms;
+
+  if (0 != m->exponential) {
+    ms = -log(1.0 - random_unit(state)) * m->cost_ms;
+  }
+  else {
+    ms = m->cost_ms + random_unit(state) * m->jitter_ms;
+  }
+
+  if (0 != m->burst_every && (index % m->burst_every) < m->burst_frames) {
+    ms = m->burst_cost_ms;
+  }
+
+  if (0 != m->stall_every && 0 != index && 0 == (index % m->stall_every)) {
+    ms += m->stall_ms;
+  }
+
+  return (uint64_t)(ms * 1e6);
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static void* consumer_thread(void* user) {
+
+  scenario* s = (scenario*)user;
+  video_generator_frame* frame;
+  uint64_t state = s->model.seed;
+  uint64_t index = 0;
+  uint64_t capture, t;
+
+  while (1) {
+
+    pthread_mutex_lock(&s->mut);
+    while (0 == s->count && 0 == s->done) {
+      pthread_cond_wait(&s->not_empty, &s->mut);
+    }
+    if (0 == s->count) {
+      pthread_mutex_unlock(&s->mut);
+      break;
+    }
+    frame = s->queue[s->head];
+    s->head = (s->head + 1) % s->depth;
+    s->count--;
+    pthread_cond_signal(&s->not_full);
+    pthread_mutex_unlock(&s->mut);
+
+    /* "process" the frame. */
+    sleep_until(now_ns() + consumer_cost_ns(&s->model, index, &state));
+
+    t = now_ns();
+    capture = s->start_ns + (uint64_t)(frame->frame * s->frame_ns);
+    if (s->consumed < s->max_latencies) {
+      s->latencies[s->consumed] = (t > capture) ? (t - capture) : 0;
+    }
+
+    video_generator_frame_release(frame);
+    s->consumed++;
+    s->end_ns = t;
+    index++;
+  }
+
+  return NULL;
+}
+
+/* Runs the producer for `duration` seconds with the policy of the scenario, then drains the queue. */
+static int run_scenario(video_generator_settings* cfg, scenario* s, double duration) {
+
+  video_generator gen;
+  video_generator_pool pool;
+  video_generator_frame* frame;
+  video_generator_frame* dropped;
+  pthread_t thread;
+  uint64_t due, now, end;
+  int r = 0;
+
+  if (0 != video_generator_init(cfg, &gen)) {
+    fprintf(stderr, "Error: cannot initialize the generator.\n");
+    return -1;
+  }
+
+  /* the queue, the frame the consumer works on and the one we render. */
+  if (0 != video_generator_pool_init(&pool, &gen, s->depth + 2, VIDEO_GENERATOR_POOL_BLOCK)) {
+    fprintf(stderr, "Error: cannot initialize the frame pool.\n");
+    video_generator_clear(&gen);
+    return -2;
+  }
+
+  s->frame_ns = 1e9 / cfg->fps;
+  s->max_latencies = (uint64_t)(duration * cfg->fps) + 2;
+  s->latencies = (uint64_t*)malloc(sizeof(uint64_t) * s->max_latencies);
+  if (NULL == s->latencies) {
+    fprintf(stderr, "Error: cannot allocate the latencies.\n");
+    video_generator_pool_clear(&pool);
+    video_generator_clear(&gen);
+    return -3;
+  }
+
+  pthread_mutex_init(&s->mut, NULL);
+  pthread_cond_init(&s->not_empty, NULL);
+  pthread_cond_init(&s->not_full, NULL);
+
+  s->start_ns = now_ns() + 10000000ull;
+  end = s->start_ns + (uint64_t)(duration * 1e9);
+
+  if (0 != pthread_create(&thread, NULL, consumer_thread, s)) {
+    fprintf(stderr, "Error: cannot create the consumer thread.\n");
+    pthread_cond_destroy(&s->not_full);
+    pthread_cond_destroy(&s->not_empty);
+    pthread_mutex_destroy(&s->mut);
+    free(s->latencies);
+    s->latencies = NULL;
+    video_generator_pool_clear(&pool);
+    video_generator_clear(&gen);
+    return -4;
+  }
+
+  while (1) {
+
+    /* wait until the frame is due; when we're behind we render straight away. */
+    due = s->start_ns + (uint64_t)(gen.frame * s->frame_ns);
+    if (due >= end) {
+      break;
+    }
+
+    now = now_ns();
+    if (now < due) {
+      sleep_until(due);
+    }
+    else if ((now - due) > s->max_lag_ns) {
+      s->max_lag_ns = now - due;
+    }
+
+    if (0 != video_generator_pool_acquire(&pool, &frame)) {
+      fprintf(stderr, "Error: cannot acquire a frame.\n");
+      r = -5;
+      break;
+    }
+
+    s->produced++;
+    dropped = NULL;
+
+    pthread_mutex_lock(&s->mut);
+
+    if (s->count == s->depth) {
+      if (POLICY_BLOCK == s->policy) {
+        while (s->count == s->depth) {
+          pthread_cond_wait(&s->not_full, &s->mut);
+        }
+      }
+      else if (POLICY_DROP_OLDEST == s->policy) {
+        dropped = s->queue[s->head];
+        s->head = (s->head + 1) % s->depth;
+        s->count--;
+      }
+      else {
+        dropped = frame;
+        frame = NULL;
+      }
+    }
+
+    if (NULL != frame) {
+      s->queue[(s->head + s->count) % s->depth] = frame;
+      s->count++;
+      s->max_count = (s->count > s->max_count) ? s->count : s->max_count;
+      pthread_cond_signal(&s->not_empty);
+    }
+
+    pthread_mutex_unlock(&s->mut);
+
+    if (NULL != dropped) {
+      video_generator_frame_release(dropped);
+      s->dropped++;
+    }
+  }
+
+  /* let the consumer drain the queue. */
+  pthread_mutex_lock(&s->mut);
+  s->done = 1;
+  pthread_cond_signal(&s->not_empty);
+  pthread_mutex_unlock(&s->mut);
+  pthread_join(thread, NULL);
+
+  pthread_cond_destroy(&s->not_full);
+  pthread_cond_destroy(&s->not_empty);
+  pthread_mutex_destroy(&s->mut);
+  video_generator_pool_clear(&pool);
+  video_generator_clear(&gen);
+
+  /* print_result() frees the latencies, but it's not called when we failed. */
+  if (0 != r) {
+    free(s->latencies);
+    s->latencies = NULL;
+  }
+
+  return r;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static void print_result(scenario* s) {
+
+  uint64_t n;
+  double fps = 0.0;
+  double p[4] = { 0.0 };
+
+  n = (s->consumed < s->max_latencies) ? s->consumed : s->max_latencies;
+
+  if (n > 0) {
+    qsort(s->latencies, n, sizeof(uint64_t), compare_u64);
+    p[0] = s->latencies[(n * 50) / 100] / 1e6;
+    p[1] = s->latencies[(n * 90) / 100] / 1e6;
+    p[2] = s->latencies[(n * 99) / 100] / 1e6;
+    p[3] = s->latencies[n - 1] / 1e6;
+  }
+
+  if (s->end_ns > s->start_ns) {
+    fps = s->consumed / ((s->end_ns - s->start_ns) / 1e9);
+  }
+
+  printf("%-12s %9llu %9llu %9llu %8.2f %8.2f %8.2f %8.2f %8.2f %9.2f %6u\n",
+         policy_names[s->policy],
+         (unsigned long long)s->produced,
+         (unsigned long long)s->consumed,
+         (unsigned long long)s->dropped,
+         fps, p[0], p[1], p[2], p[3],
+         s->max_lag_ns / 1e6,
+         s->max_count);
+
+  free(s->latencies);
+  s->latencies = NULL;
+}
+
+static int compare_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a;
+  uint64_t y = *(const uint64_t*)b;
+  return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
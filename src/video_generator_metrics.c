@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <video_generator_metrics.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  define HAVE_SSE2
+#  include <emmintrin.h>
+#endif
+
+/* SSIM constants for 8 bit samples, scaled for sums over 64 pixels. */
+#define SSIM_C1 ((int64_t)(0.01 * 0.01 * 255 * 255 * 64 + 0.5))
+#define SSIM_C2 ((int64_t)(0.03 * 0.03 * 255 * 255 * 64 * 63 + 0.5))
+
+/* ----------------------------------------------------------------------------------- */
+
+static uint64_t metrics_sse(const uint8_t* a, uint32_t astride, const uint8_t* b, uint32_t bstride, uint32_t w, uint32_t h);
+static double metrics_ssim(video_generator_metrics* m, const uint8_t* a, uint32_t astride, const uint8_t* b, uint32_t bstride, uint32_t w, uint32_t h);
+static void metrics_ssim_blocks(const uint8_t* a, uint32_t astride, const uint8_t* b, uint32_t bstride, uint32_t nblocks, int32_t* sums, uint32_t sums_stride);
+static double metrics_psnr(double mse);
+
+/* ----------------------------------------------------------------------------------- */
+
+int video_generator_metrics_init(video_generator_metrics* m, video_generator_settings* cfg) {
+
+  video_generator_settings rcfg;
+
+  if (!m) { return -1; }
+  if (!cfg) { return -2; }
+  if (cfg->width < 16 || cfg->height < 16) {
+    printf("Error: the metrics need frames of at least 16x16.\n");
+    return -3;
+  }
+
+  /* the reference is the plain video: no audio, faults, slices or renditions. */
+  rcfg = *cfg;
+  rcfg.audio_callback = NULL;
+  rcfg.faults = NULL;
+  rcfg.slice_rows = 0;
+  rcfg.slice_callback = NULL;
+  rcfg.slice_user = NULL;
+  rcfg.renditions = NULL;
+  rcfg.num_renditions = 0;
+
+  memset(m, 0x00, sizeof(*m));
+
+  if (0 != video_generator_init(&rcfg, &m->ref)) {
+    printf("Error: cannot initialize the reference generator.\n");
+    return -4;
+  }
+
+  /* two block rows with 4 sums each; room for the 4 blocks the SIMD kernel writes at once. */
+  m->ssim_sums = (int32_t*)malloc(sizeof(int32_t) * 2 * 4 * ((cfg->width / 4) + 4));
+  if (NULL == m->ssim_sums) {
+    printf("Error: cannot allocate the SSIM buffer.\n");
+    video_generator_clear(&m->ref);
+    return -5;
+  }
+
+  return 0;
+}
+
+int video_generator_metrics_compare(video_generator_metrics* m, uint64_t frame, uint8_t* planes[3], uint32_t strides[3], video_generator_metrics_result* result) {
+
+  video_generator* g;
+  uint32_t widths[3];
+  uint32_t heights[3];
+  uint64_t sse, total_sse;
+  uint32_t i;
+  int r;
+
+  if (!m) { return -1; }
+  if (!planes) { return -2; }
+  if (!strides) { return -3; }
+  if (!result) { return -4; }
+  if (!m->ssim_sums) { return -5; }
+
+  g = &m->ref;
+  g->frame = frame;
+
+  r = video_generator_update(g);
+  if (0 != r) {
+    printf("Error: failed to render reference frame %llu: %d\n", (unsigned long long)frame, r);
+    return -6;
+  }
+
+  widths[0] = g->width;
+  heights[0] = g->height;
+  widths[1] = widths[2] = g->width / 2;
+  heights[1] = heights[2] = g->height / 2;
+
+  result->frame = frame;
+  total_sse = 0;
+
+  for (i = 0; i < 3; ++i) {
+    sse = metrics_sse(planes[i], strides[i], g->planes[i], g->strides[i], widths[i], heights[i]);
+    total_sse += sse;
+    result->mse[i] = (double)sse / ((double)widths[i] * heights[i]);
+    result->psnr[i] = metrics_psnr(result->mse[i]);
+    result->ssim[i] = metrics_ssim(m, planes[i], strides[i], g->planes[i], g->strides[i], widths[i], heights[i]);
+  }
+
+  result->psnr_yuv = metrics_psnr((double)total_sse / (double)g->nbytes);
+
+  return 0;
+}
+
+int video_generator_metrics_clear(video_generator_metrics* m) {
+
+  if (!m) { return -1; }
+  if (!m->ssim_sums) { return -2; }
+
+  video_generator_clear(&m->ref);
+  free(m->ssim_sums);
+  m->ssim_sums = NULL;
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static double metrics_psnr(double mse) {
+
+  double psnr;
+
+  if (mse <= 0.0) {
+    return VIDEO_GENERATOR_METRICS_PSNR_MAX;
+  }
+
+  psnr = 10.0 * log10((255.0 * 255.0) / mse);
+
+  return (psnr > VIDEO_GENERATOR_METRICS_PSNR_MAX) ? VIDEO_GENERATOR_METRICS_PSNR_MAX : psnr;
+}
+
+/* Sum of squared differences of two planes. */
+static uint64_t metrics_sse(const uint8_t* a, uint32_t astride, const uint8_t* b, uint32_t bstride, uint32_t w, uint32_t h) {
+
+  uint64_t total = 0;
+  uint32_t i, j;
+  int d;
+
+#if defined(HAVE_SSE2)
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc, va, vb, ad, lo, hi;
+  uint32_t tmp[4];
+#endif
+
+  for (j = 0; j < h; ++j) {
+
+    i = 0;
+
+#if defined(HAVE_SSE2)
+    /* |a - b| fits in a byte, its square in a 16x16 bit madd. One row can't overflow the 32 bit lanes. */
+    acc = _mm_setzero_si128();
+    for (; i + 16 <= w; i += 16) {
+      va = _mm_loadu_si128((const __m128i*)(a + i));
+      vb = _mm_loadu_si128((const __m128i*)(b + i));
+      ad = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+      lo = _mm_unpacklo_epi8(ad, zero);
+      hi = _mm_unpackhi_epi8(ad, zero);
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+    }
+    _mm_storeu_si128((__m128i*)tmp, acc);
+    total += (uint64_t)tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+
+    for (; i < w; ++i) {
+      d = (int)a[i] - (int)b[i];
+      total += (uint64_t)(d * d);
+    }
+
+    a += astride;
+    b += bstride;
+  }
+
+  return total;
+}
+
+/*
+  SSIM over 8x8 windows with a step of 4 pixels. We first compute the sums
+  of each 4x4 block (sum of a, sum of b, sum of a*a + b*b and sum of a*b) of
+  one block row; every window is made of 2x2 blocks of two block rows. The
+  sums are stored per kind: s1[], s2[], ss[], s12[], each `sums_stride` long.
+*/
+static double metrics_ssim(video_generator_metrics* m, const uint8_t* a, uint32_t astride, const uint8_t* b, uint32_t bstride, uint32_t w, uint32_t h) {
+
+  uint32_t nbx = w / 4;
+  uint32_t nby = h / 4;
+  uint32_t sums_stride = nbx + 4;
+  int32_t* rows[2];
+  int32_t* r0;
+  int32_t* r1;
+  int64_t s1, s2, ss, s12, vars, covar;
+  double total = 0.0;
+  uint32_t x, y;
+
+/* sum of kind `k` of the 2x2 blocks of window x. */
+#define SSIM_WINDOW(k) ((int64_t)r0[(k) * sums_stride + x] + r0[(k) * sums_stride + x + 1] \
+                        + r1[(k) * sums_stride + x] + r1[(k) * sums_stride + x + 1])
+
+  rows[0] = m->ssim_sums;
+  rows[1] = m->ssim_sums + 4 * sums_stride;
+
+  metrics_ssim_blocks(a, astride, b, bstride, nbx, rows[0], sums_stride);
+
+  for (y = 1; y < nby; ++y) {
+
+    r0 = rows[(y - 1) & 1];
+    r1 = rows[y & 1];
+    metrics_ssim_blocks(a + (size_t)y * 4 * astride, astride, b + (size_t)y * 4 * bstride, bstride, nbx, r1, sums_stride);
+
+    for (x = 0; x + 1 < nbx; ++x) {
+      s1 = SSIM_WINDOW(0);
+      s2 = SSIM_WINDOW(1);
+      ss = SSIM_WINDOW(2);
+      s12 = SSIM_WINDOW(3);
+      vars = ss * 64 - s1 * s1 - s2 * s2;
+      covar = s12 * 64 - s1 * s2;
+      total += ((double)(2 * s1 * s2 + SSIM_C1) * (double)(2 * covar + SSIM_C2))
+             / ((double)(s1 * s1 + s2 * s2 + SSIM_C1) * (double)(vars + SSIM_C2));
+    }
+  }
+
+#undef SSIM_WINDOW
+
+  return total / ((double)(nbx - 1) * (nby - 1));
+}
+
+/* Sums of `nblocks` 4x4 blocks, see metrics_ssim(). */
+static void metrics_ssim_blocks(const uint8_t* a, uint32_t astride, const uint8_t* b, uint32_t bstride, uint32_t nblocks, int32_t* sums, uint32_t sums_stride) {
+
+  uint32_t x, i, j;
+  int32_t s1, s2, ss, s12;
+  int pa, pb;
+
+#if defined(HAVE_SSE2)
+  __m128i zero = _mm_setzero_si128();
+  __m128i ones = _mm_set1_epi16(1);
+  __m128i va, vb, alo, ahi, blo, bhi;
+  __m128i s1lo, s1hi, s2lo, s2hi, sslo, sshi, s12lo, s12hi;
+
+/* 8 int16 or 4 int32 pair sums -> lanes 0 and 2 hold the sums of the two 4 pixel blocks. */
+#define SSIM_PAIRS(v) _mm_add_epi32((v), _mm_srli_epi64((v), 32))
+#define SSIM_STORE(dest, lo, hi) \
+  _mm_storeu_si128((__m128i*)(dest), _mm_unpacklo_epi64(_mm_shuffle_epi32(SSIM_PAIRS(lo), 0x08), _mm_shuffle_epi32(SSIM_PAIRS(hi), 0x08)))
+
+  for (x = 0; x + 4 <= nblocks; x += 4) {
+
+    s1lo = s1hi = s2lo = s2hi = zero;
+    sslo = sshi = s12lo = s12hi = zero;
+
+    for (j = 0; j < 4; ++j) {
+      va = _mm_loadu_si128((const __m128i*)(a + j * astride + x * 4));
+      vb = _mm_loadu_si128((const __m128i*)(b + j * bstride + x * 4));
+      alo = _mm_unpacklo_epi8(va, zero);
+      ahi = _mm_unpackhi_epi8(va, zero);
+      blo = _mm_unpacklo_epi8(vb, zero);
+      bhi = _mm_unpackhi_epi8(vb, zero);
+      s1lo = _mm_add_epi16(s1lo, alo);
+      s1hi = _mm_add_epi16(s1hi, ahi);
+      s2lo = _mm_add_epi16(s2lo, blo);
+      s2hi = _mm_add_epi16(s2hi, bhi);
+      sslo = _mm_add_epi32(sslo, _mm_add_epi32(_mm_madd_epi16(alo, alo), _mm_madd_epi16(blo, blo)));
+      sshi = _mm_add_epi32(sshi, _mm_add_epi32(_mm_madd_epi16(ahi, ahi), _mm_madd_epi16(bhi, bhi)));
+      s12lo = _mm_add_epi32(s12lo, _mm_madd_epi16(alo, blo));
+      s12hi = _mm_add_epi32(s12hi, _mm_madd_epi16(ahi, bhi));
+    }
+
+    SSIM_STORE(sums + x, _mm_madd_epi16(s1lo, ones), _mm_madd_epi16(s1hi, ones));
+    SSIM_STORE(sums + sums_stride + x, _mm_madd_epi16(s2lo, ones), _mm_madd_epi16(s2hi, ones));
+    SSIM_STORE(sums + 2 * sums_stride + x, sslo, sshi);
+    SSIM_STORE(sums + 3 * sums_stride + x, s12lo, s12hi);
+  }
+
+#undef SSIM_STORE
+#undef SSIM_PAIRS
+#else
+  x = 0;
+#endif
+
+  for (; x < nblocks; ++x) {
+    s1 = s2 = ss = s12 = 0;
+    for (j = 0; j < 4; ++j) {
+      for (i = 0; i < 4; ++i) {
+        pa = a[j * astride + x * 4 + i];
+        pb = b[j * bstride + x * 4 + i];
+        s1 += pa;
+        s2 += pb;
+        ss += pa * pa + pb * pb;
+        s12 += pa * pb;
+      }
+    }
+    sums[x] = s1;
+    sums[sums_stride + x] = s2;
+    sums[2 * sums_stride + x] = ss;
+    sums[3 * sums_stride + x] = s12;
+  }
+}
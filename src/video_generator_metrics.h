@@ -0,0 +1,84 @@
+/*
+
+  Video Generator - Quality Metrics
+  ==================================
+
+  The generator is deterministic: frame N always looks the same for the same
+  settings. This means it can be its own reference when you check what an
+  encoder made of the video; you don't need to store the source. Decode the
+  encoded stream, pass every decoded frame with its frame number into
+  `video_generator_metrics_compare()` and it renders the reference frame
+  with its own generator and computes the PSNR and SSIM of each plane.
+
+  Use the same settings as the generator that created the video. Audio,
+  faults, slices and renditions are ignored: the reference is rendered
+  without audio, so record the video without audio or the bip/bop markers
+  count as errors. The frame number is the `frame` member of the generator
+  at the time the frame was rendered (0 for the first frame).
+
+  PSNR is computed from the sum of squared differences and is
+  VIDEO_GENERATOR_METRICS_PSNR_MAX when the planes are identical. SSIM is
+  the mean over 8x8 windows that overlap by 4 pixels. The kernels use SSE2
+  when available and the scalar versions give the same result.
+
+  A metrics object is not thread safe; to compare frames in parallel give
+  each thread its own object. See `video_generator_compare.c` for a tool
+  that does this for complete raw YUV files.
+
+     video_generator_metrics_init()     - create the reference generator for the given settings.
+     video_generator_metrics_compare()  - compare a decoded frame with the reference frame.
+     video_generator_metrics_clear()    - free all memory.
+
+  <example>
+
+     video_generator_metrics m;
+     video_generator_metrics_result res;
+
+     video_generator_metrics_init(&m, &cfg);
+
+     while (decode(&pic)) {
+       video_generator_metrics_compare(&m, pic.frame_number, pic.planes, pic.strides, &res);
+       printf("%llu: %.2f dB, ssim %.4f\n", res.frame, res.psnr[0], res.ssim[0]);
+     }
+
+     video_generator_metrics_clear(&m);
+
+  </example>
+ */
+
+#ifndef VIDEO_GENERATOR_METRICS_H
+#define VIDEO_GENERATOR_METRICS_H
+
+#include <video_generator.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VIDEO_GENERATOR_METRICS_PSNR_MAX 100.0                   /* PSNR of identical planes. */
+
+typedef struct video_generator_metrics video_generator_metrics;
+typedef struct video_generator_metrics_result video_generator_metrics_result;
+
+struct video_generator_metrics_result {
+  uint64_t frame;                                                /* the frame number that was compared. */
+  double mse[3];                                                 /* mean squared error of the y, u and v planes. */
+  double psnr[3];                                                /* PSNR of the y, u and v planes in dB. */
+  double ssim[3];                                                /* SSIM of the y, u and v planes, 1.0 when identical. */
+  double psnr_yuv;                                               /* PSNR over all samples of the frame. */
+};
+
+struct video_generator_metrics {
+  video_generator ref;                                           /* renders the reference frames. */
+  int32_t* ssim_sums;                                            /* 4x4 block sums of two block rows, used by the SSIM kernel. */
+};
+
+int video_generator_metrics_init(video_generator_metrics* m, video_generator_settings* cfg);
+int video_generator_metrics_compare(video_generator_metrics* m, uint64_t frame, uint8_t* planes[3], uint32_t strides[3], video_generator_metrics_result* result);
+int video_generator_metrics_clear(video_generator_metrics* m);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
+
+#endif
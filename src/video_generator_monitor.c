@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <video_generator_monitor.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#  define HAVE_SSE2
+#  include <emmintrin.h>
+#endif
+
+#define MONITOR_MIN_AMPLITUDE 300.0f                             /* a tone must be at least this loud; the generator plays them at 10000. */
+#define MONITOR_MIN_RATIO 0.5f                                   /* part of the energy of a block that must be in the tone. */
+#define MONITOR_PEAK_BLOCKS 2                                    /* number of blocks after the first one we use to find the full amplitude. */
+#define MONITOR_END_BLOCKS 2                                     /* number of blocks without the tone before it's over. */
+#define MONITOR_CHROMA_ON 48                                     /* distance of U or V from 128 of a tone color; the other plane must be closer. */
+
+/* ----------------------------------------------------------------------------------- */
+
+static void monitor_goertzel(video_generator_monitor* m, const int16_t* samples, uint32_t nframes);
+static void monitor_block(video_generator_monitor* m, uint32_t lane, uint64_t end);
+static void monitor_tone(video_generator_monitor* m, uint32_t tone, float amp, int found, double end_ms);
+static void monitor_event(video_generator_monitor* m, uint32_t type, uint32_t source, double ms);
+static double monitor_timestamp_ms(const video_generator_timestamp* ts);
+
+/* ----------------------------------------------------------------------------------- */
+
+int video_generator_monitor_init(video_generator_monitor* m, video_generator_settings* cfg, video_generator_monitor_callback callback, void* user) {
+
+  video_generator_settings gcfg;
+  video_generator gen;
+  uint32_t margin;
+
+  if (!m) { return -1; }
+  if (!cfg) { return -2; }
+  if (0 == cfg->bip_frequency || 0 == cfg->bop_frequency) {
+    printf("Error: the monitor needs the bip_frequency and bop_frequency.\n");
+    return -3;
+  }
+
+  /* we only need the position of the time box, so we create a plain generator of the same size. */
+  memset(&gcfg, 0x00, sizeof(gcfg));
+  gcfg.width = cfg->width;
+  gcfg.height = cfg->height;
+  gcfg.fps = (0 == cfg->fps) ? 25 : cfg->fps;
+
+  if (0 != video_generator_init(&gcfg, &gen)) {
+    printf("Error: cannot initialize the generator for the monitor.\n");
+    return -4;
+  }
+
+  memset(m, 0x00, sizeof(*m));
+  m->callback = callback;
+  m->user = user;
+
+  /* the patch sits in the top left margin of the box: away from the edge and from the text. */
+  margin = gen.text_margin / 2;
+  m->patch_x = (((gen.width / 2) - (gen.text_w / 2)) / 2) + 1;
+  m->patch_y = (((gen.height / 2) - (gen.text_h / 2)) / 2) + 1;
+  m->patch_w = (margin > 3) ? (margin - 2) : 1;
+  m->patch_h = m->patch_w;
+
+  video_generator_clear(&gen);
+
+  m->block_size = VIDEO_GENERATOR_MONITOR_SAMPLERATE / 100;
+  m->coeff[0] = m->coeff[2] = (float)(2.0 * cos((6.28318530718 / VIDEO_GENERATOR_MONITOR_SAMPLERATE) * cfg->bip_frequency));
+  m->coeff[1] = m->coeff[3] = (float)(2.0 * cos((6.28318530718 / VIDEO_GENERATOR_MONITOR_SAMPLERATE) * cfg->bop_frequency));
+
+  return 0;
+}
+
+int video_generator_monitor_clear(video_generator_monitor* m) {
+
+  video_generator_monitor_callback callback;
+  float coeff[4];
+  void* user;
+  uint32_t patch[4];
+
+  if (!m) { return -1; }
+
+  /* keep the settings, forget everything we've seen. */
+  callback = m->callback;
+  user = m->user;
+  patch[0] = m->patch_x;
+  patch[1] = m->patch_y;
+  patch[2] = m->patch_w;
+  patch[3] = m->patch_h;
+  memcpy(coeff, m->coeff, sizeof(coeff));
+
+  memset(m, 0x00, sizeof(*m));
+
+  m->callback = callback;
+  m->user = user;
+  m->patch_x = patch[0];
+  m->patch_y = patch[1];
+  m->patch_w = patch[2];
+  m->patch_h = patch[3];
+  m->block_size = VIDEO_GENERATOR_MONITOR_SAMPLERATE / 100;
+  memcpy(m->coeff, coeff, sizeof(coeff));
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+int video_generator_monitor_video(video_generator_monitor* m, uint8_t* planes[3], uint32_t strides[3], const video_generator_timestamp* ts) {
+
+  const uint8_t* u;
+  const uint8_t* v;
+  uint32_t sum_u = 0;
+  uint32_t sum_v = 0;
+  uint32_t state;
+  uint32_t i, j, n;
+  int du, dv;
+
+  if (!m) { return -1; }
+  if (!planes) { return -2; }
+  if (!strides) { return -3; }
+  if (!ts) { return -4; }
+  if (0 == m->block_size) { return -5; }
+
+  for (j = 0; j < m->patch_h; ++j) {
+    u = planes[1] + (m->patch_y + j) * strides[1] + m->patch_x;
+    v = planes[2] + (m->patch_y + j) * strides[2] + m->patch_x;
+    for (i = 0; i < m->patch_w; ++i) {
+      sum_u += u[i];
+      sum_v += v[i];
+    }
+  }
+
+  n = m->patch_w * m->patch_h;
+  du = (int)((sum_u + n / 2) / n) - 128;
+  dv = (int)((sum_v + n / 2) / n) - 128;
+
+  if (du > MONITOR_CHROMA_ON && abs(dv) < MONITOR_CHROMA_ON) {
+    state = VIDEO_GENERATOR_MONITOR_BIP;
+  }
+  else if (dv > MONITOR_CHROMA_ON && abs(du) < MONITOR_CHROMA_ON) {
+    state = VIDEO_GENERATOR_MONITOR_BOP;
+  }
+  else {
+    state = VIDEO_GENERATOR_MONITOR_NONE;
+  }
+
+  if (state != m->video_state && VIDEO_GENERATOR_MONITOR_NONE != state) {
+    monitor_event(m, state, 1, monitor_timestamp_ms(ts));
+  }
+
+  m->video_state = state;
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+/*
+  Runs the Goertzel filters. Block phase 0 covers samples [k * N, (k + 1) * N)
+  and phase 1 is shifted by N/2, so every N/2 samples one of the phases
+  finishes a block. Between two block ends all 4 filters see the same
+  samples, so we run them in one vector and only touch the finished lanes
+  at the block end.
+*/
+int video_generator_monitor_audio(video_generator_monitor* m, const int16_t* samples, uint32_t nframes, const video_generator_timestamp* ts) {
+
+  uint32_t half;
+  uint32_t todo;
+  uint32_t n;
+  uint64_t end;
+
+  if (!m) { return -1; }
+  if (!samples) { return -2; }
+  if (0 == m->block_size) { return -3; }
+
+  if (NULL != ts) {
+    m->audio_anchor = m->audio_nsamples;
+    m->audio_anchor_ms = monitor_timestamp_ms(ts);
+  }
+
+  half = m->block_size / 2;
+
+  while (nframes > 0) {
+
+    /* samples until the next block end. */
+    todo = (m->block_pos < half) ? (half - m->block_pos) : (m->block_size - m->block_pos);
+    n = (nframes < todo) ? nframes : todo;
+
+    monitor_goertzel(m, samples, n);
+
+    samples += n * VIDEO_GENERATOR_MONITOR_NCHANNELS;
+    nframes -= n;
+    m->block_pos += n;
+    m->audio_nsamples += n;
+    end = m->audio_nsamples;
+
+    if (half == m->block_pos) {
+      /* the first phase 1 block is only half a block. */
+      if (m->block_count > 0) {
+        monitor_block(m, 2, end);
+      }
+      else {
+        m->s1[2] = m->s1[3] = 0.0f;
+        m->s2[2] = m->s2[3] = 0.0f;
+        m->energy[2] = m->energy[3] = 0.0f;
+      }
+    }
+    else if (m->block_size == m->block_pos) {
+      monitor_block(m, 0, end);
+      m->block_pos = 0;
+      m->block_count++;
+    }
+  }
+
+  return 0;
+}
+
+/* Feeds the (mixed) samples into all 4 filters. */
+static void monitor_goertzel(video_generator_monitor* m, const int16_t* samples, uint32_t nframes) {
+
+  uint32_t i;
+
+#if defined(HAVE_SSE2)
+
+  __m128 coeff = _mm_loadu_ps(m->coeff);
+  __m128 s1 = _mm_loadu_ps(m->s1);
+  __m128 s2 = _mm_loadu_ps(m->s2);
+  __m128 energy = _mm_loadu_ps(m->energy);
+  __m128 x, s0;
+
+  for (i = 0; i < nframes; ++i) {
+    x = _mm_set1_ps(0.5f * ((float)samples[0] + (float)samples[1]));
+    s0 = _mm_sub_ps(_mm_add_ps(x, _mm_mul_ps(coeff, s1)), s2);
+    s2 = s1;
+    s1 = s0;
+    energy = _mm_add_ps(energy, _mm_mul_ps(x, x));
+    samples += VIDEO_GENERATOR_MONITOR_NCHANNELS;
+  }
+
+  _mm_storeu_ps(m->s1, s1);
+  _mm_storeu_ps(m->s2, s2);
+  _mm_storeu_ps(m->energy, energy);
+
+#else
+
+  uint32_t j;
+  float x, s0;
+
+  for (i = 0; i < nframes; ++i) {
+    x = 0.5f * ((float)samples[0] + (float)samples[1]);
+    for (j = 0; j < 4; ++j) {
+      s0 = x + m->coeff[j] * m->s1[j] - m->s2[j];
+      m->s2[j] = m->s1[j];
+      m->s1[j] = s0;
+      m->energy[j] += x * x;
+    }
+    samples += VIDEO_GENERATOR_MONITOR_NCHANNELS;
+  }
+
+#endif
+}
+
+/*
+  Evaluates the bip and bop filter of the block that ends at sample `end`
+  (lanes `lane` and `lane + 1`) and resets them for the next block.
+
+  For a tone with amplitude A the power of the filter is (A * N / 2)^2. When
+  the block is only partly filled with the tone the amplitude we measure
+  drops with the part that is missing, and the part of the energy that's in
+  the tone is a measure of how pure the tone is.
+*/
+static void monitor_block(video_generator_monitor* m, uint32_t lane, uint64_t end) {
+
+  double end_ms;
+  float power, amp, ratio;
+  float half = 0.5f * m->block_size;
+  uint32_t tone, j;
+
+  end_ms = m->audio_anchor_ms + ((double)(int64_t)(end - m->audio_anchor) * 1000.0) / VIDEO_GENERATOR_MONITOR_SAMPLERATE;
+
+  for (tone = 0; tone < 2; ++tone) {
+    j = lane + tone;
+    power = m->s1[j] * m->s1[j] + m->s2[j] * m->s2[j] - m->coeff[j] * m->s1[j] * m->s2[j];
+    power = (power > 0.0f) ? power : 0.0f;
+    amp = sqrtf(power) / half;
+    ratio = (m->energy[j] > 0.0f) ? (power / (half * m->energy[j])) : 0.0f;
+    monitor_tone(m, tone, amp, (amp > MONITOR_MIN_AMPLITUDE && ratio > MONITOR_MIN_RATIO), end_ms);
+    m->s1[j] = 0.0f;
+    m->s2[j] = 0.0f;
+    m->energy[j] = 0.0f;
+  }
+}
+
+/*
+  Finds the start of a tone. The first block that contains the tone tells
+  us where it ends, the next blocks give the full amplitude and the ratio
+  between the two how much of the first block was filled with the tone.
+*/
+static void monitor_tone(video_generator_monitor* m, uint32_t tone, float amp, int found, double end_ms) {
+
+  double filled;
+
+  switch (m->tone_state[tone]) {
+
+    case 0: {
+      if (found) {
+        m->tone_state[tone] = 1;
+        m->tone_nblocks[tone] = 0;
+        m->tone_first[tone] = amp;
+        m->tone_peak[tone] = amp;
+        m->tone_first_end_ms[tone] = end_ms;
+      }
+      break;
+    }
+
+    case 1: {
+      m->tone_peak[tone] = (amp > m->tone_peak[tone]) ? amp : m->tone_peak[tone];
+      m->tone_nblocks[tone]++;
+      if (m->tone_nblocks[tone] < MONITOR_PEAK_BLOCKS) {
+        break;
+      }
+      filled = m->tone_first[tone] / m->tone_peak[tone];
+      filled = (filled > 1.0) ? 1.0 : filled;
+      monitor_event(m,
+                    (0 == tone) ? VIDEO_GENERATOR_MONITOR_BIP : VIDEO_GENERATOR_MONITOR_BOP,
+                    0,
+                    m->tone_first_end_ms[tone] - (filled * m->block_size * 1000.0) / VIDEO_GENERATOR_MONITOR_SAMPLERATE);
+      m->tone_state[tone] = 2;
+      m->tone_nblocks[tone] = 0;
+      break;
+    }
+
+    case 2: {
+      m->tone_nblocks[tone] = (found) ? 0 : (m->tone_nblocks[tone] + 1);
+      if (m->tone_nblocks[tone] >= MONITOR_END_BLOCKS) {
+        m->tone_state[tone] = 0;
+      }
+      break;
+    }
+
+    default: {
+      break;
+    }
+  }
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+/* Pairs a tone (source 0) with a color change (source 1) and calls the callback. */
+static void monitor_event(video_generator_monitor* m, uint32_t type, uint32_t source, double ms) {
+
+  video_generator_monitor_event ev;
+  uint32_t tone = type - 1;
+  uint32_t other = 1 - source;
+
+  if (0 == m->pending[tone][other]
+      || fabs(m->pending_ms[tone][other] - ms) > VIDEO_GENERATOR_MONITOR_WINDOW_MS)
+    {
+      m->pending[tone][other] = 0;
+      m->pending[tone][source] = 1;
+      m->pending_ms[tone][source] = ms;
+      return;
+    }
+
+  ev.type = type;
+  ev.audio_ms = (0 == source) ? ms : m->pending_ms[tone][other];
+  ev.video_ms = (1 == source) ? ms : m->pending_ms[tone][other];
+  ev.offset_ms = ev.video_ms - ev.audio_ms;
+
+  m->pending[tone][0] = 0;
+  m->pending[tone][1] = 0;
+
+  m->offset_last_ms = ev.offset_ms;
+  m->offset_min_ms = (0 == m->nevents || ev.offset_ms < m->offset_min_ms) ? ev.offset_ms : m->offset_min_ms;
+  m->offset_max_ms = (0 == m->nevents || ev.offset_ms > m->offset_max_ms) ? ev.offset_ms : m->offset_max_ms;
+  m->nevents++;
+
+  if (NULL != m->callback) {
+    m->callback(&ev, m->user);
+  }
+}
+
+static double monitor_timestamp_ms(const video_generator_timestamp* ts) {
+
+  if (0 == ts->timebase_den) {
+    return 0.0;
+  }
+
+  return ((double)ts->pts * ts->timebase_num * 1000.0) / ts->timebase_den;
+}
+
+/* ----------------------------------------------------------------------------------- */
@@ -0,0 +1,131 @@
+/*
+
+  Video Generator - A/V Sync Monitor
+  ===================================
+
+  The generator plays a bip (after 1 second) and a bop (after 3 seconds)
+  every 4 seconds, and the time box turns blue for the bip and red for the
+  bop. The monitor finds both in the decoded stream and reports how far the
+  video is off: feed it every decoded audio buffer and every decoded frame
+  with their timestamps and it calls your callback with the A/V offset each
+  time it found a tone and the matching color change.
+
+  Audio: the tones are detected with Goertzel filters for the bip and bop
+  frequencies over blocks of 10 ms, which overlap by 5 ms. The onset of the
+  tone is interpolated within the first block from the amplitude it has
+  compared to the next blocks, so the audio time is accurate to well below a
+  millisecond. The filters of both tones and both block phases run in the 4
+  lanes of one SSE2 vector. The audio must be interleaved int16 at 44100hz;
+  the channels are mixed.
+
+  Video: only a small patch of the chroma planes in the corner of the time
+  box is read, so checking a frame costs about as much as reading a cache
+  line per row of the patch. The video time is the time of the first frame
+  with the new color, so it's accurate to a frame.
+
+  The offset is `video_ms - audio_ms`: positive when the video is late. The
+  generator itself changes the color at the first frame that starts at or 
+  after the first sample of the tone (see `video_generator_markers()`), so
+  a perfect capture shows an offset between 0 and one frame, and 0 when the
+  tone starts on a frame like the default bip and bop. A tone and a color 
+  change are only paired when they are less than 2 seconds apart.
+
+  Times are the timestamps you pass in, converted to milliseconds; use the
+  same clock for audio and video (e.g. the pts of the demuxer).
+
+     video_generator_monitor_init()     - set up the monitor for the settings of the generator that made the stream.
+     video_generator_monitor_audio()    - process decoded audio.
+     video_generator_monitor_video()    - process a decoded frame.
+     video_generator_monitor_clear()    - reset.
+
+  <example>
+
+     void on_event(const video_generator_monitor_event* ev, void* user) {
+       printf("%s: %.2f ms\n", (VIDEO_GENERATOR_MONITOR_BIP == ev->type) ? "bip" : "bop", ev->offset_ms);
+     }
+
+     video_generator_monitor_init(&mon, &cfg, on_event, NULL);
+
+     video_generator_monitor_audio(&mon, samples, nframes, &audio_ts);
+     video_generator_monitor_video(&mon, planes, strides, &video_ts);
+
+  </example>
+ */
+
+#ifndef VIDEO_GENERATOR_MONITOR_H
+#define VIDEO_GENERATOR_MONITOR_H
+
+#include <video_generator.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VIDEO_GENERATOR_MONITOR_NONE 0                           /* the time box has no tone color. */
+#define VIDEO_GENERATOR_MONITOR_BIP 1                            /* bip tone, blue time box. */
+#define VIDEO_GENERATOR_MONITOR_BOP 2                            /* bop tone, red time box. */
+#define VIDEO_GENERATOR_MONITOR_SAMPLERATE 44100                 /* samplerate of the audio. */
+#define VIDEO_GENERATOR_MONITOR_NCHANNELS 2                      /* number of interleaved channels. */
+#define VIDEO_GENERATOR_MONITOR_WINDOW_MS 2000.0                 /* max distance between a tone and a color change that are paired. */
+
+typedef struct video_generator_monitor video_generator_monitor;
+typedef struct video_generator_monitor_event video_generator_monitor_event;
+typedef void(*video_generator_monitor_callback)(const video_generator_monitor_event* ev, void* user);
+
+struct video_generator_monitor_event {
+  uint32_t type;                                                 /* VIDEO_GENERATOR_MONITOR_BIP or VIDEO_GENERATOR_MONITOR_BOP. */
+  double audio_ms;                                               /* start of the tone. */
+  double video_ms;                                               /* first frame with the color of the tone. */
+  double offset_ms;                                              /* video_ms - audio_ms, > 0 when the video is late. */
+};
+
+struct video_generator_monitor {
+
+  video_generator_monitor_callback callback;                     /* called for every event. */
+  void* user;                                                    /* passed into the callback. */
+
+  /* video */
+  uint32_t patch_x;                                              /* first chroma column of the patch we check. */
+  uint32_t patch_y;                                              /* first chroma row of the patch. */
+  uint32_t patch_w;                                              /* width of the patch in chroma samples. */
+  uint32_t patch_h;                                              /* height of the patch in chroma rows. */
+  uint32_t video_state;                                          /* VIDEO_GENERATOR_MONITOR_* color of the last frame. */
+
+  /* audio */
+  uint32_t block_size;                                           /* number of samples of a Goertzel block. */
+  uint32_t block_pos;                                            /* position in the current block of phase 0. */
+  uint32_t block_count;                                          /* number of blocks of phase 0 so far. */
+  float coeff[4];                                                /* 2 cos(w) of the bip, bop, bip, bop filter. */
+  float s1[4];                                                   /* filter state, lanes 0-1 block phase 0, lanes 2-3 phase 1. */
+  float s2[4];                                                   /* filter state. */
+  float energy[4];                                               /* sum of the squared samples of the block. */
+  uint32_t tone_state[2];                                        /* 0: no tone, 1: found the start, 2: in the tone. */
+  uint32_t tone_nblocks[2];                                      /* number of blocks since the state changed. */
+  float tone_first[2];                                           /* amplitude of the first block with the tone. */
+  float tone_peak[2];                                            /* largest amplitude of the next blocks. */
+  double tone_first_end_ms[2];                                   /* time of the end of the first block with the tone. */
+  double audio_anchor_ms;                                        /* time of sample `audio_anchor`. */
+  uint64_t audio_anchor;                                         /* sample index that belongs to the last timestamp. */
+  uint64_t audio_nsamples;                                       /* number of samples processed. */
+
+  /* pairing */
+  double pending_ms[2][2];                                       /* [tone][0 = audio, 1 = video] time of an unpaired event. */
+  uint8_t pending[2][2];                                         /* 1 when pending_ms is set. */
+
+  /* stats */
+  uint64_t nevents;                                              /* number of events. */
+  double offset_last_ms;                                         /* offset of the last event. */
+  double offset_min_ms;                                          /* smallest offset. */
+  double offset_max_ms;                                          /* largest offset. */
+};
+
+int video_generator_monitor_init(video_generator_monitor* m, video_generator_settings* cfg, video_generator_monitor_callback callback, void* user);
+int video_generator_monitor_audio(video_generator_monitor* m, const int16_t* samples, uint32_t nframes, const video_generator_timestamp* ts);
+int video_generator_monitor_video(video_generator_monitor* m, uint8_t* planes[3], uint32_t strides[3], const video_generator_timestamp* ts);
+int video_generator_monitor_clear(video_generator_monitor* m);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <video_generator_pool.h>
+
+#if defined(_WIN32)
+#  define pool_atomic_add(ptr, val) (InterlockedExchangeAdd((volatile LONG*)(ptr), (val)) + (val))
+#else
+#  define pool_atomic_add(ptr, val) __atomic_add_fetch((ptr), (val), __ATOMIC_ACQ_REL)
+#endif
+
+/* ----------------------------------------------------------------------------------- */
+
+int video_generator_pool_init(video_generator_pool* pool, video_generator* g, uint32_t depth, int mode) {
+
+  video_generator_frame* f;
+  uint8_t* base;
+  uint32_t i;
+
+  if (!pool) { return -1; }
+  if (!g) { return -2; }
+  if (!g->width) { return -3; }
+  if (depth < 1 || depth > VIDEO_GENERATOR_POOL_MAX_FRAMES) {
+    printf("Error: the depth of the frame pool must be between 1 and %d.\n", VIDEO_GENERATOR_POOL_MAX_FRAMES);
+    return -4;
+  }
+  if (VIDEO_GENERATOR_POOL_BLOCK != mode && VIDEO_GENERATOR_POOL_FAIL_FAST != mode) {
+    printf("Error: invalid frame pool mode: %d\n", mode);
+    return -5;
+  }
+
+  memset(pool, 0x00, sizeof(*pool));
+  pool->gen = g;
+  pool->mode = mode;
+  pool->nframes = depth;
+
+  /* every frame starts at a cache line. */
+  pool->frame_stride = (g->nbytes + 63) & ~63u;
+  pool->buffer = (uint8_t*)malloc((size_t)pool->frame_stride * depth + 63);
+  pool->frames = (video_generator_frame*)malloc(sizeof(video_generator_frame) * depth);
+  if (NULL == pool->buffer || NULL == pool->frames) {
+    printf("Error: cannot allocate the frame pool.\n");
+    free(pool->buffer);
+    free(pool->frames);
+    pool->buffer = NULL;
+    pool->frames = NULL;
+    return -6;
+  }
+
+  if (0 != mutex_init(&pool->mut)) {
+    printf("Error: cannot initialize the frame pool mutex.\n");
+    free(pool->buffer);
+    free(pool->frames);
+    pool->buffer = NULL;
+    pool->frames = NULL;
+    return -7;
+  }
+
+  if (0 != cond_init(&pool->available)) {
+    printf("Error: cannot initialize the frame pool condition variable.\n");
+    mutex_destroy(&pool->mut);
+    free(pool->buffer);
+    free(pool->frames);
+    pool->buffer = NULL;
+    pool->frames = NULL;
+    return -8;
+  }
+
+  base = (uint8_t*)(((uintptr_t)pool->buffer + 63) & ~(uintptr_t)63);
+
+  /* build the free list so the first frame is handed out first. */
+  for (i = depth; i > 0; --i) {
+    f = &pool->frames[i - 1];
+    memset(f, 0x00, sizeof(*f));
+    f->planes[0] = base + (size_t)(i - 1) * pool->frame_stride;
+    f->planes[1] = f->planes[0] + g->ybytes;
+    f->planes[2] = f->planes[1] + g->ubytes;
+    f->strides[0] = g->strides[0];
+    f->strides[1] = g->strides[1];
+    f->strides[2] = g->strides[2];
+    f->width = g->width;
+    f->height = g->height;
+    f->nbytes = g->nbytes;
+    f->index = i - 1;
+    f->pool = pool;
+    f->next = pool->free_frames;
+    pool->free_frames = f;
+  }
+
+  pool->nfree = depth;
+
+  return 0;
+}
+
+int video_generator_pool_acquire(video_generator_pool* pool, video_generator_frame** frame) {
+
+  video_generator_frame* f = NULL;
+  int r;
+
+  if (!pool) { return -1; }
+  if (!frame) { return -2; }
+  if (!pool->frames) { return -3; }
+
+  *frame = NULL;
+
+  mutex_lock(&pool->mut);
+  {
+    if (0 == pool->nfree) {
+      pool->nexhausted++;
+      if (VIDEO_GENERATOR_POOL_FAIL_FAST == pool->mode) {
+        mutex_unlock(&pool->mut);
+        return VIDEO_GENERATOR_POOL_EXHAUSTED;
+      }
+    }
+
+    while (0 == pool->nfree) {
+      cond_wait(&pool->available, &pool->mut);
+    }
+
+    f = pool->free_frames;
+    pool->free_frames = f->next;
+    pool->nfree--;
+  }
+  mutex_unlock(&pool->mut);
+
+  f->next = NULL;
+  f->refcount = 1;
+
+  video_generator_set_buffer(pool->gen, f->planes[0]);
+
+  r = video_generator_update(pool->gen);
+  if (0 != r) {
+    printf("Error: failed to render the frame of the pool: %d\n", r);
+    video_generator_frame_release(f);
+    return -4;
+  }
+
+  /* the frame counter is incremented by update. */
+  f->frame = pool->gen->frame - 1;
+  f->fault_flags = pool->gen->fault_flags;
+  f->timestamp = pool->gen->timestamp;
+  f->num_dirty_rects = pool->gen->num_dirty_rects;
+  memcpy(f->dirty_rects, pool->gen->dirty_rects, sizeof(video_generator_rect) * f->num_dirty_rects);
+  pool->nacquired++;
+
+  *frame = f;
+
+  return 0;
+}
+
+int video_generator_pool_clear(video_generator_pool* pool) {
+
+  video_generator* g;
+  uint8_t* base;
+  uint32_t nfree;
+
+  if (!pool) { return -1; }
+  if (!pool->frames) { return -2; }
+
+  /* the owners of a frame would use freed memory. */
+  mutex_lock(&pool->mut);
+  {
+    nfree = pool->nfree;
+  }
+  mutex_unlock(&pool->mut);
+
+  if (nfree != pool->nframes) {
+    printf("Error: cannot clear the frame pool while %u frame(s) are still in use.\n", pool->nframes - nfree);
+    return -3;
+  }
+
+  /* make sure the generator doesn't point into our memory anymore. */
+  g = pool->gen;
+  base = pool->frames[0].planes[0];
+  if (g->y >= base && g->y < base + (size_t)pool->frame_stride * pool->nframes) {
+    video_generator_set_buffer(g, NULL);
+  }
+
+  cond_destroy(&pool->available);
+  mutex_destroy(&pool->mut);
+
+  free(pool->buffer);
+  free(pool->frames);
+
+  pool->buffer = NULL;
+  pool->frames = NULL;
+  pool->free_frames = NULL;
+  pool->nframes = 0;
+  pool->nfree = 0;
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+int video_generator_frame_retain(video_generator_frame* frame) {
+
+  if (!frame) { return -1; }
+
+  if (pool_atomic_add(&frame->refcount, 1) <= 1) {
+    printf("Error: retaining a frame that was already released.\n");
+    return -2;
+  }
+
+  return 0;
+}
+
+int video_generator_frame_release(video_generator_frame* frame) {
+
+  video_generator_pool* pool;
+  int32_t count;
+
+  if (!frame) { return -1; }
+
+  count = pool_atomic_add(&frame->refcount, -1);
+  if (count > 0) {
+    return 0;
+  }
+
+  if (count < 0) {
+    printf("Error: releasing frame %u too often.\n", frame->index);
+    return -2;
+  }
+
+  /* last reference: back to the pool. */
+  pool = frame->pool;
+
+  mutex_lock(&pool->mut);
+  {
+    frame->next = pool->free_frames;
+    pool->free_frames = frame;
+    pool->nfree++;
+  }
+  mutex_unlock(&pool->mut);
+
+  cond_signal(&pool->available);
+
+  return 0;
+}
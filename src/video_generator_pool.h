@@ -0,0 +1,107 @@
+/*
+
+  Video Generator - Frame Pool
+  =============================
+
+  `video_generator_update()` renders into one buffer, so a consumer that
+  works asynchronously (an encoder with lookahead, a network sender) has to
+  copy every frame before the next update. The frame pool gives every frame
+  its own buffer instead: `video_generator_pool_acquire()` takes a free
+  buffer from the pool, renders the next frame into it and returns a
+  handle with a reference count of 1. Every thread that wants to keep the
+  frame calls `video_generator_frame_retain()` and every owner calls
+  `video_generator_frame_release()` when done. When the last reference is
+  released the buffer goes back to the pool.
+
+  All buffers are allocated in `video_generator_pool_init()`; nothing is
+  allocated while running. When all frames are in use, acquire() either
+  waits until a frame is released (VIDEO_GENERATOR_POOL_BLOCK) or returns
+  VIDEO_GENERATOR_POOL_EXHAUSTED immediately (VIDEO_GENERATOR_POOL_FAIL_FAST),
+  which is what a capture device does: it drops the frame.
+
+  Only one thread may call acquire(); retain() and release() can be called
+  from any thread. The generator renders into the pool buffers; while the
+  pool exists you should not call `video_generator_update()` yourself.
+
+     video_generator_pool_init()      - allocate `depth` frames for the given generator.
+     video_generator_pool_acquire()   - render the next frame into a free buffer.
+     video_generator_frame_retain()   - add a reference to a frame you already hold.
+     video_generator_frame_release()  - drop a reference, the last one returns the frame to the pool.
+     video_generator_pool_clear()     - free all memory. Release all frames first; when a frame 
+                                        is still in use nothing is freed and it returns < 0.
+
+  <example>
+
+     video_generator_pool pool;
+     video_generator_frame* frame;
+
+     video_generator_pool_init(&pool, &gen, 8, VIDEO_GENERATOR_POOL_BLOCK);
+
+     while (1) {
+       video_generator_pool_acquire(&pool, &frame);
+       encoder_push(frame);                       // encoder calls video_generator_frame_release() later.
+     }
+
+  </example>
+ */
+
+#ifndef VIDEO_GENERATOR_POOL_H
+#define VIDEO_GENERATOR_POOL_H
+
+#include <video_generator.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VIDEO_GENERATOR_POOL_BLOCK 0                             /* acquire() waits until a frame is released. */
+#define VIDEO_GENERATOR_POOL_FAIL_FAST 1                         /* acquire() returns VIDEO_GENERATOR_POOL_EXHAUSTED. */
+#define VIDEO_GENERATOR_POOL_EXHAUSTED 1                         /* acquire() found no free frame. */
+#define VIDEO_GENERATOR_POOL_MAX_FRAMES 256
+
+typedef struct video_generator_pool video_generator_pool;
+typedef struct video_generator_frame video_generator_frame;
+
+struct video_generator_frame {
+  uint8_t* planes[3];                                            /* y, u and v planes of this frame. */
+  uint32_t strides[3];                                           /* strides of the planes. */
+  uint32_t width;                                                /* width of the frame. */
+  uint32_t height;                                               /* height of the frame. */
+  uint32_t nbytes;                                               /* number of bytes of the planes. */
+  uint64_t frame;                                                /* the `frame` of the generator that was rendered. */
+  uint8_t fault_flags;                                           /* the `fault_flags` of the generator for this frame. */
+  video_generator_timestamp timestamp;                           /* the `timestamp` of the generator for this frame. */
+  video_generator_rect dirty_rects[VIDEO_GENERATOR_MAX_DIRTY_RECTS]; /* the `dirty_rects` of the generator for this frame. */
+  uint32_t num_dirty_rects;                                      /* number of elements in `dirty_rects`. */
+  volatile int32_t refcount;                                     /* number of owners, 0 when in the pool. */
+  uint32_t index;                                                /* index of the frame in the pool. */
+  video_generator_pool* pool;                                    /* the pool that owns this frame. */
+  video_generator_frame* next;                                   /* next free frame. */
+};
+
+struct video_generator_pool {
+  video_generator* gen;                                          /* the generator that renders into the frames. */
+  uint8_t* buffer;                                               /* memory of all frames. */
+  video_generator_frame* frames;                                 /* all frames. */
+  uint32_t nframes;                                              /* number of frames (depth). */
+  uint32_t frame_stride;                                         /* distance between the frames in `buffer`. */
+  int mode;                                                      /* VIDEO_GENERATOR_POOL_BLOCK or VIDEO_GENERATOR_POOL_FAIL_FAST. */
+  mutex mut;                                                     /* protects the free list. */
+  cond available;                                                /* signalled when a frame returns to the pool. */
+  video_generator_frame* free_frames;                            /* list with the free frames. */
+  uint32_t nfree;                                                /* number of free frames. */
+  uint64_t nacquired;                                            /* number of frames that were handed out. */
+  uint64_t nexhausted;                                           /* number of times acquire() found the pool empty. */
+};
+
+int video_generator_pool_init(video_generator_pool* pool, video_generator* g, uint32_t depth, int mode);
+int video_generator_pool_acquire(video_generator_pool* pool, video_generator_frame** frame);
+int video_generator_pool_clear(video_generator_pool* pool);
+int video_generator_frame_retain(video_generator_frame* frame);
+int video_generator_frame_release(video_generator_frame* frame);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,491 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <video_generator_rtp.h>
+
+#ifndef UDP_SEGMENT
+#  define UDP_SEGMENT 103
+#endif
+
+#define RTP_HEADER_SIZE 12
+#define RTP_VIDEO_HEADER_SIZE 20                 /* rtp header + extended sequence number + one sample row data header. */
+#define RTP_AUDIO_FRAMES_PER_PACKET 256
+
+/* ----------------------------------------------------------------------------------- */
+
+static int rtp_open(video_generator_rtp* rtp, const char* host, uint16_t port);
+static void rtp_write_header(uint8_t* p, video_generator_rtp* rtp, int marker, uint32_t ts);
+static uint32_t rtp_packetize(video_generator_rtp* rtp, video_generator* g, uint32_t dx, uint32_t ts, uint8_t* p);
+static int rtp_send_batch(video_generator_rtp* rtp, uint8_t* packets, uint32_t count);
+static uint64_t rtp_now();
+static void rtp_sleep_until(uint64_t t);
+
+/* ----------------------------------------------------------------------------------- */
+
+int video_generator_rtp_init_video(video_generator_rtp* rtp, const char* host, uint16_t port, video_generator* g) {
+
+  uint32_t max_pixels;
+  uint32_t ppp;
+  int r;
+
+  if (!rtp) { return -1; }
+  if (!host) { return -2; }
+  if (!g) { return -3; }
+  if (!g->width || (g->width & 1) || (g->height & 1)) { return -4; }
+
+  r = rtp_open(rtp, host, port);
+  if (0 != r) {
+    return r;
+  }
+
+  rtp->payload_type = 96;
+  rtp->clock_rate = 90000;
+  rtp->width = g->width;
+  rtp->height = g->height;
+  rtp->fps = g->fps_den;
+
+  /*
+     A pgroup of 6 bytes holds 2x2 pixels. We prefer a number of pixels per
+     packet that divides the width, so all packets have the same size and
+     can be sent with GSO. When that gives very small packets we fill them
+     and send the last packet of a line pair shorter.
+  */
+  max_pixels = (VIDEO_GENERATOR_RTP_MAX_PAYLOAD / 6) * 2;
+  max_pixels = (max_pixels > g->width) ? g->width : max_pixels;
+  for (ppp = max_pixels; ppp >= 2; ppp -= 2) {
+    if (0 == (g->width % ppp)) {
+      break;
+    }
+  }
+
+  if (ppp < max_pixels / 2) {
+    ppp = max_pixels;
+    rtp->use_gso = 0;
+  }
+  else {
+    rtp->use_gso = 1;
+  }
+
+  rtp->pixels_per_packet = ppp;
+  rtp->packets_per_line = (g->width + ppp - 1) / ppp;
+  rtp->npackets = rtp->packets_per_line * (g->height / 2);
+  rtp->packet_stride = RTP_VIDEO_HEADER_SIZE + ppp * 3;
+  rtp->packets = (uint8_t*)malloc(rtp->packet_stride * VIDEO_GENERATOR_RTP_BATCH);
+  rtp->packet_sizes = (uint16_t*)malloc(sizeof(uint16_t) * VIDEO_GENERATOR_RTP_BATCH);
+
+  if (NULL == rtp->packets || NULL == rtp->packet_sizes) {
+    video_generator_rtp_clear(rtp);
+    return -5;
+  }
+
+  if (1 == rtp->use_gso) {
+    r = rtp->packet_stride;
+    if (0 != setsockopt(rtp->fd, SOL_UDP, UDP_SEGMENT, &r, sizeof(r))) {
+      rtp->use_gso = 0;
+    }
+  }
+
+  return 0;
+}
+
+int video_generator_rtp_init_audio(video_generator_rtp* rtp, const char* host, uint16_t port, uint32_t samplerate, uint32_t nchannels) {
+
+  int r;
+
+  if (!rtp) { return -1; }
+  if (!host) { return -2; }
+  if (!samplerate) { return -3; }
+  if (!nchannels) { return -4; }
+
+  r = rtp_open(rtp, host, port);
+  if (0 != r) {
+    return r;
+  }
+
+  rtp->payload_type = 97;
+  rtp->clock_rate = samplerate;
+  rtp->nchannels = nchannels;
+  rtp->packet_stride = RTP_HEADER_SIZE + RTP_AUDIO_FRAMES_PER_PACKET * nchannels * sizeof(int16_t);
+  rtp->packets = (uint8_t*)malloc(rtp->packet_stride * VIDEO_GENERATOR_RTP_BATCH);
+  rtp->packet_sizes = (uint16_t*)malloc(sizeof(uint16_t) * VIDEO_GENERATOR_RTP_BATCH);
+
+  if (NULL == rtp->packets || NULL == rtp->packet_sizes) {
+    video_generator_rtp_clear(rtp);
+    return -5;
+  }
+
+  return 0;
+}
+
+/*
+  Sends the frame that was generated by the last call to `video_generator_update()`.
+  Batch `i` is scheduled at `start_ns + i * (frame interval / number of batches)`,
+  so the packets are spread over the frame interval instead of sent in one burst.
+*/
+int video_generator_rtp_send_video(video_generator_rtp* rtp, video_generator* g, uint64_t start_ns) {
+
+  uint64_t interval;
+  uint64_t due;
+  uint64_t now;
+  uint64_t err;
+  uint32_t ts;
+  uint32_t nbatches;
+  uint32_t batch;
+  uint32_t dx;
+  uint32_t count;
+  uint32_t i;
+
+  if (!rtp) { return -1; }
+  if (!rtp->packets) { return -2; }
+  if (!g) { return -3; }
+  if (0 == g->frame) { return -4; }
+  if (g->width != rtp->width || g->height != rtp->height) { return -5; }
+
+  ts = (uint32_t)(((g->frame - 1) * 90000ull) / rtp->fps);
+  interval = 1000000000ull / rtp->fps;
+  nbatches = (rtp->npackets + VIDEO_GENERATOR_RTP_BATCH - 1) / VIDEO_GENERATOR_RTP_BATCH;
+
+  for (batch = 0; batch < nbatches; ++batch) {
+
+    dx = batch * VIDEO_GENERATOR_RTP_BATCH;
+    count = rtp->npackets - dx;
+    count = (count > VIDEO_GENERATOR_RTP_BATCH) ? VIDEO_GENERATOR_RTP_BATCH : count;
+
+    for (i = 0; i < count; ++i) {
+      rtp->packet_sizes[i] = rtp_packetize(rtp, g, dx + i, ts, rtp->packets + i * rtp->packet_stride);
+    }
+
+    due = start_ns + (interval * batch) / nbatches;
+    now = rtp_now();
+    if (due > now) {
+      rtp_sleep_until(due);
+      now = rtp_now();
+    }
+
+    err = now - due;
+    if (now < due) {
+      err = due - now;
+    }
+
+    rtp->nbatches++;
+    rtp->pacing_error_total += err;
+    rtp->pacing_error_max = (err > rtp->pacing_error_max) ? err : rtp->pacing_error_max;
+
+    rtp_send_batch(rtp, rtp->packets, count);
+  }
+
+  return 0;
+}
+
+int video_generator_rtp_send_audio(video_generator_rtp* rtp, const int16_t* samples, uint32_t nframes, uint64_t sample) {
+
+  uint8_t* p;
+  uint32_t count = 0;
+  uint32_t n;
+  uint32_t i;
+  uint32_t nsamples;
+
+  if (!rtp) { return -1; }
+  if (!rtp->packets) { return -2; }
+  if (!samples) { return -3; }
+
+  while (nframes > 0) {
+
+    n = (nframes > RTP_AUDIO_FRAMES_PER_PACKET) ? RTP_AUDIO_FRAMES_PER_PACKET : nframes;
+    p = rtp->packets + count * rtp->packet_stride;
+    rtp_write_header(p, rtp, 0, (uint32_t)sample);
+
+    /* L16 is big endian. */
+    nsamples = n * rtp->nchannels;
+    for (i = 0; i < nsamples; ++i) {
+      p[RTP_HEADER_SIZE + i * 2 + 0] = ((uint16_t)samples[i] >> 8) & 0xff;
+      p[RTP_HEADER_SIZE + i * 2 + 1] = ((uint16_t)samples[i] >> 0) & 0xff;
+    }
+
+    rtp->packet_sizes[count] = RTP_HEADER_SIZE + nsamples * 2;
+    rtp->nframes_sent += n;
+    sample += n;
+    samples += nsamples;
+    nframes -= n;
+    count++;
+
+    if (VIDEO_GENERATOR_RTP_BATCH == count || 0 == nframes) {
+      rtp_send_batch(rtp, rtp->packets, count);
+      count = 0;
+    }
+  }
+
+  return 0;
+}
+
+int video_generator_rtp_print_sdp(FILE* fp, video_generator_rtp* video, video_generator_rtp* audio) {
+
+  const char* host = NULL;
+
+  if (!fp) { return -1; }
+
+  host = (NULL != video) ? video->host : (NULL != audio) ? audio->host : NULL;
+  if (NULL == host) {
+    return -2;
+  }
+
+  fprintf(fp,
+          "v=0\n"
+          "o=- 0 0 IN IP4 %s\n"
+          "s=video_generator\n"
+          "c=IN IP4 %s\n"
+          "t=0 0\n",
+          host, host);
+
+  if (NULL != video) {
+    fprintf(fp,
+            "m=video %u RTP/AVP %u\n"
+            "a=rtpmap:%u raw/90000\n"
+            "a=fmtp:%u sampling=YCbCr-4:2:0; width=%u; height=%u; depth=8; colorimetry=BT601-5; exactframerate=%u\n",
+            video->port, video->payload_type,
+            video->payload_type,
+            video->payload_type, video->width, video->height, video->fps);
+  }
+
+  if (NULL != audio) {
+    fprintf(fp,
+            "m=audio %u RTP/AVP %u\n"
+            "a=rtpmap:%u L16/%u/%u\n",
+            audio->port, audio->payload_type,
+            audio->payload_type, audio->clock_rate, audio->nchannels);
+  }
+
+  return 0;
+}
+
+int video_generator_rtp_clear(video_generator_rtp* rtp) {
+
+  if (!rtp) { return -1; }
+
+  if (rtp->fd >= 0) {
+    close(rtp->fd);
+  }
+
+  if (NULL != rtp->packets) {
+    free(rtp->packets);
+  }
+
+  if (NULL != rtp->packet_sizes) {
+    free(rtp->packet_sizes);
+  }
+
+  rtp->fd = -1;
+  rtp->packets = NULL;
+  rtp->packet_sizes = NULL;
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static int rtp_open(video_generator_rtp* rtp, const char* host, uint16_t port) {
+
+  struct addrinfo hints;
+  struct addrinfo* res = NULL;
+  char port_str[16];
+  int sndbuf;
+
+  memset(rtp, 0x00, sizeof(*rtp));
+  rtp->fd = -1;
+
+  if (strlen(host) >= sizeof(rtp->host)) {
+    return -10;
+  }
+
+  memset(&hints, 0x00, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  snprintf(port_str, sizeof(port_str), "%u", port);
+
+  if (0 != getaddrinfo(host, port_str, &hints, &res) || NULL == res) {
+    printf("Error: cannot resolve %s.\n", host);
+    return -11;
+  }
+
+  memcpy(&rtp->addr, res->ai_addr, res->ai_addrlen);
+  rtp->addr_len = res->ai_addrlen;
+  rtp->fd = socket(res->ai_family, SOCK_DGRAM, 0);
+  freeaddrinfo(res);
+
+  if (rtp->fd < 0) {
+    printf("Error: cannot create the udp socket: %s\n", strerror(errno));
+    return -12;
+  }
+
+  if (0 != connect(rtp->fd, (struct sockaddr*)&rtp->addr, rtp->addr_len)) {
+    printf("Error: cannot connect the udp socket: %s\n", strerror(errno));
+    close(rtp->fd);
+    rtp->fd = -1;
+    return -13;
+  }
+
+  /* a large send buffer so a batch never blocks. */
+  sndbuf = 4 * 1024 * 1024;
+  setsockopt(rtp->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+  strcpy(rtp->host, host);
+  rtp->port = port;
+  rtp->ssrc = (uint32_t)(rtp_now() ^ ((uint64_t)getpid() << 16) ^ port);
+  rtp->seq = rtp->ssrc * 2654435761u;
+
+  return 0;
+}
+
+static void rtp_write_header(uint8_t* p, video_generator_rtp* rtp, int marker, uint32_t ts) {
+  p[0] = 0x80;
+  p[1] = (marker ? 0x80 : 0x00) | (rtp->payload_type & 0x7f);
+  p[2] = (rtp->seq >> 8) & 0xff;
+  p[3] = (rtp->seq >> 0) & 0xff;
+  p[4] = (ts >> 24) & 0xff;
+  p[5] = (ts >> 16) & 0xff;
+  p[6] = (ts >> 8) & 0xff;
+  p[7] = (ts >> 0) & 0xff;
+  p[8] = (rtp->ssrc >> 24) & 0xff;
+  p[9] = (rtp->ssrc >> 16) & 0xff;
+  p[10] = (rtp->ssrc >> 8) & 0xff;
+  p[11] = (rtp->ssrc >> 0) & 0xff;
+}
+
+/* Writes packet `dx` of the frame: RFC 4175 headers and the 4:2:0 pgroups Y00 Y01 Y10 Y11 Cb Cr. Returns the packet size. */
+static uint32_t rtp_packetize(video_generator_rtp* rtp, video_generator* g, uint32_t dx, uint32_t ts, uint8_t* p) {
+
+  uint32_t line = (dx / rtp->packets_per_line) * 2;
+  uint32_t x = (dx % rtp->packets_per_line) * rtp->pixels_per_packet;
+  uint32_t npixels = rtp->width - x;
+  uint32_t length;
+  uint32_t i;
+  const uint8_t* y0;
+  const uint8_t* y1;
+  const uint8_t* u;
+  const uint8_t* v;
+  uint8_t* out;
+
+  npixels = (npixels > rtp->pixels_per_packet) ? rtp->pixels_per_packet : npixels;
+  length = npixels * 3;
+
+  rtp_write_header(p, rtp, (dx == rtp->npackets - 1) ? 1 : 0, ts);
+  p[12] = (rtp->seq >> 24) & 0xff;
+  p[13] = (rtp->seq >> 16) & 0xff;
+  p[14] = (length >> 8) & 0xff;
+  p[15] = (length >> 0) & 0xff;
+  p[16] = (line >> 8) & 0x7f;
+  p[17] = (line >> 0) & 0xff;
+  p[18] = (x >> 8) & 0x7f;
+  p[19] = (x >> 0) & 0xff;
+  rtp->seq++;
+
+  y0 = g->y + line * g->strides[0] + x;
+  y1 = y0 + g->strides[0];
+  u = g->u + (line / 2) * g->strides[1] + x / 2;
+  v = g->v + (line / 2) * g->strides[2] + x / 2;
+  out = p + RTP_VIDEO_HEADER_SIZE;
+
+  for (i = 0; i < npixels / 2; ++i) {
+    out[0] = y0[0];
+    out[1] = y0[1];
+    out[2] = y1[0];
+    out[3] = y1[1];
+    out[4] = u[i];
+    out[5] = v[i];
+    out += 6;
+    y0 += 2;
+    y1 += 2;
+  }
+
+  return RTP_VIDEO_HEADER_SIZE + length;
+}
+
+static int rtp_send_batch(video_generator_rtp* rtp, uint8_t* packets, uint32_t count) {
+
+  struct mmsghdr msgs[VIDEO_GENERATOR_RTP_BATCH];
+  struct iovec iov[VIDEO_GENERATOR_RTP_BATCH];
+  uint32_t sent = 0;
+  uint32_t nbytes = 0;
+  uint32_t i;
+  int r;
+
+  for (i = 0; i < count; ++i) {
+    nbytes += rtp->packet_sizes[i];
+  }
+
+  if (1 == rtp->use_gso && count > 1) {
+    /* all packets are `packet_stride` bytes, the kernel splits them. */
+    iov[0].iov_base = packets;
+    iov[0].iov_len = count * rtp->packet_stride;
+    memset(&msgs[0], 0x00, sizeof(msgs[0]));
+    msgs[0].msg_hdr.msg_iov = iov;
+    msgs[0].msg_hdr.msg_iovlen = 1;
+    r = sendmsg(rtp->fd, &msgs[0].msg_hdr, 0);
+    if (r < 0) {
+      if (EIO == errno || EINVAL == errno) {
+        /* no GSO for this route (e.g. checksum offload not available), fall back. */
+        rtp->use_gso = 0;
+        return rtp_send_batch(rtp, packets, count);
+      }
+      rtp->send_errors += count;
+      return -1;
+    }
+    sent = count;
+  }
+  else {
+    for (i = 0; i < count; ++i) {
+      iov[i].iov_base = packets + i * rtp->packet_stride;
+      iov[i].iov_len = rtp->packet_sizes[i];
+      memset(&msgs[i], 0x00, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (sent < count) {
+      r = sendmmsg(rtp->fd, msgs + sent, count - sent, 0);
+      if (r <= 0) {
+        if (r < 0 && EINTR == errno) {
+          continue;
+        }
+        /* e.g. ECONNREFUSED when nobody listens on loopback; we keep sending. */
+        rtp->send_errors += count - sent;
+        break;
+      }
+      sent += r;
+    }
+  }
+
+  rtp->last_send_ns = rtp_now();
+  if (0 == rtp->first_send_ns) {
+    rtp->first_send_ns = rtp->last_send_ns;
+  }
+
+  rtp->packets_sent += sent;
+  rtp->bytes_sent += (sent == count) ? nbytes : 0;
+
+  return (sent == count) ? 0 : -2;
+}
+
+static uint64_t rtp_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void rtp_sleep_until(uint64_t t) {
+  struct timespec ts;
+  ts.tv_sec = t / 1000000000ull;
+  ts.tv_nsec = t % 1000000000ull;
+  while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+  }
+}
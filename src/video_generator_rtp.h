@@ -0,0 +1,109 @@
+/*
+
+  Video Generator - RTP sender
+  =============================
+
+  Sends the generated video as RFC 4175 raw video (YCbCr-4:2:0, 8 bit) and
+  the audio as L16 over RTP/UDP, so the generator can act as a local live
+  source, e.g. on 127.0.0.1, for encoders with network ingest.
+
+  Video: the packets of a frame are spread evenly over the frame interval,
+  in small batches that are sent with one sendmmsg() call, or with one UDP
+  GSO send (UDP_SEGMENT) when the kernel supports it and all packets have
+  the same size. Every packet carries the pixels of a part of one line pair;
+  the timestamp is based on the frame number, using a 90khz clock.
+
+  Audio: call `video_generator_rtp_send_audio()` from your audio callback
+  with the `sample` of its timestamp. The samples are split into packets of
+  at most 256 frames. The RTP timestamp is the sample index of the first 
+  frame in the packet, so it stays in sync with the video when the audio 
+  thread skips a period or delivers one twice.
+
+  The sender keeps some statistics: the achieved packet rate and the pacing
+  error, which is the difference between the moment we wanted to send a
+  batch and the moment we actually sent it.
+
+  This sender is only available on Linux.
+
+     video_generator_rtp_init_video()   - create a video sender for the generator.
+     video_generator_rtp_init_audio()   - create an audio sender.
+     video_generator_rtp_send_video()   - packetize the last generated frame and send it, paced
+                                          over the frame interval starting at `start_ns`
+                                          (CLOCK_MONOTONIC). Returns after the last packet was sent.
+     video_generator_rtp_send_audio()   - send audio samples (interleaved, int16); `sample` is the
+                                          index of the first frame, e.g. `ts->sample` of the callback.
+     video_generator_rtp_print_sdp()    - print a SDP file that describes the stream(s).
+     video_generator_rtp_clear()        - close the socket and free memory.
+
+ */
+
+#ifndef VIDEO_GENERATOR_RTP_H
+#define VIDEO_GENERATOR_RTP_H
+
+#include <stdio.h>
+#include <sys/socket.h>
+#include <video_generator.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VIDEO_GENERATOR_RTP_MAX_PAYLOAD 1452                     /* 1500 MTU - IPv4 - UDP - RTP - extended seq - one SRD header. */
+#define VIDEO_GENERATOR_RTP_BATCH 16                             /* number of packets we send at once. */
+
+typedef struct video_generator_rtp video_generator_rtp;
+
+struct video_generator_rtp {
+
+  /* socket */
+  int fd;                                                        /* the udp socket. */
+  struct sockaddr_storage addr;                                  /* destination address. */
+  socklen_t addr_len;                                            /* size of `addr`. */
+  char host[64];                                                 /* destination host, used for the SDP. */
+  uint16_t port;                                                 /* destination port. */
+
+  /* rtp */
+  uint32_t ssrc;                                                 /* synchronization source, random. */
+  uint32_t seq;                                                  /* sequence number, video uses the 32 bit extended sequence number. */
+  uint8_t payload_type;                                          /* 96 for video, 97 for audio. */
+  uint32_t clock_rate;                                           /* 90000 for video, samplerate for audio. */
+
+  /* video */
+  uint32_t width;                                                /* width of the frames. */
+  uint32_t height;                                               /* height of the frames. */
+  uint32_t fps;                                                  /* framerate. */
+  uint32_t pixels_per_packet;                                    /* number of pixels of a line pair in one packet. */
+  uint32_t packets_per_line;                                     /* number of packets per line pair. */
+  uint32_t packet_stride;                                        /* distance between packets in `packets`. */
+  uint32_t npackets;                                             /* number of packets per frame. */
+  uint8_t* packets;                                              /* the packets of one frame. */
+  uint16_t* packet_sizes;                                        /* size of each packet. */
+  int use_gso;                                                   /* 1 when all packets have the same size and UDP_SEGMENT works. */
+
+  /* audio */
+  uint32_t nchannels;                                            /* number of audio channels. */
+  uint64_t nframes_sent;                                         /* number of audio frames sent. */
+
+  /* stats */
+  uint64_t packets_sent;                                         /* total number of packets sent. */
+  uint64_t bytes_sent;                                           /* total number of bytes sent, including the rtp headers. */
+  uint64_t send_errors;                                          /* number of failed sends. */
+  uint64_t nbatches;                                             /* number of paced batches. */
+  uint64_t pacing_error_total;                                   /* sum of all pacing errors in ns. */
+  uint64_t pacing_error_max;                                     /* largest pacing error in ns. */
+  uint64_t first_send_ns;                                        /* time of the first send. */
+  uint64_t last_send_ns;                                         /* time of the last send. */
+};
+
+int video_generator_rtp_init_video(video_generator_rtp* rtp, const char* host, uint16_t port, video_generator* g);
+int video_generator_rtp_init_audio(video_generator_rtp* rtp, const char* host, uint16_t port, uint32_t samplerate, uint32_t nchannels);
+int video_generator_rtp_send_video(video_generator_rtp* rtp, video_generator* g, uint64_t start_ns);
+int video_generator_rtp_send_audio(video_generator_rtp* rtp, const int16_t* samples, uint32_t nframes, uint64_t sample);
+int video_generator_rtp_print_sdp(FILE* fp, video_generator_rtp* video, video_generator_rtp* audio);
+int video_generator_rtp_clear(video_generator_rtp* rtp);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
+
+#endif
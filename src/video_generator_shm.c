@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <video_generator_shm.h>
+
+#define VIDEO_GENERATOR_SHM_MAGIC 0x56475348 /* VGSH */
+#define VIDEO_GENERATOR_SHM_VERSION 2
+#define VIDEO_GENERATOR_SHM_BUSY UINT64_MAX
+
+/* ----------------------------------------------------------------------------------- */
+
+static int futex_wait(uint32_t* addr, uint32_t val, int timeout_ms);
+static int futex_wake(uint32_t* addr);
+static void shm_fill_frame(video_generator_shm* shm, uint64_t seq, video_generator_shm_frame* frame);
+
+/* ----------------------------------------------------------------------------------- */
+/*                          P R O D U C E R                                            */
+/* ----------------------------------------------------------------------------------- */
+
+int video_generator_shm_create(video_generator_shm* shm, const char* name, video_generator* g, uint32_t nslots) {
+
+  long page_size;
+  uint64_t slot_stride;
+  uint64_t slot_offset;
+  video_generator_shm_header* h;
+  uint32_t i;
+
+  if (!shm) { return -1; }
+  if (!name) { return -2; }
+  if (!g) { return -3; }
+  if (!g->width) { return -4; }
+  if (nslots < 2 || nslots > VIDEO_GENERATOR_SHM_MAX_SLOTS) {
+    printf("Error: the number of shm slots must be between 2 and %d.\n", VIDEO_GENERATOR_SHM_MAX_SLOTS);
+    return -5;
+  }
+
+  if (strlen(name) >= sizeof(shm->name)) { return -6; }
+
+  memset(shm, 0x00, sizeof(*shm));
+  strcpy(shm->name, name);
+  shm->fd = -1;
+  shm->is_producer = 1;
+  shm->gen = g;
+
+  /* each slot starts at a page boundary. */
+  page_size = sysconf(_SC_PAGESIZE);
+  page_size = (page_size > 0) ? page_size : 4096;
+  slot_stride = ((g->nbytes + page_size - 1) / page_size) * page_size;
+  slot_offset = ((sizeof(video_generator_shm_header) + page_size - 1) / page_size) * page_size;
+  shm->nbytes = slot_offset + slot_stride * nslots;
+
+  /* never take over the segment of another producer, see video_generator_shm_remove(). */
+  shm->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (shm->fd < 0 && EEXIST == errno) {
+    printf("Error: the shared memory segment %s already exists, is another producer running?\n", name);
+    return -10;
+  }
+  if (shm->fd < 0) {
+    printf("Error: cannot create the shared memory segment %s: %s\n", name, strerror(errno));
+    return -7;
+  }
+
+  if (0 != ftruncate(shm->fd, shm->nbytes)) {
+    printf("Error: cannot resize the shared memory segment: %s\n", strerror(errno));
+    video_generator_shm_destroy(shm);
+    return -8;
+  }
+
+  shm->base = (uint8_t*)mmap(NULL, shm->nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+  if (MAP_FAILED == shm->base) {
+    printf("Error: cannot map the shared memory segment: %s\n", strerror(errno));
+    shm->base = NULL;
+    video_generator_shm_destroy(shm);
+    return -9;
+  }
+
+  h = (video_generator_shm_header*)shm->base;
+  h->version = VIDEO_GENERATOR_SHM_VERSION;
+  h->width = g->width;
+  h->height = g->height;
+  h->fps_num = g->fps_num;
+  h->fps_den = g->fps_den;
+  h->nslots = nslots;
+  h->frame_nbytes = g->nbytes;
+  h->slot_offset = slot_offset;
+  h->slot_stride = slot_stride;
+  h->is_open = 1;
+  h->futex = 0;
+  h->write_seq = 0;
+
+  for (i = 0; i < VIDEO_GENERATOR_SHM_MAX_SLOTS; ++i) {
+    memset(&h->slots[i], 0x00, sizeof(h->slots[i]));
+    h->slots[i].seq = VIDEO_GENERATOR_SHM_BUSY;
+  }
+
+  /* consumers check the magic last. */
+  __atomic_store_n(&h->magic, VIDEO_GENERATOR_SHM_MAGIC, __ATOMIC_RELEASE);
+  shm->header = h;
+
+  return 0;
+}
+
+/*
+   Renders the next frame directly into the next slot. The slot is marked
+   as busy first so a consumer that is still reading the frame that was in
+   this slot will see the overrun when it releases the frame.
+*/
+int video_generator_shm_update(video_generator_shm* shm, video_generator* g) {
+
+  video_generator_shm_header* h;
+  video_generator_shm_slot* slot;
+  uint64_t seq;
+  int r;
+
+  if (!shm) { return -1; }
+  if (!shm->header) { return -2; }
+  if (!g) { return -3; }
+
+  h = shm->header;
+  seq = h->write_seq;
+  slot = &h->slots[seq % h->nslots];
+
+  __atomic_store_n(&slot->seq, VIDEO_GENERATOR_SHM_BUSY, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+  video_generator_set_buffer(g, shm->base + h->slot_offset + (seq % h->nslots) * h->slot_stride);
+
+  r = video_generator_update(g);
+  if (0 != r) {
+    return r;
+  }
+
+  /* after the update: a dropped frame changes the frame number. */
+  slot->frame = (uint64_t)g->timestamp.pts;
+  slot->timestamp = g->timestamp;
+  slot->fault_flags = g->fault_flags;
+  slot->num_dirty_rects = g->num_dirty_rects;
+  memcpy(slot->dirty_rects, g->dirty_rects, sizeof(video_generator_rect) * g->num_dirty_rects);
+
+  __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+  __atomic_store_n(&h->write_seq, seq + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&h->futex, (uint32_t)(seq + 1), __ATOMIC_RELEASE);
+  futex_wake(&h->futex);
+
+  return 0;
+}
+
+int video_generator_shm_destroy(video_generator_shm* shm) {
+
+  if (!shm) { return -1; }
+
+  if (NULL != shm->header) {
+    __atomic_store_n(&shm->header->is_open, 0, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&shm->header->futex, 1, __ATOMIC_RELEASE);
+    futex_wake(&shm->header->futex);
+  }
+
+  /* make sure the generator doesn't render into the slots anymore. */
+  if (NULL != shm->base
+      && NULL != shm->gen
+      && shm->gen->y >= shm->base
+      && shm->gen->y < shm->base + shm->nbytes)
+    {
+      video_generator_set_buffer(shm->gen, NULL);
+    }
+
+  if (NULL != shm->base) {
+    munmap(shm->base, shm->nbytes);
+  }
+
+  if (shm->fd >= 0) {
+    close(shm->fd);
+    shm_unlink(shm->name);
+  }
+
+  shm->base = NULL;
+  shm->header = NULL;
+  shm->gen = NULL;
+  shm->fd = -1;
+  shm->nbytes = 0;
+
+  return 0;
+}
+
+/* Removes a segment that was left behind by a producer that didn't call destroy(), e.g. because it crashed. */
+int video_generator_shm_remove(const char* name) {
+
+  if (!name) { return -1; }
+
+  if (0 != shm_unlink(name) && ENOENT != errno) {
+    printf("Error: cannot remove the shared memory segment %s: %s\n", name, strerror(errno));
+    return -2;
+  }
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+/*                          C O N S U M E R                                            */
+/* ----------------------------------------------------------------------------------- */
+
+int video_generator_shm_open(video_generator_shm* shm, const char* name) {
+
+  struct stat st;
+  video_generator_shm_header* h;
+
+  if (!shm) { return -1; }
+  if (!name) { return -2; }
+  if (strlen(name) >= sizeof(shm->name)) { return -3; }
+
+  memset(shm, 0x00, sizeof(*shm));
+  strcpy(shm->name, name);
+  shm->is_producer = 0;
+
+  shm->fd = shm_open(name, O_RDWR, 0600);
+  if (shm->fd < 0) {
+    printf("Error: cannot open the shared memory segment %s: %s\n", name, strerror(errno));
+    return -4;
+  }
+
+  if (0 != fstat(shm->fd, &st) || st.st_size < (off_t)sizeof(video_generator_shm_header)) {
+    printf("Error: the shared memory segment %s is too small.\n", name);
+    video_generator_shm_close(shm);
+    return -5;
+  }
+
+  /* we need write access for the futex word only, but the mapping is shared anyway. */
+  shm->nbytes = st.st_size;
+  shm->base = (uint8_t*)mmap(NULL, shm->nbytes, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+  if (MAP_FAILED == shm->base) {
+    printf("Error: cannot map the shared memory segment: %s\n", strerror(errno));
+    shm->base = NULL;
+    video_generator_shm_close(shm);
+    return -6;
+  }
+
+  h = (video_generator_shm_header*)shm->base;
+  if (VIDEO_GENERATOR_SHM_MAGIC != __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE)
+      || VIDEO_GENERATOR_SHM_VERSION != h->version
+      || h->slot_offset + h->slot_stride * h->nslots > shm->nbytes)
+    {
+      printf("Error: %s is not a (compatible) video generator segment.\n", name);
+      video_generator_shm_close(shm);
+      return -7;
+    }
+
+  shm->header = h;
+
+  /* start at the newest frame. */
+  shm->read_seq = __atomic_load_n(&h->write_seq, __ATOMIC_ACQUIRE);
+  shm->overruns = 0;
+
+  return 0;
+}
+
+/*
+  Waits for frame `read_seq`. When the producer is more than nslots - 1
+  frames ahead, the frames in between are lost: they're counted in
+  `overruns` and we continue with the oldest frame that is still valid.
+
+  @return 0 on success, VIDEO_GENERATOR_SHM_TIMEOUT, VIDEO_GENERATOR_SHM_CLOSED
+          or < 0 on error.
+*/
+int video_generator_shm_acquire(video_generator_shm* shm, video_generator_shm_frame* frame, int timeout_ms) {
+
+  video_generator_shm_header* h;
+  uint64_t write_seq;
+  uint64_t oldest;
+  uint64_t slot_seq;
+  uint32_t futex_val;
+
+  if (!shm) { return -1; }
+  if (!shm->header) { return -2; }
+  if (!frame) { return -3; }
+
+  h = shm->header;
+
+  while (1) {
+
+    futex_val = __atomic_load_n(&h->futex, __ATOMIC_ACQUIRE);
+    write_seq = __atomic_load_n(&h->write_seq, __ATOMIC_ACQUIRE);
+
+    if (write_seq > shm->read_seq) {
+      break;
+    }
+
+    if (0 == __atomic_load_n(&h->is_open, __ATOMIC_ACQUIRE)) {
+      return VIDEO_GENERATOR_SHM_CLOSED;
+    }
+
+    if (0 != futex_wait(&h->futex, futex_val, timeout_ms)) {
+      if (write_seq == __atomic_load_n(&h->write_seq, __ATOMIC_ACQUIRE)) {
+        return VIDEO_GENERATOR_SHM_TIMEOUT;
+      }
+    }
+  }
+
+  /* the slot of frame `write_seq` is (or will be) written now. */
+  oldest = (write_seq >= h->nslots) ? (write_seq - h->nslots + 1) : 0;
+  if (shm->read_seq < oldest) {
+    shm->overruns += oldest - shm->read_seq;
+    shm->read_seq = oldest;
+  }
+
+  slot_seq = __atomic_load_n(&h->slots[shm->read_seq % h->nslots].seq, __ATOMIC_ACQUIRE);
+  if (slot_seq != shm->read_seq) {
+    /* the producer passed us while we were looking; continue with the newest frame. */
+    shm->overruns += (write_seq - 1) - shm->read_seq;
+    shm->read_seq = write_seq - 1;
+  }
+
+  shm_fill_frame(shm, shm->read_seq, frame);
+  shm->read_seq++;
+
+  return 0;
+}
+
+int video_generator_shm_release(video_generator_shm* shm, video_generator_shm_frame* frame) {
+
+  video_generator_shm_header* h;
+  uint64_t slot_seq;
+
+  if (!shm) { return -1; }
+  if (!shm->header) { return -2; }
+  if (!frame) { return -3; }
+
+  h = shm->header;
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  slot_seq = __atomic_load_n(&h->slots[frame->seq % h->nslots].seq, __ATOMIC_ACQUIRE);
+  if (slot_seq != frame->seq) {
+    shm->overruns++;
+    return VIDEO_GENERATOR_SHM_OVERRUN;
+  }
+
+  return 0;
+}
+
+int video_generator_shm_close(video_generator_shm* shm) {
+
+  if (!shm) { return -1; }
+
+  if (NULL != shm->base) {
+    munmap(shm->base, shm->nbytes);
+  }
+
+  if (shm->fd >= 0) {
+    close(shm->fd);
+  }
+
+  shm->base = NULL;
+  shm->header = NULL;
+  shm->fd = -1;
+  shm->nbytes = 0;
+
+  return 0;
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+static void shm_fill_frame(video_generator_shm* shm, uint64_t seq, video_generator_shm_frame* frame) {
+
+  video_generator_shm_header* h = shm->header;
+  video_generator_shm_slot* slot = &h->slots[seq % h->nslots];
+  uint8_t* data = shm->base + h->slot_offset + (seq % h->nslots) * h->slot_stride;
+  uint32_t ybytes = h->width * h->height;
+  uint32_t ubytes = (h->width / 2) * (h->height / 2);
+
+  frame->seq = seq;
+  frame->frame = slot->frame;
+  frame->timestamp = slot->timestamp;
+  frame->fault_flags = slot->fault_flags;
+  frame->num_dirty_rects = (slot->num_dirty_rects > VIDEO_GENERATOR_MAX_DIRTY_RECTS) ? VIDEO_GENERATOR_MAX_DIRTY_RECTS : slot->num_dirty_rects;
+  memcpy(frame->dirty_rects, slot->dirty_rects, sizeof(video_generator_rect) * frame->num_dirty_rects);
+  frame->width = h->width;
+  frame->height = h->height;
+  frame->planes[0] = data;
+  frame->planes[1] = data + ybytes;
+  frame->planes[2] = data + ybytes + ubytes;
+  frame->strides[0] = h->width;
+  frame->strides[1] = h->width / 2;
+  frame->strides[2] = h->width / 2;
+}
+
+static int futex_wait(uint32_t* addr, uint32_t val, int timeout_ms) {
+
+  struct timespec ts;
+  struct timespec* tsp = NULL;
+
+  if (timeout_ms >= 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+    tsp = &ts;
+  }
+
+  /* returns immediately with EAGAIN when the value already changed. */
+  if (0 != syscall(SYS_futex, addr, FUTEX_WAIT, val, tsp, NULL, 0)) {
+    if (EAGAIN == errno || EINTR == errno) {
+      return 0;
+    }
+    return -1;
+  }
+
+  return 0;
+}
+
+static int futex_wake(uint32_t* addr) {
+  return (int)syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
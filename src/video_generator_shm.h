@@ -0,0 +1,156 @@
+/*
+
+  Video Generator - Shared Memory Transport
+  ==========================================
+
+  Moves the generated frames to another process without copying them. The
+  producer creates a POSIX shared memory segment with a ring of frame slots
+  and renders each new frame directly into the next slot. The consumer maps
+  the same segment and reads the frames in place.
+
+  The ring never blocks the producer: it behaves like a capture device that
+  keeps delivering frames. When a consumer is too slow the producer will
+  overwrite slots that weren't read yet; this is detected and reported as
+  an overrun. Every published frame gets a sequence number (0, 1, 2, ...)
+  and the consumer is woken up using a futex on the shared header.
+
+  Each slot also carries the timestamp, fault flags and dirty rectangles of 
+  its frame, so a consumer gets the same information as a caller of 
+  `video_generator_update()`. The dirty rectangles describe the change 
+  since the previous frame of the producer; a consumer that missed frames 
+  (see `overruns`) has to treat the whole frame as changed.
+
+  This transport is only available on Linux.
+
+  Producer:
+
+     video_generator_shm_create()   - create the segment for the given generator.
+     video_generator_shm_update()   - render the next frame into the next slot and publish it.
+     video_generator_shm_destroy()  - wakes up the consumers, unmaps and removes the segment.
+                                      The generator renders into its own buffer again.
+     video_generator_shm_remove()   - remove a segment that a crashed producer left behind. 
+                                      create() fails when the segment exists, because it 
+                                      may belong to a producer that is still running.
+
+  Consumer:
+
+     video_generator_shm_open()     - map the segment that was created by the producer.
+     video_generator_shm_acquire()  - wait for the next frame, returns pointers into the segment.
+     video_generator_shm_release()  - call when done with the frame. Returns
+                                      VIDEO_GENERATOR_SHM_OVERRUN when the producer overwrote
+                                      the frame while you were using it.
+     video_generator_shm_close()    - unmap the segment.
+
+  <example>
+
+     video_generator_shm shm;
+     video_generator_shm_frame frame;
+
+     video_generator_shm_open(&shm, "/video_generator");
+
+     while (1) {
+       r = video_generator_shm_acquire(&shm, &frame, 1000);
+       if (VIDEO_GENERATOR_SHM_CLOSED == r) {
+         break;
+       }
+       if (0 != r) {
+         continue;
+       }
+
+       encode(frame.planes, frame.strides);
+       video_generator_shm_release(&shm, &frame);
+     }
+
+     printf("Missed %llu frames.\n", shm.overruns);
+     video_generator_shm_close(&shm);
+
+  </example>
+ */
+
+#ifndef VIDEO_GENERATOR_SHM_H
+#define VIDEO_GENERATOR_SHM_H
+
+#include <stddef.h>
+#include <video_generator.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VIDEO_GENERATOR_SHM_MAX_SLOTS 64
+#define VIDEO_GENERATOR_SHM_TIMEOUT 1                            /* acquire() timed out; there was no new frame. */
+#define VIDEO_GENERATOR_SHM_CLOSED 2                             /* acquire() found that the producer is gone. */
+#define VIDEO_GENERATOR_SHM_OVERRUN 3                            /* release() found that the frame was overwritten. */
+
+typedef struct video_generator_shm video_generator_shm;
+typedef struct video_generator_shm_header video_generator_shm_header;
+typedef struct video_generator_shm_slot video_generator_shm_slot;
+typedef struct video_generator_shm_frame video_generator_shm_frame;
+
+struct video_generator_shm_slot {
+  uint64_t seq;                                                  /* sequence number of the frame in this slot, UINT64_MAX while being written. */
+  uint64_t frame;                                                /* the `frame` of the generator for this slot. */
+  video_generator_timestamp timestamp;                           /* the `timestamp` of the generator for this slot. */
+  uint32_t fault_flags;                                          /* the `fault_flags` of the generator for this slot. */
+  uint32_t num_dirty_rects;                                      /* number of elements in `dirty_rects`. */
+  video_generator_rect dirty_rects[VIDEO_GENERATOR_MAX_DIRTY_RECTS]; /* the `dirty_rects` of the generator for this slot. */
+};
+
+/* Lives at the start of the segment. */
+struct video_generator_shm_header {
+  uint32_t magic;                                                /* VIDEO_GENERATOR_SHM_MAGIC */
+  uint32_t version;                                              /* layout version. */
+  uint32_t width;                                                /* width of the frames. */
+  uint32_t height;                                               /* height of the frames. */
+  uint32_t fps_num;                                              /* framerate numerator. */
+  uint32_t fps_den;                                              /* framerate denominator. */
+  uint32_t nslots;                                               /* number of slots in the ring. */
+  uint32_t frame_nbytes;                                         /* number of bytes of one yuv420p frame. */
+  uint64_t slot_offset;                                          /* offset of the first slot from the start of the segment. */
+  uint64_t slot_stride;                                          /* distance between slots, page aligned. */
+  uint32_t is_open;                                              /* 1 while the producer is running. */
+  uint32_t futex;                                                /* lower 32 bits of write_seq, consumers wait on this. */
+  uint64_t write_seq;                                            /* number of published frames. */
+  video_generator_shm_slot slots[VIDEO_GENERATOR_SHM_MAX_SLOTS];
+};
+
+struct video_generator_shm_frame {
+  uint64_t seq;                                                  /* sequence number of the frame. */
+  uint64_t frame;                                                /* frame number of the generator. */
+  uint8_t* planes[3];                                            /* y, u and v planes inside the segment. */
+  uint32_t strides[3];                                           /* strides of the planes. */
+  uint32_t width;                                                /* width of the frame. */
+  uint32_t height;                                               /* height of the frame. */
+  video_generator_timestamp timestamp;                           /* timestamp of the frame. */
+  uint32_t fault_flags;                                          /* VIDEO_GENERATOR_FAULT_* flags of the frame. */
+  uint32_t num_dirty_rects;                                      /* number of elements in `dirty_rects`. */
+  video_generator_rect dirty_rects[VIDEO_GENERATOR_MAX_DIRTY_RECTS]; /* areas that changed since the previous frame, relative to the previous published frame. */
+};
+
+struct video_generator_shm {
+  char name[256];                                                /* name of the segment, e.g. "/video_generator". */
+  int fd;                                                        /* file descriptor of the segment. */
+  int is_producer;                                               /* 1 when we created the segment. */
+  uint8_t* base;                                                 /* start of the mapped segment. */
+  size_t nbytes;                                                 /* size of the mapped segment. */
+  video_generator_shm_header* header;                            /* points to `base`. */
+  uint64_t read_seq;                                             /* consumer: sequence number of the next frame we want to read. */
+  uint64_t overruns;                                             /* consumer: number of frames we lost because we were too slow. */
+  video_generator* gen;                                          /* producer: the generator that renders into the slots. */
+};
+
+int video_generator_shm_create(video_generator_shm* shm, const char* name, video_generator* g, uint32_t nslots);
+int video_generator_shm_update(video_generator_shm* shm, video_generator* g);
+int video_generator_shm_destroy(video_generator_shm* shm);
+int video_generator_shm_remove(const char* name);
+
+int video_generator_shm_open(video_generator_shm* shm, const char* name);
+int video_generator_shm_acquire(video_generator_shm* shm, video_generator_shm_frame* frame, int timeout_ms);
+int video_generator_shm_release(video_generator_shm* shm, video_generator_shm_frame* frame);
+int video_generator_shm_close(video_generator_shm* shm);
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <video_generator_trace.h>
+
+#if defined(VIDEO_GENERATOR_TRACE)
+
+#if defined(_WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  define TRACE_THREAD_LOCAL __declspec(thread)
+#  define trace_atomic_inc(ptr) ((uint32_t)InterlockedIncrement((volatile LONG*)(ptr)) - 1)
+#  define trace_atomic_load(ptr) (MemoryBarrier(), *(ptr))
+#  define trace_atomic_store(ptr, val) do { MemoryBarrier(); *(ptr) = (val); } while (0)
+#  define trace_atomic_claim(ptr) (0 == InterlockedCompareExchange((volatile LONG*)(ptr), 1, 0))
+#else
+#  include <time.h>
+#  define TRACE_THREAD_LOCAL __thread
+#  define trace_atomic_inc(ptr) __atomic_fetch_add((ptr), 1, __ATOMIC_ACQ_REL)
+#  define trace_atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#  define trace_atomic_store(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#  define trace_atomic_claim(ptr) __sync_bool_compare_and_swap((ptr), 0, 1)
+#endif
+
+#define TRACE_SPAN 'X'
+#define TRACE_INSTANT 'i'
+
+/* ----------------------------------------------------------------------------------- */
+
+typedef struct trace_event trace_event;
+typedef struct trace_ring trace_ring;
+
+struct trace_event {
+  const char* name;                                              /* string literal. */
+  uint64_t start;                                                /* start time in ns. */
+  uint64_t duration;                                             /* duration in ns, spans only. */
+  int64_t value;                                                 /* value of an instant event. */
+  char type;                                                     /* TRACE_SPAN or TRACE_INSTANT. */
+};
+
+struct trace_ring {
+  uint32_t tid;                                                  /* thread id in the trace. */
+  const char* name;                                              /* name of the thread, or NULL. */
+  volatile int32_t in_use;                                       /* 1 while a thread records into this ring, 0 when it can be reused. */
+  uint64_t count;                                                /* number of recorded events, the ring index is count % capacity. */
+  trace_event events[VIDEO_GENERATOR_TRACE_CAPACITY];
+};
+
+/* ----------------------------------------------------------------------------------- */
+
+static trace_ring* trace_get_ring();
+static void trace_push(trace_ring* ring, const char* name, uint64_t start, uint64_t duration, int64_t value, char type);
+
+/* ----------------------------------------------------------------------------------- */
+
+static trace_ring* rings[VIDEO_GENERATOR_TRACE_MAX_THREADS];
+static uint32_t nrings = 0;
+static TRACE_THREAD_LOCAL trace_ring* thread_ring = NULL;
+static TRACE_THREAD_LOCAL int thread_ring_failed = 0;
+
+/* ----------------------------------------------------------------------------------- */
+
+uint64_t video_generator_trace_now() {
+#if defined(_WIN32)
+  static LARGE_INTEGER freq;
+  LARGE_INTEGER now;
+  if (0 == freq.QuadPart) {
+    QueryPerformanceFrequency(&freq);
+  }
+  QueryPerformanceCounter(&now);
+  return (uint64_t)((1e9 * now.QuadPart) / freq.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+void video_generator_trace_span(const char* name, uint64_t start_ns, uint64_t end_ns) {
+  trace_ring* ring = trace_get_ring();
+  if (NULL == ring) {
+    return;
+  }
+  trace_push(ring, name, start_ns, (end_ns > start_ns) ? (end_ns - start_ns) : 0, 0, TRACE_SPAN);
+}
+
+void video_generator_trace_instant(const char* name, int64_t value) {
+  trace_ring* ring = trace_get_ring();
+  if (NULL == ring) {
+    return;
+  }
+  trace_push(ring, name, video_generator_trace_now(), 0, value, TRACE_INSTANT);
+}
+
+void video_generator_trace_thread_name(const char* name) {
+  trace_ring* ring = trace_get_ring();
+  if (NULL == ring) {
+    return;
+  }
+  ring->name = name;
+}
+
+/* The events stay in the ring until another thread takes it. */
+void video_generator_trace_thread_exit() {
+
+  if (NULL != thread_ring) {
+    trace_atomic_store(&thread_ring->in_use, 0);
+    thread_ring = NULL;
+  }
+
+  thread_ring_failed = 0;
+}
+
+int video_generator_trace_dump(const char* filepath) {
+
+  FILE* fp;
+  trace_ring* ring;
+  trace_event* ev;
+  uint64_t count, first, base, i;
+  uint32_t n, k;
+  int is_first = 1;
+
+  if (!filepath) { return -1; }
+
+  fp = fopen(filepath, "wb");
+  if (!fp) {
+    printf("Error: cannot open the trace file %s.\n", filepath);
+    return -2;
+  }
+
+  n = trace_atomic_load(&nrings);
+  if (n > VIDEO_GENERATOR_TRACE_MAX_THREADS) {
+    n = VIDEO_GENERATOR_TRACE_MAX_THREADS;
+  }
+
+  /* timestamps are written relative to the oldest event. */
+  base = UINT64_MAX;
+  for (k = 0; k < n; ++k) {
+    ring = (trace_ring*)trace_atomic_load(&rings[k]);
+    if (NULL == ring) {
+      continue;
+    }
+    /* spans are recorded when they end, so the oldest one isn't always first. */
+    count = trace_atomic_load(&ring->count);
+    first = (count > VIDEO_GENERATOR_TRACE_CAPACITY) ? (count - VIDEO_GENERATOR_TRACE_CAPACITY) : 0;
+    for (i = first; i < count; ++i) {
+      if (ring->events[i % VIDEO_GENERATOR_TRACE_CAPACITY].start < base) {
+        base = ring->events[i % VIDEO_GENERATOR_TRACE_CAPACITY].start;
+      }
+    }
+  }
+
+  if (UINT64_MAX == base) {
+    base = 0;
+  }
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+  for (k = 0; k < n; ++k) {
+
+    ring = (trace_ring*)trace_atomic_load(&rings[k]);
+    if (NULL == ring) {
+      continue;
+    }
+
+    if (NULL != ring->name) {
+      fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+              is_first ? "" : ",\n", ring->tid, ring->name);
+      is_first = 0;
+    }
+
+    count = trace_atomic_load(&ring->count);
+    first = (count > VIDEO_GENERATOR_TRACE_CAPACITY) ? (count - VIDEO_GENERATOR_TRACE_CAPACITY) : 0;
+
+    for (i = first; i < count; ++i) {
+
+      ev = &ring->events[i % VIDEO_GENERATOR_TRACE_CAPACITY];
+
+      if (TRACE_SPAN == ev->type) {
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                is_first ? "" : ",\n", ev->name, ring->tid,
+                (ev->start - base) / 1000.0, ev->duration / 1000.0);
+      }
+      else {
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                is_first ? "" : ",\n", ev->name, ring->tid,
+                (ev->start - base) / 1000.0, (long long)ev->value);
+      }
+
+      is_first = 0;
+    }
+  }
+
+  fprintf(fp, "\n]}\n");
+
+  if (0 != fclose(fp)) {
+    printf("Error: failed to close the trace file.\n");
+    return -3;
+  }
+
+  return 0;
+}
+
+void video_generator_trace_reset() {
+
+  uint32_t n, k;
+  trace_ring* ring;
+
+  n = trace_atomic_load(&nrings);
+  if (n > VIDEO_GENERATOR_TRACE_MAX_THREADS) {
+    n = VIDEO_GENERATOR_TRACE_MAX_THREADS;
+  }
+
+  for (k = 0; k < n; ++k) {
+    ring = (trace_ring*)trace_atomic_load(&rings[k]);
+    if (NULL != ring) {
+      trace_atomic_store(&ring->count, 0);
+    }
+  }
+}
+
+/* ----------------------------------------------------------------------------------- */
+
+/* 
+   Returns the ring of the calling thread. The first call takes the ring of
+   a thread that exited, or allocates a new one.
+*/
+static trace_ring* trace_get_ring() {
+
+  uint32_t slot, n, k;
+  trace_ring* ring;
+
+  if (NULL != thread_ring) {
+    return thread_ring;
+  }
+
+  if (0 != thread_ring_failed) {
+    return NULL;
+  }
+
+  n = trace_atomic_load(&nrings);
+  if (n > VIDEO_GENERATOR_TRACE_MAX_THREADS) {
+    n = VIDEO_GENERATOR_TRACE_MAX_THREADS;
+  }
+
+  for (k = 0; k < n; ++k) {
+    ring = (trace_ring*)trace_atomic_load(&rings[k]);
+    if (NULL != ring && trace_atomic_claim(&ring->in_use)) {
+      ring->name = NULL;
+      trace_atomic_store(&ring->count, 0);
+      thread_ring = ring;
+      return ring;
+    }
+  }
+
+  slot = trace_atomic_inc(&nrings);
+  if (slot >= VIDEO_GENERATOR_TRACE_MAX_THREADS) {
+    printf("Error: too many threads are tracing, max is %d.\n", VIDEO_GENERATOR_TRACE_MAX_THREADS);
+    thread_ring_failed = 1;
+    return NULL;
+  }
+
+  ring = (trace_ring*)calloc(1, sizeof(trace_ring));
+  if (NULL == ring) {
+    printf("Error: cannot allocate the trace ring.\n");
+    thread_ring_failed = 1;
+    return NULL;
+  }
+
+  ring->tid = slot + 1;
+  ring->in_use = 1;
+  thread_ring = ring;
+  trace_atomic_store(&rings[slot], ring);
+
+  return ring;
+}
+
+static void trace_push(trace_ring* ring, const char* name, uint64_t start, uint64_t duration, int64_t value, char type) {
+
+  uint64_t count = ring->count;
+  trace_event* ev = &ring->events[count % VIDEO_GENERATOR_TRACE_CAPACITY];
+
+  ev->name = name;
+  ev->start = start;
+  ev->duration = duration;
+  ev->value = value;
+  ev->type = type;
+
+  /* publish the event for the dumping thread. */
+  trace_atomic_store(&ring->count, count + 1);
+}
+
+#else
+
+/* ----------------------------------------------------------------------------------- */
+/* Tracing disabled.                                                                   */
+/* ----------------------------------------------------------------------------------- */
+
+uint64_t video_generator_trace_now() {
+  return 0;
+}
+
+void video_generator_trace_span(const char* name, uint64_t start_ns, uint64_t end_ns) {
+  (void)name;
+  (void)start_ns;
+  (void)end_ns;
+}
+
+void video_generator_trace_instant(const char* name, int64_t value) {
+  (void)name;
+  (void)value;
+}
+
+void video_generator_trace_thread_name(const char* name) {
+  (void)name;
+}
+
+void video_generator_trace_thread_exit() {
+}
+
+int video_generator_trace_dump(const char* filepath) {
+  (void)filepath;
+  printf("Error: tracing is disabled, compile with VIDEO_GENERATOR_TRACE.\n");
+  return -1;
+}
+
+void video_generator_trace_reset() {
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+
+  Video Generator - Tracing
+  ==========================
+
+  When a soak test misses deadlines you want to know where the time went.
+  With tracing enabled the generator records a span for each stage of
+  `video_generator_update()` (bars, pattern, timeline, time box, text), the
+  wakeups of the audio thread (with how late they were) and the duration of
+  every audio callback. You can add spans for your own
+  stages with the same macros. `video_generator_trace_dump()` writes all
+  events as Chrome trace-event JSON which can be opened in chrome://tracing
+  or https://ui.perfetto.dev.
+
+  Tracing is compiled in when VIDEO_GENERATOR_TRACE is defined (cmake:
+  -DVIDEO_GENERATOR_TRACE=ON). Without it the macros are empty and the
+  functions below do nothing, so there is no overhead at all.
+
+  Every thread records into its own ring buffer of VIDEO_GENERATOR_TRACE_CAPACITY
+  events, so recording doesn't need a lock; when a ring is full the oldest
+  events are overwritten. The ring of a thread is allocated the first time
+  it records an event. A thread that exits should release its ring with 
+  VIDEO_GENERATOR_TRACE_THREAD_EXIT() so the next thread reuses it; the 
+  audio thread does this, so creating and clearing generators in a loop 
+  doesn't run out of rings. Its events are kept until the ring is reused.
+  Names are stored as pointers, so use string literals.
+
+     VIDEO_GENERATOR_TRACE_BEGIN(var)          - declares `var` and stores the start time in it.
+     VIDEO_GENERATOR_TRACE_END(var, name)      - records a span from `var` until now.
+     VIDEO_GENERATOR_TRACE_INSTANT(name, val)  - records an instant event with a value.
+     VIDEO_GENERATOR_TRACE_THREAD(name)        - sets the name of the calling thread in the trace.
+     VIDEO_GENERATOR_TRACE_THREAD_EXIT()       - releases the ring of the calling thread.
+
+     video_generator_trace_dump()              - write all events to a JSON file. Dump when the
+                                                 traced threads are idle; events that are
+                                                 recorded while dumping can be torn.
+     video_generator_trace_reset()             - forget all recorded events.
+
+  <example>
+
+     VIDEO_GENERATOR_TRACE_BEGIN(t);
+     encode(gen.y);
+     VIDEO_GENERATOR_TRACE_END(t, "encode");
+
+     ...
+
+     video_generator_trace_dump("trace.json");
+
+  </example>
+ */
+
+#ifndef VIDEO_GENERATOR_TRACE_H
+#define VIDEO_GENERATOR_TRACE_H
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define VIDEO_GENERATOR_TRACE_CAPACITY 16384                     /* number of events per thread. */
+#define VIDEO_GENERATOR_TRACE_MAX_THREADS 64                     /* max number of threads that can record events. */
+
+#if defined(VIDEO_GENERATOR_TRACE)
+#  define VIDEO_GENERATOR_TRACE_BEGIN(var) uint64_t var = video_generator_trace_now()
+#  define VIDEO_GENERATOR_TRACE_END(var, name) video_generator_trace_span(name, var, video_generator_trace_now())
+#  define VIDEO_GENERATOR_TRACE_INSTANT(name, val) video_generator_trace_instant(name, val)
+#  define VIDEO_GENERATOR_TRACE_THREAD(name) video_generator_trace_thread_name(name)
+#  define VIDEO_GENERATOR_TRACE_THREAD_EXIT() video_generator_trace_thread_exit()
+#else
+#  define VIDEO_GENERATOR_TRACE_BEGIN(var)
+#  define VIDEO_GENERATOR_TRACE_END(var, name)
+#  define VIDEO_GENERATOR_TRACE_INSTANT(name, val)
+#  define VIDEO_GENERATOR_TRACE_THREAD(name)
+#  define VIDEO_GENERATOR_TRACE_THREAD_EXIT()
+#endif
+
+uint64_t video_generator_trace_now();
+void video_generator_trace_span(const char* name, uint64_t start_ns, uint64_t end_ns);
+void video_generator_trace_instant(const char* name, int64_t value);
+void video_generator_trace_thread_name(const char* name);
+void video_generator_trace_thread_exit();
+int video_generator_trace_dump(const char* filepath);
+void video_generator_trace_reset();
+
+#if defined(__cplusplus)
+} /* extern "C" */
+#endif
+
+#endif